@@ -10,7 +10,7 @@
 *******************************************************************************/
 
 #include <stdlib.h>
-#include <math.h>           /* pow, exp */
+#include <math.h>           /* pow, exp, lgamma */
 #include <stdio.h>          /* printf */
 #include <string.h>         /* strlen */
 #include <fcntl.h>          /* O_RDWR */
@@ -18,7 +18,20 @@
 #include <sys/types.h>      /* */
 #include <sys/stat.h>       /* fstat */
 #include <unistd.h>         /* close */
+#include <dirent.h>         /* opendir, readdir */
 #include "bloom.h"
+#if defined(_OPENMP)
+#include <omp.h>            /* omp_get_thread_num */
+#endif
+
+/* x86 kernels selected at runtime are compiled with target attributes */
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define BLOOM_X86_DISPATCH
+#endif
+
+#if defined(BLOOM_X86_DISPATCH)
+#include <immintrin.h>      /* split block bloom filter and popcount kernels */
+#endif
 
 
 #define CHECK_BIT_CHAR(c, k)  ((c) & (1 << (k)))
@@ -31,6 +44,62 @@
 #define LOG_TWO_SQUARED  0.480453013918201388143813800   // 0.4804530143737792968750000
                                                         // 0.4804530143737792968750000
 #define LOG_TWO 0.693147180559945286226764000
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+/*  Bloom filters that do not use the original defaults store their options in a
+    block between the bloom and the trailer so that older files remain readable:
+    [bloom][options (uint32)][magic (uint32)][estimated elements][elements added][fpr] */
+#define BLOOM_EXT_MAGIC 0x584d4c42  // "BLMX"
+#define BLOOM_EXT_SIZE (2 * sizeof(uint32_t))
+#define BLOOM_TRAILER_SIZE (2 * sizeof(uint64_t) + sizeof(float))
+#define BLOOM_BLOCKED_MAGIC 0x4b4c4242  // "BBLK"
+#define BLOOM_CACHE_LINE 64
+#define BLOOM_BLOCK_HASHES_PER_MIX 7  // 9 bit positions taken from each 64 bit mix
+#define BLOOM_BLOCK_EXACT_MAX 32       // larger inclusion-exclusion sums lose precision
+#define SBBF_MAGIC 0x46424253  // "SBBF"
+#define BLOOM_BSI_MAGIC 0x49534242  // "BBSI"
+#define BLOOM_BSI_HEADER_SIZE 64  // keeps the mapped rows cache line aligned
+#define BLOOM_BSI_GROUP 64  // filters transposed together, one bit of a row word each
+#define BLOOM_BSI_BLOCK_WORDS 64  // row words (4096 filters) ANDed at a time by a query
+#define BLOOM_BSI_BUILD_BYTES (256 << 20)  // most filter bytes read at a time when building from files
+#define BLOOM_TREE_MAGIC 0x45525442  // "BTRE"
+#define BLOOM_TREE_HEADER_SIZE 64  // keeps the mapped nodes cache line aligned
+#define BLOOM_BATCH_WINDOW 16  // keys hashed and prefetched ahead of setting their bits
+#define BLOOM_BATCH_LOOKUPS 16  // lookups interleaved by the batch checks
+#define BLOOM_BULK_STAGED (1 << 23)  // bit positions staged at a time by the bulk load
+#define BLOOM_BULK_REGION 4096  // smallest region (a page) the bulk load partitions into
+#define BLOOM_BULK_MAX_PARTITIONS 1024
+#define BLOOM_BULK_MIN_BYTES (64 << 20)  // smaller filters use the prefetching batch instead
+#define BLOOM_BULK_THREAD_WORDS (1 << 15)  // fewest words (256 KB) worth giving a bulk operation thread
+#define BLOOM_MANY_BLOCK_WORDS 512  // the N-way union and intersection build 4 KB of output at a time
+#define BLOOM_MANY_FILTERS_AHEAD 4  // filters whose bits are prefetched ahead of checking a key against them
+#define BLOOM_KEY_HASHES(key) ((key)->__heap != NULL ? (key)->__heap : (key)->__stack)
+
+#if defined(__GNUC__) || defined(__clang__)
+#define BLOOM_PREFETCH(addr, rw) __builtin_prefetch((addr), (rw), 3)
+#else
+#define BLOOM_PREFETCH(addr, rw)
+#endif
+
+/*  Thread safe inserts use the __atomic builtins (what C11 atomics are built on) so
+    they work from any threading runtime and when compiled as C++. Words of the bit
+    array hold bit i of the filter at bit i % 64 only on little endian machines;
+    otherwise the atomics are done on the byte. */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+typedef unsigned char bloom_atomic_t;
+#else
+typedef uint64_t __attribute__((__may_alias__)) bloom_atomic_t;
+#endif
+#define BLOOM_ATOMIC_BITS (8 * sizeof(bloom_atomic_t))
+
+/*  In thread safe mode each thread adds to its own stripe of the element count (and
+    of the bits set), one cache line apart, and the stripes are folded into
+    elements_added (and the bits set) when they are read */
+#define BLOOM_COUNTER_STRIPES 64
+#define BLOOM_COUNTER_STRIDE (BLOOM_CACHE_LINE / sizeof(uint64_t))
+static __thread unsigned int bloom_thread_stripe = 0;  // 0 until the thread first adds
+static unsigned int bloom_next_stripe = 0;
 
 /* https://graphics.stanford.edu/~seander/bithacks.html#CountBitsSetTable */
 #define B2(n) n,     n+1,     n+1,     n+2
@@ -43,57 +112,236 @@ static const unsigned char bits_set_table[256] = {B6(0), B6(1), B6(1), B6(2)};
 ***  PRIVATE FUNCTIONS
 *******************************************************************************/
 static uint64_t* __default_hash(int num_hashes, const char *str);
-static uint64_t __fnv_1a(const char *key, int seed);
+static void __default_hash_noalloc(int num_hashes, const char *str, uint64_t *results);
+static void __default_hash_bytes(int num_hashes, const void *key, size_t len, uint64_t *results);
+static uint64_t __fnv_1a_bytes(const unsigned char *key, size_t len, int seed);
+static void __double_fnv_1a_hash(int num_hashes, const char *str, uint64_t *results);
+static void __double_fnv_1a_hash_bytes(int num_hashes, const void *key, size_t len, uint64_t *results);
+static void __double_hash_finalize(uint64_t h1, uint64_t h2, int num_hashes, uint64_t *results);
+static void __xxh64_hash_bytes(int num_hashes, const void *key, size_t len, uint64_t *results);
+static void __murmur3_hash_bytes(int num_hashes, const void *key, size_t len, uint64_t *results);
+static void __double_hash_from_64(uint64_t h, int num_hashes, uint64_t *results);
+static uint64_t __xxh64(const void *key, size_t len, uint64_t seed);
+static void __murmur3_128(const void *key, size_t len, uint64_t seed, uint64_t *out1, uint64_t *out2);
+static __inline__ uint64_t __read64(const unsigned char *p);
+static __inline__ uint64_t __read32(const unsigned char *p);
+static __inline__ uint64_t __rotl64(uint64_t x, int r);
+static uint64_t* __hash_buffer(BloomFilter *bf, uint64_t *stack_buffer);
+static void __hash_u64(uint64_t key, uint64_t *h1, uint64_t *h2);
+static void __hash_u128(uint64_t high, uint64_t low, uint64_t *h1, uint64_t *h2);
+static __inline__ uint64_t __map_bit(BloomFilter *bf, uint64_t hash);
+static __inline__ int __check_mapped_bit(BloomFilter *bf, uint64_t bit);
+static int __key_init(BloomKey *key, BloomFilter *bf);
+static int __key_fits(BloomFilter *bf, const BloomKey *key);
+static __inline__ uint64_t __key_bit(BloomFilter *bf, const BloomKey *key, unsigned int i);
+static __inline__ uint64_t __mulhi64(uint64_t a, uint64_t b);
+static __inline__ void __set_bit(BloomFilter *bf, uint64_t hash);
+static __inline__ int __check_bit(BloomFilter *bf, uint64_t hash);
+static void __increment_elements_added(BloomFilter *bf);
+static void __add_elements_added(BloomFilter *bf, uint64_t count);
+static void __fold_elements_added(BloomFilter *bf);
+static void __discard_elements_added(BloomFilter *bf);
+static __inline__ uint64_t* __counter_stripe(BloomFilter *bf);
+static __inline__ void __add_bits_set(BloomFilter *bf);
+static void __recount_bits_set(BloomFilter *bf);
+static __inline__ void __set_mapped_bit(BloomFilter *bf, uint64_t bit);
+static __inline__ int __test_and_set_mapped_bit(BloomFilter *bf, uint64_t bit);
+
+/*  the keys of a batch; either byte strings (lengths may be NULL), 64 bit integers,
+    or keys supplied by a callback */
+typedef struct bloom_batch {
+    const char * const *keys;
+    const size_t *lengths;
+    const uint64_t *ints;
+    BloomKeyCallback key_at;
+    void *user_data;
+} BloomBatch;
+static void __batch_bits(BloomFilter *bf, const BloomBatch *batch, size_t idx, uint64_t *bits);
+static int __add_batch(BloomFilter *bf, const BloomBatch *batch, size_t num_keys);
+static int __add_batch_bits(BloomFilter *bf, const BloomBatch *batch, size_t first, size_t num_keys, int is_private, unsigned char *results);
+static int __add_if_absent_batch(BloomFilter *bf, const BloomBatch *batch, size_t num_keys, unsigned char *results);
+static int __parallel_build(BloomFilter *bf, const BloomBatch *batch, size_t num_keys, int num_threads);
+
+/* the word loops shared by the bulk operations */
+typedef enum bloom_bulk_op {
+    BLOOM_BULK_OR,
+    BLOOM_BULK_AND,
+    BLOOM_BULK_CLEAR,
+    BLOOM_BULK_COUNT
+} BloomBulkOp;
+static int __bulk_thread_count(uint64_t words);
+static uint64_t __bulk_slice_start(uint64_t words, int t, int threads);
+static uint64_t __bulk_words(BloomBulkOp op, unsigned char *res, const unsigned char *a, const unsigned char *b, uint64_t words);
+static void __pair_counts(BloomFilter *bf1, BloomFilter *bf2, BloomPairCounts *counts);
+static int __combine_many(BloomFilter *res, BloomFilter **filters, size_t num_filters, int intersect);
+static uint64_t __combine_many_slice(BloomFilter *res, BloomFilter **filters, size_t num_filters, int intersect, uint64_t first, uint64_t last);
+static void __popcount_pair_words(const unsigned char *a, const unsigned char *b, uint64_t words, uint64_t *counts);
+static uint64_t __bulk_slice(BloomBulkOp op, unsigned char *res, const unsigned char *a, const unsigned char *b, uint64_t first, uint64_t last);
+static int __check_batch(BloomFilter *bf, const BloomBatch *batch, size_t num_keys, unsigned char *results, int bitmap);
+static int __bulk_load(BloomFilter *bf, const BloomBatch *batch, size_t num_keys);
+static uint64_t __fmix64(uint64_t h);
+static int __init_in_memory(BloomFilter *bf, uint64_t estimated_elements, float false_positive_rate, BloomHashFunction hash_function, BloomHashType hash_type, BloomIndexMapping index_mapping);
+static int __init_on_disk(BloomFilter *bf, uint64_t estimated_elements, float false_positive_rate, const char *filepath, BloomHashFunction hash_function, BloomHashType hash_type, BloomIndexMapping index_mapping);
+static int __has_options(BloomFilter *bf);
+static uint32_t __get_options(BloomFilter *bf);
+static int __set_options(BloomFilter *bf, uint32_t options);
 static void __calculate_optimal_hashes(BloomFilter *bf);
 static void __read_from_file(BloomFilter *bf, FILE *fp, short on_disk, const char *filename);
 static void __write_to_file(BloomFilter *bf, FILE *fp, short on_disk);
 static void __update_elements_added_on_disk(BloomFilter *bf);
 static int __sum_bits_set_char(unsigned char c);
 static int __check_if_union_or_intersection_ok(BloomFilter *res, BloomFilter *bf1, BloomFilter *bf2);
+static void* __aligned_calloc(size_t bytes);
+static unsigned char* __alloc_bloom(BloomFilter *bf);
+static __inline__ uint64_t __load_word(const unsigned char *bytes, uint64_t i);
+static __inline__ void __store_word(unsigned char *bytes, uint64_t i, uint64_t word);
+static __inline__ uint64_t __popcount64(uint64_t word);
+static uint64_t __popcount_words(const unsigned char *bytes, uint64_t words);
+static int __blocked_calculate_optimal_size(BlockedBloomFilter *bf);
+static double __blocked_best_hashes(uint64_t n, uint64_t blocks, unsigned int *number_hashes);
+static double __poisson_pmf(double j, double lambda);
+static int __blocked_alloc(BlockedBloomFilter *bf);
+static uint64_t __blocked_bytes(BlockedBloomFilter *bf);
+static int __blocked_add(BlockedBloomFilter *bf, uint64_t hash);
+static int __blocked_check(BlockedBloomFilter *bf, uint64_t hash);
+static uint32_t* __sbbf_block(SplitBlockBloomFilter *bf, uint64_t hash);
+static __inline__ void __sbbf_insert(uint32_t *block, uint32_t key);
+static __inline__ int __sbbf_check(const uint32_t *block, uint32_t key);
+static void __sbbf_copy_le(void *dst, const void *src, uint64_t number_bytes);
+static int __sbbf_alloc(SplitBlockBloomFilter *bf, uint64_t number_bytes);
+static uint64_t __sbbf_estimate_elements(SplitBlockBloomFilter *bf);
+static void __copy_params(BloomFilter *params, BloomFilter *like);
+static int __tree_create(BloomFilterTree *tree, BloomFilter *like, uint64_t number_leaves, unsigned int fanout, const char *filepath);
+static int __tree_build_levels(BloomFilterTree *tree, int num_threads);
+static int __tree_build_node(BloomFilterTree *tree, unsigned int level, uint64_t index);
+static __inline__ unsigned char* __tree_node(BloomFilterTree *tree, unsigned int level, uint64_t index);
+static void __tree_write_header(BloomFilterTree *tree, unsigned char *header);
+static int __tree_read_header(BloomFilterTree *tree, const unsigned char *header, uint64_t *number_leaves, unsigned int *fanout);
+static int __tree_layout(BloomFilterTree *tree, uint64_t number_leaves, unsigned int fanout);
+static int __tree_query(BloomFilterTree *tree, const BloomKey *key, uint64_t *ids, uint64_t *num_ids);
+static void __tree_descend(BloomFilterTree *tree, unsigned int level, uint64_t index, const uint64_t *bits, unsigned int k, uint64_t *ids, uint64_t *found);
+static __inline__ int __tree_node_has(const unsigned char *node, const uint64_t *bits, unsigned int k);
+static int __compare_strings(const void *a, const void *b);
+static uint64_t __bsi_row_words(uint64_t capacity);
+static uint64_t __bsi_rows_bytes(BitSlicedBloomIndex *idx, uint64_t row_words);
+static int __bsi_reserve(BitSlicedBloomIndex *idx, uint64_t number_filters);
+static int __bsi_map(BitSlicedBloomIndex *idx);
+static void __bsi_write_header(BitSlicedBloomIndex *idx, unsigned char *header);
+static int __bsi_read_header(BitSlicedBloomIndex *idx, const unsigned char *header);
+static void __bsi_append_group(BitSlicedBloomIndex *idx, BloomFilter **filters, size_t count);
+static __inline__ uint64_t __bsi_filter_word(BloomFilter *bf, uint64_t word);
+static int __bsi_query(BitSlicedBloomIndex *idx, const BloomKey *key, uint64_t *ids, uint64_t *num_ids);
+static void __transpose64(uint64_t *block);
+static void __and_rows(uint64_t *out, const uint64_t * const *rows, unsigned int number_rows, uint64_t first, uint64_t words);
 
 
 int bloom_filter_init_alt(BloomFilter *bf, uint64_t estimated_elements, float false_positive_rate, BloomHashFunction hash_function) {
-    if(estimated_elements == 0 || estimated_elements > UINT64_MAX || false_positive_rate <= 0.0 || false_positive_rate >= 1.0) {
-        return BLOOM_FAILURE;
-    }
-    bf->estimated_elements = estimated_elements;
-    bf->false_positive_probability = false_positive_rate;
-    __calculate_optimal_hashes(bf);
-    bf->bloom = (unsigned char*)calloc(bf->bloom_length + 1, sizeof(char)); // pad to ensure no running off the end
-    bf->elements_added = 0;
-    bloom_filter_set_hash_function(bf, hash_function);
-    bf->__is_on_disk = 0; // not on disk
-    return BLOOM_SUCCESS;
+    return __init_in_memory(bf, estimated_elements, false_positive_rate, hash_function, BLOOM_HASH_FNV1A, BLOOM_INDEX_MODULO);
+}
+
+int bloom_filter_init_options(BloomFilter *bf, uint64_t estimated_elements, float false_positive_rate, BloomHashType hash_type, BloomIndexMapping index_mapping) {
+    return __init_in_memory(bf, estimated_elements, false_positive_rate, NULL, hash_type, index_mapping);
 }
 
 int bloom_filter_init_on_disk_alt(BloomFilter *bf, uint64_t estimated_elements, float false_positive_rate, const char *filepath, BloomHashFunction hash_function) {
-    if(estimated_elements == 0 || estimated_elements > UINT64_MAX || false_positive_rate <= 0.0 || false_positive_rate >= 1.0) {
-        return BLOOM_FAILURE;
+    return __init_on_disk(bf, estimated_elements, false_positive_rate, filepath, hash_function, BLOOM_HASH_FNV1A, BLOOM_INDEX_MODULO);
+}
+
+int bloom_filter_init_on_disk_options(BloomFilter *bf, uint64_t estimated_elements, float false_positive_rate, const char *filepath, BloomHashType hash_type, BloomIndexMapping index_mapping) {
+    return __init_on_disk(bf, estimated_elements, false_positive_rate, filepath, NULL, hash_type, index_mapping);
+}
+
+void bloom_filter_set_hash_function(BloomFilter *bf, BloomHashFunction hash_function) {
+    if (hash_function != NULL) {
+        bf->hash_function = hash_function;
+        bf->hash_function_noalloc = NULL;
+        bf->hash_function_bytes = NULL;
+    } else if (bf->hash_type == BLOOM_HASH_FNV1A_DOUBLE) {
+        bf->hash_function = NULL;  // only the original default hash has an allocating version
+        bf->hash_function_noalloc = __double_fnv_1a_hash;
+        bf->hash_function_bytes = __double_fnv_1a_hash_bytes;
+    } else if (bf->hash_type == BLOOM_HASH_XXH64) {
+        bf->hash_function = NULL;
+        bf->hash_function_noalloc = NULL;  // strings are hashed as their bytes
+        bf->hash_function_bytes = __xxh64_hash_bytes;
+    } else if (bf->hash_type == BLOOM_HASH_MURMUR3_128) {
+        bf->hash_function = NULL;
+        bf->hash_function_noalloc = NULL;
+        bf->hash_function_bytes = __murmur3_hash_bytes;
+    } else {
+        bf->hash_function = __default_hash;
+        bf->hash_function_noalloc = __default_hash_noalloc;
+        bf->hash_function_bytes = __default_hash_bytes;
     }
-    bf->estimated_elements = estimated_elements;
-    bf->false_positive_probability = false_positive_rate;
-    __calculate_optimal_hashes(bf);
-    bf->elements_added = 0;
-    FILE *fp;
-    fp = fopen(filepath, "w+b");
-    if (fp == NULL) {
-        fprintf(stderr, "Can't open file %s!\n", filepath);
-        return BLOOM_FAILURE;
+}
+
+void bloom_filter_set_hash_function_noalloc(BloomFilter *bf, BloomHashFunctionNoAlloc hash_function) {
+    if (hash_function == NULL) {
+        bloom_filter_set_hash_function(bf, NULL);
+        return;
     }
-    __write_to_file(bf, fp, 1);
-    fclose(fp);
-    // slightly ineffecient to redo some of the calculations...
-    return bloom_filter_import_on_disk_alt(bf, filepath, hash_function);
+    bf->hash_function = NULL;
+    bf->hash_function_noalloc = hash_function;
+    bf->hash_function_bytes = NULL;
 }
 
-void bloom_filter_set_hash_function(BloomFilter *bf, BloomHashFunction hash_function) {
-    bf->hash_function = (hash_function == NULL) ? __default_hash : hash_function;
+void bloom_filter_set_hash_function_bytes(BloomFilter *bf, BloomHashFunctionBytes hash_function) {
+    if (hash_function == NULL) {
+        bloom_filter_set_hash_function(bf, NULL);
+        return;
+    }
+    bf->hash_function = NULL;
+    bf->hash_function_noalloc = NULL;  // strings are hashed as their bytes
+    bf->hash_function_bytes = hash_function;
+}
+
+void bloom_filter_set_thread_safe(BloomFilter *bf, int thread_safe) {
+    if (thread_safe != 0 && bf->__counters == NULL) {
+        // without the stripes all threads share the one atomic count
+        bf->__counters = (uint64_t*)__aligned_calloc(BLOOM_COUNTER_STRIPES * BLOOM_CACHE_LINE);
+    } else if (thread_safe == 0 && bf->__counters != NULL) {
+        __fold_elements_added(bf);
+        free(bf->__counters);
+        bf->__counters = NULL;
+    }
+    bf->__thread_safe = (thread_safe != 0);
+}
+
+void bloom_filter_set_track_bits(BloomFilter *bf, int track_bits) {
+    if (track_bits != 0 && bf->__track_bits == 0) {
+        __fold_elements_added(bf);  // drop any stripe counts of bits left from tracking before
+        bf->__bits_set = bloom_filter_count_set_bits(bf);
+    }
+    bf->__track_bits = (track_bits != 0);
+}
+
+uint64_t bloom_filter_elements_added(BloomFilter *bf) {
+    __fold_elements_added(bf);
+    return bf->elements_added;
+}
+
+void bloom_filter_set_sync_interval(BloomFilter *bf, uint64_t interval) {
+    bf->__sync_interval = interval;
+}
+
+int bloom_filter_sync(BloomFilter *bf) {
+    if (bf->__is_on_disk == 0) {
+        return BLOOM_SUCCESS;
+    }
+    __fold_elements_added(bf);
+    __update_elements_added_on_disk(bf);
+    if (msync(bf->bloom, bf->__filesize, MS_SYNC) != 0) {
+        return BLOOM_FAILURE;
+    }
+    return BLOOM_SUCCESS;
 }
 
 int bloom_filter_destroy(BloomFilter *bf) {
+    bloom_filter_set_thread_safe(bf, 0);  // fold the count so the file trailer is exact
     if (bf->__is_on_disk == 0) {
         free(bf->bloom);
     } else {
+        __update_elements_added_on_disk(bf);
         fclose(bf->filepointer);
         munmap(bf->bloom, bf->__filesize);
     }
@@ -105,16 +353,26 @@ int bloom_filter_destroy(BloomFilter *bf) {
     bf->number_hashes = 0;
     bf->number_bits = 0;
     bf->hash_function = NULL;
+    bf->hash_function_noalloc = NULL;
+    bf->hash_function_bytes = NULL;
     bf->__is_on_disk = 0;
+    bf->__thread_safe = 0;
+    bf->__counters = NULL;
+    bf->__track_bits = 0;
+    bf->__sync_interval = 0;
     bf->__filesize = 0;
     return BLOOM_SUCCESS;
 }
 
 int bloom_filter_clear(BloomFilter *bf) {
-    for (unsigned long i = 0; i < bf->bloom_length; ++i) {
-        bf->bloom[i] = 0;
+    uint64_t words = bf->bloom_length / 8;
+    __bulk_words(BLOOM_BULK_CLEAR, bf->bloom, NULL, NULL, words);
+    memset(bf->bloom + words * 8, 0, bf->bloom_length - words * 8);
+    if (bf->__counters != NULL) {
+        memset(bf->__counters, 0, BLOOM_COUNTER_STRIPES * BLOOM_CACHE_LINE);
     }
     bf->elements_added = 0;
+    bf->__bits_set = 0;
     __update_elements_added_on_disk(bf);
     return BLOOM_SUCCESS;
 }
@@ -122,6 +380,7 @@ int bloom_filter_clear(BloomFilter *bf) {
 void bloom_filter_stats(BloomFilter *bf) {
     const char *is_on_disk = (bf->__is_on_disk == 0 ? "no" : "yes");
     uint64_t size_on_disk = bloom_filter_export_size(bf);
+    __fold_elements_added(bf);
 
     printf("BloomFilter\n\
     bits: %" PRIu64 "\n\
@@ -143,22 +402,245 @@ void bloom_filter_stats(BloomFilter *bf) {
 }
 
 int bloom_filter_add_string(BloomFilter *bf, const char *str) {
-    uint64_t *hashes = bloom_filter_calculate_hashes(bf, str, bf->number_hashes);
-    int res = bloom_filter_add_string_alt(bf, hashes, bf->number_hashes);
-    free(hashes);
+    uint64_t stack_hashes[BLOOM_MAX_STACK_HASHES];
+    uint64_t *hashes = __hash_buffer(bf, stack_hashes);
+    if (hashes == NULL) {
+        return BLOOM_FAILURE;
+    }
+    int res = bloom_filter_calculate_hashes_into(bf, str, bf->number_hashes, hashes);
+    if (res == BLOOM_SUCCESS) {
+        res = bloom_filter_add_string_alt(bf, hashes, bf->number_hashes);
+    }
+    if (hashes != stack_hashes) {
+        free(hashes);
+    }
     return res;
 }
 
 
 int bloom_filter_check_string(BloomFilter *bf, const char *str) {
-    uint64_t *hashes = bloom_filter_calculate_hashes(bf, str, bf->number_hashes);
-    int res = bloom_filter_check_string_alt(bf, hashes, bf->number_hashes);
-    free(hashes);
+    uint64_t stack_hashes[BLOOM_MAX_STACK_HASHES];
+    uint64_t *hashes = __hash_buffer(bf, stack_hashes);
+    if (hashes == NULL) {
+        return BLOOM_FAILURE;
+    }
+    int res = bloom_filter_calculate_hashes_into(bf, str, bf->number_hashes, hashes);
+    if (res == BLOOM_SUCCESS) {
+        res = bloom_filter_check_string_alt(bf, hashes, bf->number_hashes);
+    }
+    if (hashes != stack_hashes) {
+        free(hashes);
+    }
+    return res;
+}
+
+int bloom_filter_add_bytes(BloomFilter *bf, const void *key, size_t len) {
+    uint64_t stack_hashes[BLOOM_MAX_STACK_HASHES];
+    uint64_t *hashes = __hash_buffer(bf, stack_hashes);
+    if (hashes == NULL) {
+        return BLOOM_FAILURE;
+    }
+    int res = bloom_filter_calculate_hashes_bytes(bf, key, len, bf->number_hashes, hashes);
+    if (res == BLOOM_SUCCESS) {
+        res = bloom_filter_add_string_alt(bf, hashes, bf->number_hashes);
+    }
+    if (hashes != stack_hashes) {
+        free(hashes);
+    }
+    return res;
+}
+
+int bloom_filter_check_bytes(BloomFilter *bf, const void *key, size_t len) {
+    uint64_t stack_hashes[BLOOM_MAX_STACK_HASHES];
+    uint64_t *hashes = __hash_buffer(bf, stack_hashes);
+    if (hashes == NULL) {
+        return BLOOM_FAILURE;
+    }
+    int res = bloom_filter_calculate_hashes_bytes(bf, key, len, bf->number_hashes, hashes);
+    if (res == BLOOM_SUCCESS) {
+        res = bloom_filter_check_string_alt(bf, hashes, bf->number_hashes);
+    }
+    if (hashes != stack_hashes) {
+        free(hashes);
+    }
+    return res;
+}
+
+int bloom_filter_add_if_absent_alt(BloomFilter *bf, uint64_t *hashes, unsigned int number_hashes_passed) {
+    if (number_hashes_passed < bf->number_hashes) {
+        fprintf(stderr, "Error: not enough hashes passed in to correctly check!\n");
+        return BLOOM_FAILURE;
+    }
+    int added = 0;
+    for (unsigned int i = 0; i < bf->number_hashes; ++i) {
+        added |= __test_and_set_mapped_bit(bf, __map_bit(bf, hashes[i]));
+    }
+    if (added == 0) {
+        return BLOOM_PRESENT;
+    }
+    __increment_elements_added(bf);
+    return BLOOM_SUCCESS;
+}
+
+int bloom_filter_add_if_absent(BloomFilter *bf, const char *str) {
+    uint64_t stack_hashes[BLOOM_MAX_STACK_HASHES];
+    uint64_t *hashes = __hash_buffer(bf, stack_hashes);
+    if (hashes == NULL) {
+        return BLOOM_FAILURE;
+    }
+    int res = bloom_filter_calculate_hashes_into(bf, str, bf->number_hashes, hashes);
+    if (res == BLOOM_SUCCESS) {
+        res = bloom_filter_add_if_absent_alt(bf, hashes, bf->number_hashes);
+    }
+    if (hashes != stack_hashes) {
+        free(hashes);
+    }
+    return res;
+}
+
+int bloom_filter_add_bytes_if_absent(BloomFilter *bf, const void *key, size_t len) {
+    uint64_t stack_hashes[BLOOM_MAX_STACK_HASHES];
+    uint64_t *hashes = __hash_buffer(bf, stack_hashes);
+    if (hashes == NULL) {
+        return BLOOM_FAILURE;
+    }
+    int res = bloom_filter_calculate_hashes_bytes(bf, key, len, bf->number_hashes, hashes);
+    if (res == BLOOM_SUCCESS) {
+        res = bloom_filter_add_if_absent_alt(bf, hashes, bf->number_hashes);
+    }
+    if (hashes != stack_hashes) {
+        free(hashes);
+    }
     return res;
 }
 
+int bloom_filter_add_batch_if_absent(BloomFilter *bf, const char * const *keys, const size_t *lengths, size_t num_keys, unsigned char *results) {
+    if (bf->hash_function_bytes == NULL) {
+        fprintf(stderr, "Error: adding bytes requires a bytes hash function!\n");
+        return BLOOM_FAILURE;
+    }
+    BloomBatch batch = {keys, lengths, NULL, NULL, NULL};
+    return __add_if_absent_batch(bf, &batch, num_keys, results);
+}
+
+int bloom_filter_add_batch_u64_if_absent(BloomFilter *bf, const uint64_t *keys, size_t num_keys, unsigned char *results) {
+    BloomBatch batch = {NULL, NULL, keys, NULL, NULL};
+    return __add_if_absent_batch(bf, &batch, num_keys, results);
+}
+
+int bloom_filter_add_batch(BloomFilter *bf, const char * const *keys, const size_t *lengths, size_t num_keys) {
+    if (bf->hash_function_bytes == NULL) {
+        fprintf(stderr, "Error: adding bytes requires a bytes hash function!\n");
+        return BLOOM_FAILURE;
+    }
+    BloomBatch batch = {keys, lengths, NULL, NULL, NULL};
+    return __add_batch(bf, &batch, num_keys);
+}
+
+int bloom_filter_add_batch_u64(BloomFilter *bf, const uint64_t *keys, size_t num_keys) {
+    BloomBatch batch = {NULL, NULL, keys, NULL, NULL};
+    return __add_batch(bf, &batch, num_keys);
+}
+
+int bloom_filter_check_batch(BloomFilter *bf, const char * const *keys, const size_t *lengths, size_t num_keys, unsigned char *results) {
+    if (bf->hash_function_bytes == NULL) {
+        fprintf(stderr, "Error: checking bytes requires a bytes hash function!\n");
+        return BLOOM_FAILURE;
+    }
+    BloomBatch batch = {keys, lengths, NULL, NULL, NULL};
+    return __check_batch(bf, &batch, num_keys, results, 0);
+}
+
+int bloom_filter_check_batch_bitmap(BloomFilter *bf, const char * const *keys, const size_t *lengths, size_t num_keys, unsigned char *bitmap) {
+    if (bf->hash_function_bytes == NULL) {
+        fprintf(stderr, "Error: checking bytes requires a bytes hash function!\n");
+        return BLOOM_FAILURE;
+    }
+    BloomBatch batch = {keys, lengths, NULL, NULL, NULL};
+    return __check_batch(bf, &batch, num_keys, bitmap, 1);
+}
+
+int bloom_filter_bulk_load(BloomFilter *bf, const char * const *keys, const size_t *lengths, size_t num_keys) {
+    if (bf->hash_function_bytes == NULL) {
+        fprintf(stderr, "Error: adding bytes requires a bytes hash function!\n");
+        return BLOOM_FAILURE;
+    }
+    BloomBatch batch = {keys, lengths, NULL, NULL, NULL};
+    return __bulk_load(bf, &batch, num_keys);
+}
+
+int bloom_filter_bulk_load_u64(BloomFilter *bf, const uint64_t *keys, size_t num_keys) {
+    BloomBatch batch = {NULL, NULL, keys, NULL, NULL};
+    return __bulk_load(bf, &batch, num_keys);
+}
+
+int bloom_filter_parallel_build(BloomFilter *bf, const char * const *keys, const size_t *lengths, size_t num_keys, int num_threads) {
+    if (bf->hash_function_bytes == NULL) {
+        fprintf(stderr, "Error: adding bytes requires a bytes hash function!\n");
+        return BLOOM_FAILURE;
+    }
+    BloomBatch batch = {keys, lengths, NULL, NULL, NULL};
+    return __parallel_build(bf, &batch, num_keys, num_threads);
+}
+
+int bloom_filter_parallel_build_u64(BloomFilter *bf, const uint64_t *keys, size_t num_keys, int num_threads) {
+    BloomBatch batch = {NULL, NULL, keys, NULL, NULL};
+    return __parallel_build(bf, &batch, num_keys, num_threads);
+}
+
+int bloom_filter_parallel_build_callback(BloomFilter *bf, BloomKeyCallback key_at, void *user_data, size_t num_keys, int num_threads) {
+    if (bf->hash_function_bytes == NULL) {
+        fprintf(stderr, "Error: adding bytes requires a bytes hash function!\n");
+        return BLOOM_FAILURE;
+    }
+    BloomBatch batch = {NULL, NULL, NULL, key_at, user_data};
+    return __parallel_build(bf, &batch, num_keys, num_threads);
+}
+
+int bloom_filter_check_batch_u64(BloomFilter *bf, const uint64_t *keys, size_t num_keys, unsigned char *results) {
+    BloomBatch batch = {NULL, NULL, keys, NULL, NULL};
+    return __check_batch(bf, &batch, num_keys, results, 0);
+}
+
+int bloom_filter_check_batch_u64_bitmap(BloomFilter *bf, const uint64_t *keys, size_t num_keys, unsigned char *bitmap) {
+    BloomBatch batch = {NULL, NULL, keys, NULL, NULL};
+    return __check_batch(bf, &batch, num_keys, bitmap, 1);
+}
+
 uint64_t* bloom_filter_calculate_hashes(BloomFilter *bf, const char *str, unsigned int number_hashes) {
-    return bf->hash_function(number_hashes, str);
+    if (bf->hash_function != NULL) {
+        return bf->hash_function(number_hashes, str);
+    }
+    uint64_t *results = (uint64_t*)calloc(number_hashes, sizeof(uint64_t));
+    bloom_filter_calculate_hashes_into(bf, str, number_hashes, results);
+    return results;
+}
+
+int bloom_filter_calculate_hashes_into(BloomFilter *bf, const char *str, unsigned int number_hashes, uint64_t *results) {
+    if (bf->hash_function_noalloc != NULL) {
+        bf->hash_function_noalloc(number_hashes, str, results);
+        return BLOOM_SUCCESS;
+    } else if (bf->hash_function_bytes != NULL) {
+        bf->hash_function_bytes(number_hashes, str, strlen(str), results);
+        return BLOOM_SUCCESS;
+    }
+    // user supplied allocating hash function; copy the results out
+    uint64_t *hashes = bf->hash_function(number_hashes, str);
+    if (hashes == NULL) {
+        return BLOOM_FAILURE;
+    }
+    memcpy(results, hashes, number_hashes * sizeof(uint64_t));
+    free(hashes);
+    return BLOOM_SUCCESS;
+}
+
+int bloom_filter_calculate_hashes_bytes(BloomFilter *bf, const void *key, size_t len, unsigned int number_hashes, uint64_t *results) {
+    if (bf->hash_function_bytes == NULL) {
+        fprintf(stderr, "Error: hashing bytes requires a bytes hash function!\n");
+        return BLOOM_FAILURE;
+    }
+    bf->hash_function_bytes(number_hashes, key, len, results);
+    return BLOOM_SUCCESS;
 }
 
 /* Add a string to a bloom filter using the defined hashes */
@@ -169,16 +651,9 @@ int bloom_filter_add_string_alt(BloomFilter *bf, uint64_t *hashes, unsigned int
     }
 
     for (unsigned int i = 0; i < bf->number_hashes; ++i) {
-        unsigned long idx = (hashes[i] % bf->number_bits) / 8;
-        int bit = (hashes[i] % bf->number_bits) % 8;
-
-        #pragma omp atomic update
-        bf->bloom[idx] |= (1 << bit); // set the bit
+        __set_bit(bf, hashes[i]);
     }
-
-    #pragma omp atomic update
-    bf->elements_added++;
-    __update_elements_added_on_disk(bf);
+    __increment_elements_added(bf);
     return BLOOM_SUCCESS;
 }
 
@@ -192,8 +667,7 @@ int bloom_filter_check_string_alt(BloomFilter *bf, uint64_t *hashes, unsigned in
     unsigned int i;
     int r = BLOOM_SUCCESS;
     for (i = 0; i < bf->number_hashes; ++i) {
-        int tmp_check = CHECK_BIT(bf->bloom, (hashes[i] % bf->number_bits));
-        if (tmp_check == 0) {
+        if (__check_bit(bf, hashes[i]) == 0) {
             r = BLOOM_FAILURE;
             break; // no need to continue checking
         }
@@ -201,7 +675,162 @@ int bloom_filter_check_string_alt(BloomFilter *bf, uint64_t *hashes, unsigned in
     return r;
 }
 
+int bloom_filter_add_u64(BloomFilter *bf, uint64_t key) {
+    uint64_t h1, h2;
+    __hash_u64(key, &h1, &h2);
+    unsigned int i;
+    for (i = 0; i < bf->number_hashes; ++i) {
+        __set_bit(bf, h1 + i * h2);
+    }
+    __increment_elements_added(bf);
+    return BLOOM_SUCCESS;
+}
+
+int bloom_filter_check_u64(BloomFilter *bf, uint64_t key) {
+    uint64_t h1, h2;
+    __hash_u64(key, &h1, &h2);
+    unsigned int i;
+    for (i = 0; i < bf->number_hashes; ++i) {
+        if (__check_bit(bf, h1 + i * h2) == 0) {
+            return BLOOM_FAILURE;
+        }
+    }
+    return BLOOM_SUCCESS;
+}
+
+int bloom_filter_add_u128(BloomFilter *bf, uint64_t high, uint64_t low) {
+    uint64_t h1, h2;
+    __hash_u128(high, low, &h1, &h2);
+    unsigned int i;
+    for (i = 0; i < bf->number_hashes; ++i) {
+        __set_bit(bf, h1 + i * h2);
+    }
+    __increment_elements_added(bf);
+    return BLOOM_SUCCESS;
+}
+
+int bloom_filter_check_u128(BloomFilter *bf, uint64_t high, uint64_t low) {
+    uint64_t h1, h2;
+    __hash_u128(high, low, &h1, &h2);
+    unsigned int i;
+    for (i = 0; i < bf->number_hashes; ++i) {
+        if (__check_bit(bf, h1 + i * h2) == 0) {
+            return BLOOM_FAILURE;
+        }
+    }
+    return BLOOM_SUCCESS;
+}
+
+int bloom_key_init(BloomKey *key, BloomFilter *bf, const char *str) {
+    if (__key_init(key, bf) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    uint64_t *hashes = BLOOM_KEY_HASHES(key);
+    if (bloom_filter_calculate_hashes_into(bf, str, key->number_hashes, hashes) == BLOOM_FAILURE) {
+        bloom_key_destroy(key);
+        return BLOOM_FAILURE;
+    }
+    for (unsigned int i = 0; i < key->number_hashes; ++i) {
+        hashes[key->number_hashes + i] = __map_bit(bf, hashes[i]);
+    }
+    return BLOOM_SUCCESS;
+}
+
+int bloom_key_init_bytes(BloomKey *key, BloomFilter *bf, const void *data, size_t len) {
+    if (__key_init(key, bf) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    uint64_t *hashes = BLOOM_KEY_HASHES(key);
+    if (bloom_filter_calculate_hashes_bytes(bf, data, len, key->number_hashes, hashes) == BLOOM_FAILURE) {
+        bloom_key_destroy(key);
+        return BLOOM_FAILURE;
+    }
+    for (unsigned int i = 0; i < key->number_hashes; ++i) {
+        hashes[key->number_hashes + i] = __map_bit(bf, hashes[i]);
+    }
+    return BLOOM_SUCCESS;
+}
+
+int bloom_key_init_u64(BloomKey *key, BloomFilter *bf, uint64_t value) {
+    if (__key_init(key, bf) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    key->__is_integer = 1;
+    uint64_t *hashes = BLOOM_KEY_HASHES(key);
+    uint64_t h1, h2;
+    __hash_u64(value, &h1, &h2);
+    for (unsigned int i = 0; i < key->number_hashes; ++i) {
+        hashes[i] = h1 + i * h2;
+        hashes[key->number_hashes + i] = __map_bit(bf, hashes[i]);
+    }
+    return BLOOM_SUCCESS;
+}
+
+int bloom_key_destroy(BloomKey *key) {
+    free(key->__heap);
+    key->__heap = NULL;
+    key->number_hashes = 0;
+    return BLOOM_SUCCESS;
+}
+
+int bloom_filter_add_key(BloomFilter *bf, const BloomKey *key) {
+    if (__key_fits(bf, key) == BLOOM_FAILURE) {
+        fprintf(stderr, "Error: the key was hashed for an incompatible bloom filter!\n");
+        return BLOOM_FAILURE;
+    }
+    for (unsigned int i = 0; i < bf->number_hashes; ++i) {
+        __set_mapped_bit(bf, __key_bit(bf, key, i));
+    }
+    __increment_elements_added(bf);
+    return BLOOM_SUCCESS;
+}
+
+int bloom_filter_check_key(BloomFilter *bf, const BloomKey *key) {
+    if (__key_fits(bf, key) == BLOOM_FAILURE) {
+        fprintf(stderr, "Error: the key was hashed for an incompatible bloom filter!\n");
+        return BLOOM_FAILURE;
+    }
+    for (unsigned int i = 0; i < bf->number_hashes; ++i) {
+        if (__check_mapped_bit(bf, __key_bit(bf, key, i)) == 0) {
+            return BLOOM_FAILURE;
+        }
+    }
+    return BLOOM_SUCCESS;
+}
+
+/*  The bits of the filters a few places ahead are prefetched before checking the key
+    against the current one so that the cache misses of several filters overlap */
+int bloom_filter_check_many_filters(const BloomKey *key, BloomFilter **filters, size_t num_filters, unsigned char *results) {
+    size_t f;
+    for (f = 0; f < num_filters; ++f) {
+        if (__key_fits(filters[f], key) == BLOOM_FAILURE) {
+            fprintf(stderr, "Error: the key was hashed for an incompatible bloom filter!\n");
+            return BLOOM_FAILURE;
+        }
+    }
+    for (f = 0; f < num_filters + BLOOM_MANY_FILTERS_AHEAD; ++f) {
+        unsigned int i;
+        if (f < num_filters) {
+            BloomFilter *ahead = filters[f];
+            for (i = 0; i < ahead->number_hashes; ++i) {
+                BLOOM_PREFETCH(ahead->bloom + __key_bit(ahead, key, i) / 8, 0);
+            }
+        }
+        if (f < BLOOM_MANY_FILTERS_AHEAD) {
+            continue;
+        }
+        BloomFilter *bf = filters[f - BLOOM_MANY_FILTERS_AHEAD];
+        unsigned char found = 1;
+        for (i = 0; i < bf->number_hashes && found; ++i) {
+            found = __check_mapped_bit(bf, __key_bit(bf, key, i)) != 0;
+        }
+        results[f - BLOOM_MANY_FILTERS_AHEAD] = found;
+    }
+    return BLOOM_SUCCESS;
+}
+
 float bloom_filter_current_false_positive_rate(BloomFilter *bf) {
+    __fold_elements_added(bf);
     int num = bf->number_hashes * bf->elements_added;
     double d = -num / (float) bf->number_bits;
     double e = exp(d);
@@ -235,6 +864,9 @@ int bloom_filter_import_alt(BloomFilter *bf, const char *filepath, BloomHashFunc
     fclose(fp);
     bloom_filter_set_hash_function(bf, hash_function);
     bf->__is_on_disk = 0; // not on disk
+    bf->__thread_safe = 0;
+    bf->__counters = NULL;
+    bf->__track_bits = 0;
     return BLOOM_SUCCESS;
 }
 
@@ -248,19 +880,27 @@ int bloom_filter_import_on_disk_alt(BloomFilter *bf, const char *filepath, Bloom
     // don't close the file pointer here...
     bloom_filter_set_hash_function(bf, hash_function);
     bf->__is_on_disk = 1; // on disk
+    bf->__thread_safe = 0;
+    bf->__counters = NULL;
+    bf->__track_bits = 0;
+    bf->__sync_interval = 1;
     return BLOOM_SUCCESS;
 }
 
 char* bloom_filter_export_hex_string(BloomFilter *bf) {
-    uint64_t i, bytes = sizeof(uint64_t) * 2 + sizeof(float) + (bf->bloom_length);
+    uint64_t i, bytes = bloom_filter_export_size(bf);
     char* hex = (char*)calloc((bytes * 2 + 1), sizeof(char));
     for (i = 0; i < bf->bloom_length; ++i) {
         sprintf(hex + (i * 2), "%02x", bf->bloom[i]); // not the fastest way, but works
     }
     i = bf->bloom_length * 2;
+    if (__has_options(bf)) {
+        sprintf(hex + i, "%08x%08x", __get_options(bf), BLOOM_EXT_MAGIC);
+        i += BLOOM_EXT_SIZE * 2;
+    }
     sprintf(hex + i, "%016" PRIx64 "", bf->estimated_elements);
     i += 16; // 8 bytes * 2 for hex
-    sprintf(hex + i, "%016" PRIx64 "", bf->elements_added);
+    sprintf(hex + i, "%016" PRIx64 "", bloom_filter_elements_added(bf));
 
     unsigned int ui;
     memcpy(&ui, &bf->false_positive_probability, sizeof (ui));
@@ -289,31 +929,120 @@ int bloom_filter_import_hex_string_alt(BloomFilter *bf, const char *hex, BloomHa
     float f;
     memcpy(&f, &t_fpr, sizeof(float));
     bf->false_positive_probability = f;
+
+    // determine if there is an options block before the trailer
+    bf->hash_type = BLOOM_HASH_FNV1A;
+    bf->index_mapping = BLOOM_INDEX_MODULO;
+    if (len >= (BLOOM_TRAILER_SIZE + BLOOM_EXT_SIZE) * 2) {
+        char opts[9] = {0};
+        char magic[9] = {0};
+        memcpy(opts, hex + (len - 56), 8);
+        memcpy(magic, hex + (len - 48), 8);
+        if (strtoul(magic, NULL, 16) == BLOOM_EXT_MAGIC) {
+            BloomFilter tmp = *bf;
+            if (__set_options(&tmp, (uint32_t)strtoul(opts, NULL, 16)) == BLOOM_SUCCESS) {
+                __calculate_optimal_hashes(&tmp);
+                if ((tmp.bloom_length + BLOOM_TRAILER_SIZE + BLOOM_EXT_SIZE) * 2 == len) {
+                    bf->hash_type = tmp.hash_type;
+                    bf->index_mapping = tmp.index_mapping;
+                }
+            }
+        }
+    }
     bloom_filter_set_hash_function(bf, hash_function);
 
     __calculate_optimal_hashes(bf);
-    bf->bloom = (unsigned char*)calloc(bf->bloom_length + 1, sizeof(char));  // pad
+    bf->bloom = __alloc_bloom(bf);
     bf->__is_on_disk = 0; // not on disk
+    bf->__thread_safe = 0;
+    bf->__counters = NULL;
+    bf->__track_bits = 0;
 
     uint64_t i;
     for (i = 0; i < bf->bloom_length; ++i) {
-        sscanf(hex + (i * 2), "%2hx", (short unsigned int*)&bf->bloom[i]);
+        unsigned int byte = 0;
+        sscanf(hex + (i * 2), "%2x", &byte);
+        bf->bloom[i] = (unsigned char)byte;
     }
     return BLOOM_SUCCESS;
 }
 
 uint64_t bloom_filter_export_size(BloomFilter *bf) {
-    return (uint64_t)(bf->bloom_length * sizeof(unsigned char)) + (2 * sizeof(uint64_t)) + sizeof(float);
+    uint64_t options_size = __has_options(bf) ? BLOOM_EXT_SIZE : 0;
+    return (uint64_t)(bf->bloom_length * sizeof(unsigned char)) + options_size + (2 * sizeof(uint64_t)) + sizeof(float);
 }
 
+/*  The bulk operations work a 64 bit word at a time; an on disk (mmap) filter is not
+    padded, so any trailing bytes are handled one at a time */
 uint64_t bloom_filter_count_set_bits(BloomFilter *bf) {
-    uint64_t i, res = 0;
-    for (i = 0; i < bf->bloom_length; ++i) {
+    if (bf->__track_bits) {
+        __fold_elements_added(bf);
+        return bf->__bits_set;
+    }
+    uint64_t i, words = bf->bloom_length / 8;
+    uint64_t res = __bulk_words(BLOOM_BULK_COUNT, NULL, bf->bloom, NULL, words);
+    for (i = words * 8; i < bf->bloom_length; ++i) {
         res += __sum_bits_set_char(bf->bloom[i]);
     }
     return res;
 }
 
+/* the kernels are defined with the private functions */
+typedef uint64_t (*BloomPopcountFunction)(const unsigned char *bytes, uint64_t words);
+typedef void (*BloomPopcountPairFunction)(const unsigned char *a, const unsigned char *b, uint64_t words, uint64_t *counts);
+typedef void (*BloomAndRowsFunction)(uint64_t *out, const uint64_t * const *rows, unsigned int number_rows, uint64_t first, uint64_t words);
+static BloomPopcountFunction __popcount_function(BloomPopcountKernel kernel);
+static BloomPopcountPairFunction __popcount_pair_function(BloomPopcountKernel kernel);
+static BloomAndRowsFunction __and_rows_function(BloomPopcountKernel kernel);
+typedef void (*BloomSbbfInsertFunction)(uint32_t *block, uint32_t key);
+typedef int (*BloomSbbfCheckFunction)(const uint32_t *block, uint32_t key);
+static BloomSbbfInsertFunction __sbbf_insert_function(BloomPopcountKernel kernel);
+static BloomSbbfCheckFunction __sbbf_check_function(BloomPopcountKernel kernel);
+static BloomPopcountKernel __popcount_detect(void);
+static BloomPopcountKernel popcount_kernel = BLOOM_POPCOUNT_AUTO;
+static BloomPopcountFunction popcount_function = NULL;
+static BloomPopcountPairFunction popcount_pair_function = NULL;
+static BloomAndRowsFunction and_rows_function = NULL;
+static BloomSbbfInsertFunction sbbf_insert_function = NULL;
+static BloomSbbfCheckFunction sbbf_check_function = NULL;
+static int bulk_threads = 1;
+
+int bloom_filter_set_popcount_kernel(BloomPopcountKernel kernel) {
+    if (kernel == BLOOM_POPCOUNT_AUTO) {
+        kernel = __popcount_detect();
+    }
+    BloomPopcountFunction function = __popcount_function(kernel);
+    if (function == NULL) {
+        return BLOOM_FAILURE;
+    }
+    popcount_function = function;
+    popcount_pair_function = __popcount_pair_function(kernel);
+    and_rows_function = __and_rows_function(kernel);
+    sbbf_insert_function = __sbbf_insert_function(kernel);
+    sbbf_check_function = __sbbf_check_function(kernel);
+    popcount_kernel = kernel;
+    return BLOOM_SUCCESS;
+}
+
+BloomPopcountKernel bloom_filter_get_popcount_kernel(void) {
+    if (popcount_kernel == BLOOM_POPCOUNT_AUTO) {
+        bloom_filter_set_popcount_kernel(BLOOM_POPCOUNT_AUTO);
+    }
+    return popcount_kernel;
+}
+
+int bloom_filter_set_bulk_threads(int num_threads) {
+    if (num_threads < 1) {
+        return BLOOM_FAILURE;
+    }
+    bulk_threads = num_threads;
+    return BLOOM_SUCCESS;
+}
+
+int bloom_filter_get_bulk_threads(void) {
+    return bulk_threads;
+}
+
 uint64_t bloom_filter_estimate_elements(BloomFilter *bf) {
     return bloom_filter_estimate_elements_by_values(bf->number_bits, bloom_filter_count_set_bits(bf), bf->number_hashes);
 }
@@ -329,10 +1058,12 @@ int bloom_filter_union(BloomFilter *res, BloomFilter *bf1, BloomFilter *bf2) {
     if (__check_if_union_or_intersection_ok(res, bf1, bf2) == BLOOM_FAILURE) {
         return BLOOM_FAILURE;
     }
-    uint64_t i;
-    for (i = 0; i < bf1->bloom_length; ++i) {
+    uint64_t i, words = bf1->bloom_length / 8;
+    __bulk_words(BLOOM_BULK_OR, res->bloom, bf1->bloom, bf2->bloom, words);
+    for (i = words * 8; i < bf1->bloom_length; ++i) {
         res->bloom[i] = bf1->bloom[i] | bf2->bloom[i];
     }
+    __recount_bits_set(res);
     bloom_filter_set_elements_to_estimated(res);
     return BLOOM_SUCCESS;
 }
@@ -342,11 +1073,9 @@ uint64_t bloom_filter_count_union_bits_set(BloomFilter *bf1, BloomFilter *bf2) {
     if (__check_if_union_or_intersection_ok(bf1, bf1, bf2) == BLOOM_FAILURE) {  // use bf1 as res
         return BLOOM_FAILURE;
     }
-    uint64_t i, res = 0;
-    for (i = 0; i < bf1->bloom_length; ++i) {
-        res += __sum_bits_set_char(bf1->bloom[i] | bf2->bloom[i]);
-    }
-    return res;
+    BloomPairCounts counts;
+    __pair_counts(bf1, bf2, &counts);
+    return counts.bits_union;
 }
 
 int bloom_filter_intersect(BloomFilter *res, BloomFilter *bf1, BloomFilter *bf2) {
@@ -354,15 +1083,26 @@ int bloom_filter_intersect(BloomFilter *res, BloomFilter *bf1, BloomFilter *bf2)
     if (__check_if_union_or_intersection_ok(res, bf1, bf2) == BLOOM_FAILURE) {
         return BLOOM_FAILURE;
     }
-    uint64_t i;
-    for (i = 0; i < bf1->bloom_length; ++i) {
+    uint64_t i, words = bf1->bloom_length / 8;
+    __bulk_words(BLOOM_BULK_AND, res->bloom, bf1->bloom, bf2->bloom, words);
+    for (i = words * 8; i < bf1->bloom_length; ++i) {
         res->bloom[i] = bf1->bloom[i] & bf2->bloom[i];
     }
+    __recount_bits_set(res);
     bloom_filter_set_elements_to_estimated(res);
     return BLOOM_SUCCESS;
 }
 
+int bloom_filter_union_many(BloomFilter *res, BloomFilter **filters, size_t num_filters) {
+    return __combine_many(res, filters, num_filters, 0);
+}
+
+int bloom_filter_intersect_many(BloomFilter *res, BloomFilter **filters, size_t num_filters) {
+    return __combine_many(res, filters, num_filters, 1);
+}
+
 void bloom_filter_set_elements_to_estimated(BloomFilter *bf) {
+    __discard_elements_added(bf);  // the estimate replaces any adds not yet folded in
     bf->elements_added = bloom_filter_estimate_elements(bf);
     __update_elements_added_on_disk(bf);
 }
@@ -372,11 +1112,9 @@ uint64_t bloom_filter_count_intersection_bits_set(BloomFilter *bf1, BloomFilter
     if (__check_if_union_or_intersection_ok(bf1, bf1, bf2) == BLOOM_FAILURE) {  // use bf1 as res
         return BLOOM_FAILURE;
     }
-    uint64_t i, res = 0;
-    for (i = 0; i < bf1->bloom_length; ++i) {
-        res += __sum_bits_set_char(bf1->bloom[i] & bf2->bloom[i]);
-    }
-    return res;
+    BloomPairCounts counts;
+    __pair_counts(bf1, bf2, &counts);
+    return counts.bits_intersection;
 }
 
 float bloom_filter_jaccard_index(BloomFilter *bf1, BloomFilter *bf2) {
@@ -384,125 +1122,3125 @@ float bloom_filter_jaccard_index(BloomFilter *bf1, BloomFilter *bf2) {
     if (__check_if_union_or_intersection_ok(bf1, bf1, bf2) == BLOOM_FAILURE) {  // use bf1 as res
         return (float)BLOOM_FAILURE;
     }
-    float set_union_bits = (float)bloom_filter_count_union_bits_set(bf1, bf2);
-    if (set_union_bits == 0) {  // check for divide by 0 error
+    BloomPairCounts counts;
+    __pair_counts(bf1, bf2, &counts);
+    if (counts.bits_union == 0) {  // check for divide by 0 error
         return 1.0; // they must be both empty for this to occur and are therefore the same
     }
-    return (float)bloom_filter_count_intersection_bits_set(bf1, bf2) / set_union_bits;
+    return (float)counts.bits_intersection / (float)counts.bits_union;
+}
+
+int bloom_filter_count_pair_bits_set(BloomFilter *bf1, BloomFilter *bf2, BloomPairCounts *counts) {
+    if (__check_if_union_or_intersection_ok(bf1, bf1, bf2) == BLOOM_FAILURE) {  // use bf1 as res
+        return BLOOM_FAILURE;
+    }
+    __pair_counts(bf1, bf2, counts);
+    return BLOOM_SUCCESS;
+}
+
+float bloom_filter_containment(BloomFilter *bf1, BloomFilter *bf2) {
+    if (__check_if_union_or_intersection_ok(bf1, bf1, bf2) == BLOOM_FAILURE) {  // use bf1 as res
+        return (float)BLOOM_FAILURE;
+    }
+    BloomPairCounts counts;
+    __pair_counts(bf1, bf2, &counts);
+    if (counts.bits_a == 0) {
+        return 1.0;  // an empty filter is contained in any other
+    }
+    return (float)counts.bits_intersection / (float)counts.bits_a;
+}
+
+uint64_t bloom_filter_estimate_union_elements(BloomFilter *bf1, BloomFilter *bf2) {
+    if (__check_if_union_or_intersection_ok(bf1, bf1, bf2) == BLOOM_FAILURE) {  // use bf1 as res
+        return BLOOM_FAILURE;
+    }
+    BloomPairCounts counts;
+    __pair_counts(bf1, bf2, &counts);
+    return bloom_filter_estimate_elements_by_values(bf1->number_bits, counts.bits_union, bf1->number_hashes);
+}
+
+uint64_t bloom_filter_estimate_intersection_elements(BloomFilter *bf1, BloomFilter *bf2) {
+    if (__check_if_union_or_intersection_ok(bf1, bf1, bf2) == BLOOM_FAILURE) {  // use bf1 as res
+        return BLOOM_FAILURE;
+    }
+    BloomPairCounts counts;
+    __pair_counts(bf1, bf2, &counts);
+    // |A n B| = |A| + |B| - |A u B| using the estimates from the bits set (Swamidass & Baldi)
+    uint64_t m = bf1->number_bits;
+    int k = bf1->number_hashes;
+    double a = (double)bloom_filter_estimate_elements_by_values(m, counts.bits_a, k);
+    double b = (double)bloom_filter_estimate_elements_by_values(m, counts.bits_b, k);
+    double u = (double)bloom_filter_estimate_elements_by_values(m, counts.bits_union, k);
+    return (a + b > u) ? (uint64_t)(a + b - u) : 0;
 }
 
 /*******************************************************************************
-*    PRIVATE FUNCTIONS
+*    BLOCKED BLOOM FILTER
 *******************************************************************************/
-static void __calculate_optimal_hashes(BloomFilter *bf) {
-    // calc optimized values
-    long n = bf->estimated_elements;
-    float p = bf->false_positive_probability;
-    uint64_t m = ceil((-n * logl(p)) / LOG_TWO_SQUARED);  // AKA pow(log(2), 2);
-    unsigned int k = round(LOG_TWO * m / n);             // AKA log(2.0);
-    // set paramenters
-    bf->number_hashes = k; // should check to make sure it is at least 1...
-    bf->number_bits = m;
-    long num_pos = ceil(m / (CHAR_LEN * 1.0));
-    bf->bloom_length = num_pos;
+int blocked_bloom_filter_init(BlockedBloomFilter *bf, uint64_t estimated_elements, float false_positive_rate) {
+    if(estimated_elements == 0 || false_positive_rate <= 0.0 || false_positive_rate >= 1.0) {
+        return BLOOM_FAILURE;
+    }
+    bf->estimated_elements = estimated_elements;
+    bf->false_positive_probability = false_positive_rate;
+    if (__blocked_calculate_optimal_size(bf) != BLOOM_SUCCESS) {
+        return BLOOM_FAILURE;
+    }
+    return __blocked_alloc(bf);
 }
 
-static int __sum_bits_set_char(unsigned char c) {
-    return bits_set_table[c];
+int blocked_bloom_filter_destroy(BlockedBloomFilter *bf) {
+    free(bf->bloom);
+    bf->bloom = NULL;
+    bf->estimated_elements = 0;
+    bf->false_positive_probability = 0;
+    bf->number_hashes = 0;
+    bf->number_blocks = 0;
+    bf->number_bits = 0;
+    bf->elements_added = 0;
+    return BLOOM_SUCCESS;
 }
 
-static int __check_if_union_or_intersection_ok(BloomFilter *res, BloomFilter *bf1, BloomFilter *bf2) {
+int blocked_bloom_filter_clear(BlockedBloomFilter *bf) {
+    memset(bf->bloom, 0, __blocked_bytes(bf));
+    bf->elements_added = 0;
+    return BLOOM_SUCCESS;
+}
+
+int blocked_bloom_filter_add_string(BlockedBloomFilter *bf, const char *str) {
+    return __blocked_add(bf, __xxh64(str, strlen(str), 0));
+}
+
+int blocked_bloom_filter_add_bytes(BlockedBloomFilter *bf, const void *key, size_t len) {
+    return __blocked_add(bf, __xxh64(key, len, 0));
+}
+
+int blocked_bloom_filter_add_u64(BlockedBloomFilter *bf, uint64_t key) {
+    uint64_t h1, h2;
+    __hash_u64(key, &h1, &h2);
+    return __blocked_add(bf, h1);
+}
+
+int blocked_bloom_filter_check_string(BlockedBloomFilter *bf, const char *str) {
+    return __blocked_check(bf, __xxh64(str, strlen(str), 0));
+}
+
+int blocked_bloom_filter_check_bytes(BlockedBloomFilter *bf, const void *key, size_t len) {
+    return __blocked_check(bf, __xxh64(key, len, 0));
+}
+
+int blocked_bloom_filter_check_u64(BlockedBloomFilter *bf, uint64_t key) {
+    uint64_t h1, h2;
+    __hash_u64(key, &h1, &h2);
+    return __blocked_check(bf, h1);
+}
+
+/*  The number of elements landing in a block is Poisson distributed with mean
+    n / blocks; average the false positive rate of a single block over it. Terms
+    are computed in log space so large means do not underflow. Within a block of
+    only 512 bits the usual (1 - e^(-kn/m))^k underestimates the rate, so the
+    chance that all of the distinct query bits are set is computed exactly. */
+double blocked_bloom_filter_false_positive_rate(uint64_t elements, uint64_t number_blocks, unsigned int number_hashes) {
+    if (number_blocks == 0 || number_hashes == 0) {
+        return 1.0;
+    }
+    unsigned int k = number_hashes;
+    double m = BLOOM_BLOCK_BITS;
+    // probability that the k query bits hit exactly s distinct positions
+    double *distinct = (double*)calloc(k + 1, sizeof(double));
+    double *stirling = (double*)calloc(k + 1, sizeof(double));  // S(i, s) for the current row i
+    double *occupied = (double*)calloc(k + 1, sizeof(double));
+    double *powers = (double*)calloc(k + 1, sizeof(double));  // (1 - i / m)^t for the current j
+    if (distinct == NULL || stirling == NULL || occupied == NULL || powers == NULL) {
+        free(distinct);
+        free(stirling);
+        free(occupied);
+        free(powers);
+        return 1.0;
+    }
+    stirling[0] = 1.0;
+    for (unsigned int i = 1; i <= k; ++i) {
+        for (unsigned int s = i; s >= 1; --s) {
+            stirling[s] = s * stirling[s] + stirling[s - 1];
+        }
+        stirling[0] = 0.0;
+    }
+    double falling = 1.0;
+    for (unsigned int s = 1; s <= k; ++s) {
+        falling *= (m - (s - 1)) / m;
+        distinct[s] = stirling[s] * falling / pow(m, k - s);
+    }
+
+    double lambda = (double)elements / number_blocks;
+    double spread = 10.0 * sqrt(lambda) + 10.0;
+    double start = floor(lambda - spread), end = ceil(lambda + spread);
+    double res = 0.0;
+    for (double j = (start < 0 ? 0 : start); j <= end; ++j) {
+        double poisson = __poisson_pmf(j, lambda);
+        if (poisson == 0) {
+            continue;
+        }
+        // chance that s given bits are all set after k * j random bits are set
+        double block = 0.0, t = (double)k * j;
+        double set = 1.0 - pow(1.0 - 1.0 / m, t);  // chance a given bit is set
+        double set_power = pow(set, BLOOM_BLOCK_EXACT_MAX);
+        unsigned int exact = (k < BLOOM_BLOCK_EXACT_MAX) ? k : BLOOM_BLOCK_EXACT_MAX;
+        for (unsigned int i = 0; i <= exact; ++i) {
+            powers[i] = pow(1.0 - i / m, t);
+        }
+        for (unsigned int s = 1; s <= k; ++s) {
+            if (s <= BLOOM_BLOCK_EXACT_MAX) {  // inclusion-exclusion
+                double sum = 0.0, binomial = 1.0;
+                for (unsigned int i = 0; i <= s; ++i) {
+                    sum += ((i % 2) ? -binomial : binomial) * powers[i];
+                    binomial = binomial * (s - i) / (i + 1);
+                }
+                occupied[s] = sum < 0 ? 0 : sum;
+            } else {
+                set_power *= set;
+                occupied[s] = set_power;
+            }
+            block += distinct[s] * occupied[s];
+        }
+        res += poisson * block;
+    }
+    free(distinct);
+    free(stirling);
+    free(occupied);
+    free(powers);
+    return res;
+}
+
+float blocked_bloom_filter_current_false_positive_rate(BlockedBloomFilter *bf) {
+    return (float)blocked_bloom_filter_false_positive_rate(bf->elements_added, bf->number_blocks, bf->number_hashes);
+}
+
+uint64_t blocked_bloom_filter_count_set_bits(BlockedBloomFilter *bf) {
+    return __popcount_words((const unsigned char*)bf->bloom, bf->number_blocks * BLOOM_BLOCK_WORDS);
+}
+
+int blocked_bloom_filter_union(BlockedBloomFilter *res, BlockedBloomFilter *bf1, BlockedBloomFilter *bf2) {
     if (res->number_hashes != bf1->number_hashes || bf1->number_hashes != bf2->number_hashes) {
         return BLOOM_FAILURE;
-    } else if (res->number_bits != bf1->number_bits || bf1->number_bits != bf2->number_bits) {
-        return BLOOM_FAILURE;
-    } else if (res->hash_function != bf1->hash_function || bf1->hash_function != bf2->hash_function) {
+    } else if (res->number_blocks != bf1->number_blocks || bf1->number_blocks != bf2->number_blocks) {
         return BLOOM_FAILURE;
     }
+    uint64_t i, words = bf1->number_blocks * BLOOM_BLOCK_WORDS;
+    for (i = 0; i < words; ++i) {
+        res->bloom[i] = bf1->bloom[i] | bf2->bloom[i];
+    }
+    res->elements_added = bloom_filter_estimate_elements_by_values(res->number_bits, blocked_bloom_filter_count_set_bits(res), res->number_hashes);
     return BLOOM_SUCCESS;
 }
 
-/* NOTE: this assumes that the file handler is open and ready to use */
-static void __write_to_file(BloomFilter *bf, FILE *fp, short on_disk) {
-    if (on_disk == 0) {
-        fwrite(bf->bloom, bf->bloom_length, 1, fp);
-    } else {
-        // will need to write out everything by hand
-        uint64_t i;
-        for (i = 0; i < bf->bloom_length; ++i) {
-            fputc(0, fp);
-        }
+int blocked_bloom_filter_export(BlockedBloomFilter *bf, const char *filepath) {
+    FILE *fp;
+    fp = fopen(filepath, "w+b");
+    if (fp == NULL) {
+        fprintf(stderr, "Can't open file %s!\n", filepath);
+        return BLOOM_FAILURE;
     }
+    uint32_t magic = BLOOM_BLOCKED_MAGIC;
+    fwrite(bf->bloom, __blocked_bytes(bf), 1, fp);
+    fwrite(&magic, sizeof(uint32_t), 1, fp);
     fwrite(&bf->estimated_elements, sizeof(uint64_t), 1, fp);
     fwrite(&bf->elements_added, sizeof(uint64_t), 1, fp);
     fwrite(&bf->false_positive_probability, sizeof(float), 1, fp);
+    fclose(fp);
+    return BLOOM_SUCCESS;
 }
 
-/* NOTE: this assumes that the file handler is open and ready to use */
-static void __read_from_file(BloomFilter *bf, FILE *fp, short on_disk, const char *filename) {
-    int offset = sizeof(uint64_t) * 2 + sizeof(float);
-    fseek(fp, offset * -1, SEEK_END);
-
-    fread(&bf->estimated_elements, sizeof(uint64_t), 1, fp);
-    fread(&bf->elements_added, sizeof(uint64_t), 1, fp);
-    fread(&bf->false_positive_probability, sizeof(float), 1, fp);
-    __calculate_optimal_hashes(bf);
-    rewind(fp);
-    if(on_disk == 0) {
-        bf->bloom = (unsigned char*)calloc(bf->bloom_length + 1, sizeof(char));
-        size_t read;
-        read = fread(bf->bloom, sizeof(char), bf->bloom_length, fp);
-        if (read != bf->bloom_length) {
-            perror("__read_from_file: ");
-            exit(1);
-        }
-    } else {
-        struct stat buf;
-        int fd = open(filename, O_RDWR);
-        if (fd < 0) {
-            perror("open: ");
-            exit(1);
-        }
-        fstat(fd, &buf);
-        bf->__filesize = buf.st_size;
-        bf->bloom = (unsigned char*)mmap((caddr_t)0, bf->__filesize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-        if (bf->bloom == (unsigned char*) - 1) {
-            perror("mmap: ");
-            exit(1);
+int blocked_bloom_filter_import(BlockedBloomFilter *bf, const char *filepath) {
+    FILE *fp;
+    fp = fopen(filepath, "r+b");
+    if (fp == NULL) {
+        fprintf(stderr, "Can't open file %s!\n", filepath);
+        return BLOOM_FAILURE;
+    }
+    uint32_t magic = 0;
+    uint64_t elements_added = 0;
+    long trailer = (long)(BLOOM_TRAILER_SIZE + sizeof(uint32_t));
+    int res = BLOOM_FAILURE;
+    fseek(fp, 0, SEEK_END);
+    long filesize = ftell(fp);
+    if (filesize >= trailer) {
+        fseek(fp, trailer * -1, SEEK_END);
+        fread(&magic, sizeof(uint32_t), 1, fp);
+        fread(&bf->estimated_elements, sizeof(uint64_t), 1, fp);
+        fread(&elements_added, sizeof(uint64_t), 1, fp);
+        fread(&bf->false_positive_probability, sizeof(float), 1, fp);
+    }
+    // the number of blocks is given by the file size, so only the hashes are recalculated
+    uint64_t bytes = (filesize > trailer) ? (uint64_t)(filesize - trailer) : 0;
+    bf->bloom = NULL;
+    if (magic == BLOOM_BLOCKED_MAGIC && bytes != 0 && bytes % (BLOOM_BLOCK_WORDS * sizeof(uint64_t)) == 0 && bf->estimated_elements != 0) {
+        bf->number_blocks = bytes / (BLOOM_BLOCK_WORDS * sizeof(uint64_t));
+        bf->number_bits = bf->number_blocks * BLOOM_BLOCK_BITS;
+        // a rate of 1.0 means it could not be calculated
+        if (__blocked_best_hashes(bf->estimated_elements, bf->number_blocks, &bf->number_hashes) < 1.0 && __blocked_alloc(bf) == BLOOM_SUCCESS) {
+            rewind(fp);
+            if (fread(bf->bloom, __blocked_bytes(bf), 1, fp) == 1) {
+                bf->elements_added = elements_added;
+                res = BLOOM_SUCCESS;
+            } else {
+                blocked_bloom_filter_destroy(bf);
+            }
         }
-        // close the file descriptor
-        close(fd);
     }
+    fclose(fp);
+    return res;
 }
 
-static void __update_elements_added_on_disk(BloomFilter* bf) {
-    if (bf->__is_on_disk == 1) { // only do this if it is on disk!
-        int offset = sizeof(uint64_t) + sizeof(float);
-        #pragma omp critical (bloom_filter_critical_on_disk)
-        {
-            fseek(bf->filepointer, offset * -1, SEEK_END);
-            fwrite(&bf->elements_added, sizeof(uint64_t), 1, bf->filepointer);
-        }
+uint64_t blocked_bloom_filter_export_size(BlockedBloomFilter *bf) {
+    return __blocked_bytes(bf) + sizeof(uint32_t) + BLOOM_TRAILER_SIZE;
+}
+
+void blocked_bloom_filter_stats(BlockedBloomFilter *bf) {
+    printf("BlockedBloomFilter\n\
+    bits: %" PRIu64 "\n\
+    blocks (%d bits): %" PRIu64 "\n\
+    estimated elements: %" PRIu64 "\n\
+    number hashes: %d\n\
+    max false positive rate: %f\n\
+    elements added: %" PRIu64 "\n\
+    current false positive rate: %f\n\
+    export size (bytes): %" PRIu64 "\n\
+    number bits set: %" PRIu64 "\n",
+    bf->number_bits, BLOOM_BLOCK_BITS, bf->number_blocks, bf->estimated_elements,
+    bf->number_hashes, bf->false_positive_probability, bf->elements_added,
+    blocked_bloom_filter_current_false_positive_rate(bf),
+    blocked_bloom_filter_export_size(bf), blocked_bloom_filter_count_set_bits(bf));
+}
+
+/*******************************************************************************
+*    SPLIT BLOCK BLOOM FILTER
+*******************************************************************************/
+/*  Parquet sizing: bits = -8 n / ln(1 - p^(1/8)), rounded up to a power of 2 bytes */
+int split_block_bloom_filter_init(SplitBlockBloomFilter *bf, uint64_t estimated_elements, float false_positive_rate) {
+    if(estimated_elements == 0 || false_positive_rate <= 0.0 || false_positive_rate >= 1.0) {
+        return BLOOM_FAILURE;
     }
+    double bits = -8.0 * estimated_elements / log(1.0 - pow(false_positive_rate, 1.0 / 8));
+    uint64_t number_bytes = SBBF_BLOCK_BYTES;
+    while (number_bytes * 8 < bits) {
+        number_bytes <<= 1;
+    }
+    if (__sbbf_alloc(bf, number_bytes) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    bf->estimated_elements = estimated_elements;
+    bf->false_positive_probability = false_positive_rate;
+    return BLOOM_SUCCESS;
 }
 
-/* NOTE: The caller will free the results */
-static uint64_t* __default_hash(int num_hashes, const char *str) {
-    uint64_t *results = (uint64_t*)calloc(num_hashes, sizeof(uint64_t));
-    int i;
-    for (i = 0; i < num_hashes; ++i) {
-        results[i] = __fnv_1a(str, i);
+int split_block_bloom_filter_destroy(SplitBlockBloomFilter *bf) {
+    free(bf->bloom);
+    bf->bloom = NULL;
+    bf->estimated_elements = 0;
+    bf->false_positive_probability = 0;
+    bf->number_blocks = 0;
+    bf->number_bytes = 0;
+    bf->elements_added = 0;
+    return BLOOM_SUCCESS;
+}
+
+int split_block_bloom_filter_clear(SplitBlockBloomFilter *bf) {
+    memset(bf->bloom, 0, bf->number_bytes);
+    bf->elements_added = 0;
+    return BLOOM_SUCCESS;
+}
+
+int split_block_bloom_filter_add_hash(SplitBlockBloomFilter *bf, uint64_t hash) {
+    __sbbf_insert(__sbbf_block(bf, hash), (uint32_t)hash);
+    #pragma omp atomic update
+    bf->elements_added++;
+    return BLOOM_SUCCESS;
+}
+
+int split_block_bloom_filter_check_hash(SplitBlockBloomFilter *bf, uint64_t hash) {
+    return __sbbf_check(__sbbf_block(bf, hash), (uint32_t)hash);
+}
+
+int split_block_bloom_filter_add_string(SplitBlockBloomFilter *bf, const char *str) {
+    return split_block_bloom_filter_add_hash(bf, __xxh64(str, strlen(str), 0));
+}
+
+int split_block_bloom_filter_add_bytes(SplitBlockBloomFilter *bf, const void *key, size_t len) {
+    return split_block_bloom_filter_add_hash(bf, __xxh64(key, len, 0));
+}
+
+int split_block_bloom_filter_add_u32(SplitBlockBloomFilter *bf, uint32_t key) {
+    unsigned char bytes[4] = {(unsigned char)key, (unsigned char)(key >> 8), (unsigned char)(key >> 16), (unsigned char)(key >> 24)};
+    return split_block_bloom_filter_add_hash(bf, __xxh64(bytes, sizeof(bytes), 0));
+}
+
+int split_block_bloom_filter_add_u64(SplitBlockBloomFilter *bf, uint64_t key) {
+    unsigned char bytes[8];
+    for (int i = 0; i < 8; ++i) {
+        bytes[i] = (unsigned char)(key >> (8 * i));
     }
-    return results;
+    return split_block_bloom_filter_add_hash(bf, __xxh64(bytes, sizeof(bytes), 0));
 }
 
-static uint64_t __fnv_1a(const char *key, int seed) {
-    // FNV-1a hash (http://www.isthe.com/chongo/tech/comp/fnv/)
-    int i, len = strlen(key);
-    uint64_t h = 14695981039346656037ULL + (31 * seed); // FNV_OFFSET 64 bit with magic number seed
-    for (i = 0; i < len; ++i){
-            h = h ^ (unsigned char) key[i];
-            h = h * 1099511628211ULL; // FNV_PRIME 64 bit
+int split_block_bloom_filter_check_string(SplitBlockBloomFilter *bf, const char *str) {
+    return split_block_bloom_filter_check_hash(bf, __xxh64(str, strlen(str), 0));
+}
+
+int split_block_bloom_filter_check_bytes(SplitBlockBloomFilter *bf, const void *key, size_t len) {
+    return split_block_bloom_filter_check_hash(bf, __xxh64(key, len, 0));
+}
+
+int split_block_bloom_filter_check_u32(SplitBlockBloomFilter *bf, uint32_t key) {
+    unsigned char bytes[4] = {(unsigned char)key, (unsigned char)(key >> 8), (unsigned char)(key >> 16), (unsigned char)(key >> 24)};
+    return split_block_bloom_filter_check_hash(bf, __xxh64(bytes, sizeof(bytes), 0));
+}
+
+int split_block_bloom_filter_check_u64(SplitBlockBloomFilter *bf, uint64_t key) {
+    unsigned char bytes[8];
+    for (int i = 0; i < 8; ++i) {
+        bytes[i] = (unsigned char)(key >> (8 * i));
     }
-    return h;
+    return split_block_bloom_filter_check_hash(bf, __xxh64(bytes, sizeof(bytes), 0));
+}
+
+uint64_t split_block_bloom_filter_hash(const void *key, size_t len) {
+    return __xxh64(key, len, 0);
+}
+
+/*  Every element sets one of the 32 bits of each word of its block; average the
+    chance that all 8 query bits are set over the Poisson number of elements per block */
+double split_block_bloom_filter_false_positive_rate(uint64_t elements, uint64_t number_blocks) {
+    if (number_blocks == 0) {
+        return 1.0;
+    }
+    double lambda = (double)elements / number_blocks;
+    double spread = 10.0 * sqrt(lambda) + 10.0;
+    double start = floor(lambda - spread), end = ceil(lambda + spread);
+    double res = 0.0;
+    for (double j = (start < 0 ? 0 : start); j <= end; ++j) {
+        res += __poisson_pmf(j, lambda) * pow(1.0 - pow(1.0 - 1.0 / 32, j), SBBF_BLOCK_WORDS);
+    }
+    return res;
+}
+
+float split_block_bloom_filter_current_false_positive_rate(SplitBlockBloomFilter *bf) {
+    return (float)split_block_bloom_filter_false_positive_rate(bf->elements_added, bf->number_blocks);
+}
+
+uint64_t split_block_bloom_filter_count_set_bits(SplitBlockBloomFilter *bf) {
+    return __popcount_words((const unsigned char*)bf->bloom, bf->number_bytes / 8);
+}
+
+int split_block_bloom_filter_union(SplitBlockBloomFilter *res, SplitBlockBloomFilter *bf1, SplitBlockBloomFilter *bf2) {
+    if (res->number_blocks != bf1->number_blocks || bf1->number_blocks != bf2->number_blocks) {
+        return BLOOM_FAILURE;
+    }
+    uint64_t i, words = bf1->number_blocks * SBBF_BLOCK_WORDS;
+    for (i = 0; i < words; ++i) {
+        res->bloom[i] = bf1->bloom[i] | bf2->bloom[i];
+    }
+    res->elements_added = __sbbf_estimate_elements(res);
+    return BLOOM_SUCCESS;
+}
+
+int split_block_bloom_filter_export(SplitBlockBloomFilter *bf, const char *filepath) {
+    FILE *fp;
+    fp = fopen(filepath, "w+b");
+    if (fp == NULL) {
+        fprintf(stderr, "Can't open file %s!\n", filepath);
+        return BLOOM_FAILURE;
+    }
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    unsigned char *bitset = (unsigned char*)malloc(bf->number_bytes);
+    split_block_bloom_filter_export_bitset(bf, bitset);
+    fwrite(bitset, bf->number_bytes, 1, fp);
+    free(bitset);
+#else
+    fwrite(bf->bloom, bf->number_bytes, 1, fp);
+#endif
+    uint32_t magic = SBBF_MAGIC;
+    fwrite(&magic, sizeof(uint32_t), 1, fp);
+    fwrite(&bf->estimated_elements, sizeof(uint64_t), 1, fp);
+    fwrite(&bf->elements_added, sizeof(uint64_t), 1, fp);
+    fwrite(&bf->false_positive_probability, sizeof(float), 1, fp);
+    fclose(fp);
+    return BLOOM_SUCCESS;
+}
+
+int split_block_bloom_filter_import(SplitBlockBloomFilter *bf, const char *filepath) {
+    FILE *fp;
+    fp = fopen(filepath, "r+b");
+    if (fp == NULL) {
+        fprintf(stderr, "Can't open file %s!\n", filepath);
+        return BLOOM_FAILURE;
+    }
+    uint32_t magic = 0;
+    SplitBlockBloomFilter tmp;
+    int res = BLOOM_FAILURE;
+    long trailer = (long)(BLOOM_TRAILER_SIZE + sizeof(uint32_t));
+    fseek(fp, 0, SEEK_END);
+    long filesize = ftell(fp);
+    if (filesize > trailer && (filesize - trailer) % SBBF_BLOCK_BYTES == 0) {
+        fseek(fp, trailer * -1, SEEK_END);
+        fread(&magic, sizeof(uint32_t), 1, fp);
+        fread(&tmp.estimated_elements, sizeof(uint64_t), 1, fp);
+        fread(&tmp.elements_added, sizeof(uint64_t), 1, fp);
+        fread(&tmp.false_positive_probability, sizeof(float), 1, fp);
+    }
+    if (magic == SBBF_MAGIC && __sbbf_alloc(bf, filesize - trailer) == BLOOM_SUCCESS) {
+        rewind(fp);
+        if (fread(bf->bloom, bf->number_bytes, 1, fp) == 1) {
+            __sbbf_copy_le(bf->bloom, bf->bloom, bf->number_bytes);
+            bf->estimated_elements = tmp.estimated_elements;
+            bf->elements_added = tmp.elements_added;
+            bf->false_positive_probability = tmp.false_positive_probability;
+            res = BLOOM_SUCCESS;
+        } else {
+            split_block_bloom_filter_destroy(bf);
+        }
+    }
+    fclose(fp);
+    return res;
+}
+
+int split_block_bloom_filter_import_bitset(SplitBlockBloomFilter *bf, const void *bitset, uint64_t number_bytes) {
+    if (number_bytes == 0 || number_bytes % SBBF_BLOCK_BYTES != 0) {
+        return BLOOM_FAILURE;
+    }
+    if (__sbbf_alloc(bf, number_bytes) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    __sbbf_copy_le(bf->bloom, bitset, number_bytes);
+    // the parameters are not part of a Parquet bitset; estimate what we can
+    bf->elements_added = __sbbf_estimate_elements(bf);
+    bf->estimated_elements = bf->elements_added;
+    bf->false_positive_probability = split_block_bloom_filter_current_false_positive_rate(bf);
+    return BLOOM_SUCCESS;
+}
+
+int split_block_bloom_filter_export_bitset(SplitBlockBloomFilter *bf, void *bitset) {
+    __sbbf_copy_le(bitset, bf->bloom, bf->number_bytes);
+    return BLOOM_SUCCESS;
+}
+
+uint64_t split_block_bloom_filter_export_size(SplitBlockBloomFilter *bf) {
+    return bf->number_bytes + sizeof(uint32_t) + BLOOM_TRAILER_SIZE;
+}
+
+void split_block_bloom_filter_stats(SplitBlockBloomFilter *bf) {
+    printf("SplitBlockBloomFilter\n\
+    bits: %" PRIu64 "\n\
+    blocks (256 bits): %" PRIu64 "\n\
+    estimated elements: %" PRIu64 "\n\
+    max false positive rate: %f\n\
+    elements added: %" PRIu64 "\n\
+    current false positive rate: %f\n\
+    export size (bytes): %" PRIu64 "\n\
+    number bits set: %" PRIu64 "\n",
+    bf->number_bytes * 8, bf->number_blocks, bf->estimated_elements,
+    bf->false_positive_probability, bf->elements_added,
+    split_block_bloom_filter_current_false_positive_rate(bf),
+    split_block_bloom_filter_export_size(bf), split_block_bloom_filter_count_set_bits(bf));
+}
+
+/*******************************************************************************
+*    BIT SLICED BLOOM INDEX
+*******************************************************************************/
+int bit_sliced_bloom_index_init(BitSlicedBloomIndex *idx, BloomFilter *like, uint64_t capacity) {
+    __copy_params(&idx->params, like);
+    idx->number_filters = 0;
+    idx->row_words = __bsi_row_words(capacity);
+    idx->__is_on_disk = 0;
+    idx->filepointer = NULL;
+    idx->__filesize = 0;
+    idx->rows = (uint64_t*)__aligned_calloc(__bsi_rows_bytes(idx, idx->row_words));
+    return idx->rows == NULL ? BLOOM_FAILURE : BLOOM_SUCCESS;
+}
+
+int bit_sliced_bloom_index_init_on_disk(BitSlicedBloomIndex *idx, BloomFilter *like, uint64_t capacity, const char *filepath) {
+    __copy_params(&idx->params, like);
+    idx->number_filters = 0;
+    idx->row_words = __bsi_row_words(capacity);
+    idx->__is_on_disk = 1;
+    idx->__filesize = BLOOM_BSI_HEADER_SIZE + __bsi_rows_bytes(idx, idx->row_words);
+    idx->filepointer = fopen(filepath, "w+b");
+    if (idx->filepointer == NULL) {
+        fprintf(stderr, "Can't open file %s!\n", filepath);
+        return BLOOM_FAILURE;
+    }
+    // the file is extended with zeros, which are the rows of an empty index
+    if (ftruncate(fileno(idx->filepointer), (off_t)idx->__filesize) != 0 || __bsi_map(idx) == BLOOM_FAILURE) {
+        fclose(idx->filepointer);
+        return BLOOM_FAILURE;
+    }
+    __bsi_write_header(idx, (unsigned char*)idx->rows - BLOOM_BSI_HEADER_SIZE);
+    return BLOOM_SUCCESS;
+}
+
+int bit_sliced_bloom_index_build_from_files(BitSlicedBloomIndex *idx, const char * const *filepaths, size_t num_files, const char *index_filepath) {
+    BloomFilter group[BLOOM_BSI_GROUP];
+    BloomFilter *filters[BLOOM_BSI_GROUP];
+    if (num_files == 0 || bloom_filter_import(&group[0], filepaths[0]) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    int res;
+    if (index_filepath == NULL) {
+        res = bit_sliced_bloom_index_init(idx, &group[0], num_files);
+    } else {
+        res = bit_sliced_bloom_index_init_on_disk(idx, &group[0], num_files, index_filepath);
+    }
+    // read as many filters at a time as fit the budget, up to a full group
+    uint64_t per_group = BLOOM_BSI_BUILD_BYTES / (group[0].bloom_length + 1);
+    per_group = per_group < 1 ? 1 : (per_group > BLOOM_BSI_GROUP ? BLOOM_BSI_GROUP : per_group);
+    bloom_filter_destroy(&group[0]);
+    if (res == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    size_t i, j, count;
+    for (i = 0; i < num_files && res == BLOOM_SUCCESS; i += count) {
+        count = (num_files - i < per_group) ? num_files - i : per_group;
+        for (j = 0; j < count; ++j) {
+            filters[j] = &group[j];
+            if (bloom_filter_import(&group[j], filepaths[i + j]) == BLOOM_FAILURE) {
+                res = BLOOM_FAILURE;
+                break;
+            }
+        }
+        if (res == BLOOM_SUCCESS) {
+            res = bit_sliced_bloom_index_append_many(idx, filters, count);
+        }
+        while (j > 0) {
+            bloom_filter_destroy(&group[--j]);
+        }
+    }
+    if (res == BLOOM_FAILURE) {
+        bit_sliced_bloom_index_destroy(idx);
+    }
+    return res;
+}
+
+int bit_sliced_bloom_index_destroy(BitSlicedBloomIndex *idx) {
+    if (idx->__is_on_disk == 0) {
+        free(idx->rows);
+    } else {
+        if (idx->rows != NULL) {
+            munmap((unsigned char*)idx->rows - BLOOM_BSI_HEADER_SIZE, idx->__filesize);
+        }
+        fclose(idx->filepointer);
+    }
+    idx->rows = NULL;
+    idx->filepointer = NULL;
+    idx->number_filters = 0;
+    idx->row_words = 0;
+    idx->__is_on_disk = 0;
+    idx->__filesize = 0;
+    return BLOOM_SUCCESS;
+}
+
+int bit_sliced_bloom_index_append(BitSlicedBloomIndex *idx, BloomFilter *bf) {
+    return bit_sliced_bloom_index_append_many(idx, &bf, 1);
+}
+
+int bit_sliced_bloom_index_append_many(BitSlicedBloomIndex *idx, BloomFilter **filters, size_t num_filters) {
+    size_t i;
+    for (i = 0; i < num_filters; ++i) {
+        if (__check_if_union_or_intersection_ok(&idx->params, filters[i], filters[i]) == BLOOM_FAILURE) {
+            fprintf(stderr, "Error: the bloom filter does not match the index!\n");
+            return BLOOM_FAILURE;
+        }
+    }
+    if (__bsi_reserve(idx, idx->number_filters + num_filters) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    for (i = 0; i < num_filters; i += BLOOM_BSI_GROUP) {
+        __bsi_append_group(idx, filters + i, (num_filters - i < BLOOM_BSI_GROUP) ? num_filters - i : BLOOM_BSI_GROUP);
+    }
+    if (idx->__is_on_disk) {
+        __bsi_write_header(idx, (unsigned char*)idx->rows - BLOOM_BSI_HEADER_SIZE);
+    }
+    return BLOOM_SUCCESS;
+}
+
+int bit_sliced_bloom_index_check_string(BitSlicedBloomIndex *idx, const char *str, uint64_t *ids, uint64_t *num_ids) {
+    BloomKey key;
+    if (bloom_key_init(&key, &idx->params, str) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    int res = __bsi_query(idx, &key, ids, num_ids);
+    bloom_key_destroy(&key);
+    return res;
+}
+
+int bit_sliced_bloom_index_check_bytes(BitSlicedBloomIndex *idx, const void *key, size_t len, uint64_t *ids, uint64_t *num_ids) {
+    BloomKey hashed;
+    if (bloom_key_init_bytes(&hashed, &idx->params, key, len) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    int res = __bsi_query(idx, &hashed, ids, num_ids);
+    bloom_key_destroy(&hashed);
+    return res;
+}
+
+int bit_sliced_bloom_index_check_u64(BitSlicedBloomIndex *idx, uint64_t key, uint64_t *ids, uint64_t *num_ids) {
+    BloomKey hashed;
+    if (bloom_key_init_u64(&hashed, &idx->params, key) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    int res = __bsi_query(idx, &hashed, ids, num_ids);
+    bloom_key_destroy(&hashed);
+    return res;
+}
+
+int bit_sliced_bloom_index_check_key(BitSlicedBloomIndex *idx, const BloomKey *key, uint64_t *ids, uint64_t *num_ids) {
+    if (__key_fits(&idx->params, key) == BLOOM_FAILURE) {
+        fprintf(stderr, "Error: the key was hashed for an incompatible bloom filter!\n");
+        return BLOOM_FAILURE;
+    }
+    return __bsi_query(idx, key, ids, num_ids);
+}
+
+int bit_sliced_bloom_index_export(BitSlicedBloomIndex *idx, const char *filepath) {
+    FILE *fp;
+    fp = fopen(filepath, "w+b");
+    if (fp == NULL) {
+        fprintf(stderr, "Can't open file %s!\n", filepath);
+        return BLOOM_FAILURE;
+    }
+    unsigned char header[BLOOM_BSI_HEADER_SIZE];
+    __bsi_write_header(idx, header);
+    fwrite(header, BLOOM_BSI_HEADER_SIZE, 1, fp);
+    fwrite(idx->rows, __bsi_rows_bytes(idx, idx->row_words), 1, fp);
+    fclose(fp);
+    return BLOOM_SUCCESS;
+}
+
+int bit_sliced_bloom_index_import(BitSlicedBloomIndex *idx, const char *filepath) {
+    FILE *fp;
+    fp = fopen(filepath, "r+b");
+    if (fp == NULL) {
+        fprintf(stderr, "Can't open file %s!\n", filepath);
+        return BLOOM_FAILURE;
+    }
+    unsigned char header[BLOOM_BSI_HEADER_SIZE];
+    int res = BLOOM_FAILURE;
+    fseek(fp, 0, SEEK_END);
+    uint64_t filesize = (uint64_t)ftell(fp);
+    rewind(fp);
+    if (fread(header, BLOOM_BSI_HEADER_SIZE, 1, fp) == 1 && __bsi_read_header(idx, header) == BLOOM_SUCCESS) {
+        uint64_t bytes = __bsi_rows_bytes(idx, idx->row_words);
+        idx->rows = (filesize == BLOOM_BSI_HEADER_SIZE + bytes) ? (uint64_t*)__aligned_calloc(bytes) : NULL;
+        if (idx->rows != NULL && fread(idx->rows, bytes, 1, fp) == 1) {
+            res = BLOOM_SUCCESS;
+        } else {
+            free(idx->rows);
+        }
+    }
+    fclose(fp);
+    idx->__is_on_disk = 0;
+    idx->filepointer = NULL;
+    idx->__filesize = 0;
+    if (res == BLOOM_FAILURE) {
+        idx->rows = NULL;
+    }
+    return res;
+}
+
+int bit_sliced_bloom_index_import_on_disk(BitSlicedBloomIndex *idx, const char *filepath) {
+    idx->filepointer = fopen(filepath, "r+b");
+    if (idx->filepointer == NULL) {
+        fprintf(stderr, "Can't open file %s!\n", filepath);
+        return BLOOM_FAILURE;
+    }
+    unsigned char header[BLOOM_BSI_HEADER_SIZE];
+    fseek(idx->filepointer, 0, SEEK_END);
+    idx->__filesize = (uint64_t)ftell(idx->filepointer);
+    rewind(idx->filepointer);
+    idx->__is_on_disk = 1;
+    idx->rows = NULL;
+    if (fread(header, BLOOM_BSI_HEADER_SIZE, 1, idx->filepointer) != 1 || __bsi_read_header(idx, header) == BLOOM_FAILURE ||
+            idx->__filesize != BLOOM_BSI_HEADER_SIZE + __bsi_rows_bytes(idx, idx->row_words) || __bsi_map(idx) == BLOOM_FAILURE) {
+        bit_sliced_bloom_index_destroy(idx);
+        return BLOOM_FAILURE;
+    }
+    return BLOOM_SUCCESS;
+}
+
+/*******************************************************************************
+*    BLOOM FILTER TREE
+*******************************************************************************/
+int bloom_filter_tree_build(BloomFilterTree *tree, BloomFilter **filters, size_t num_filters, unsigned int fanout, int num_threads) {
+    size_t i;
+    if (num_filters == 0) {
+        return BLOOM_FAILURE;
+    }
+    for (i = 0; i < num_filters; ++i) {
+        if (__check_if_union_or_intersection_ok(filters[0], filters[0], filters[i]) == BLOOM_FAILURE) {
+            fprintf(stderr, "Error: the bloom filters of a tree must match!\n");
+            return BLOOM_FAILURE;
+        }
+    }
+    if (__tree_create(tree, filters[0], num_filters, fanout, NULL) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    for (i = 0; i < num_filters; ++i) {
+        memcpy(__tree_node(tree, 0, i), filters[i]->bloom, filters[i]->bloom_length);
+    }
+    if (__tree_build_levels(tree, num_threads) == BLOOM_FAILURE) {
+        bloom_filter_tree_destroy(tree);
+        return BLOOM_FAILURE;
+    }
+    return BLOOM_SUCCESS;
+}
+
+int bloom_filter_tree_build_from_files(BloomFilterTree *tree, const char * const *filepaths, size_t num_files, unsigned int fanout, const char *tree_filepath, int num_threads) {
+    BloomFilter first;
+    if (num_files == 0 || bloom_filter_import(&first, filepaths[0]) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    int status = __tree_create(tree, &first, num_files, fanout, tree_filepath);
+    bloom_filter_destroy(&first);
+    if (status == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+#if defined(_OPENMP)
+    num_threads = (num_threads < 1) ? 1 : num_threads;
+#else
+    num_threads = 1;
+#endif
+    int64_t i, leaves = (int64_t)num_files;
+    // each thread reads whole files straight into their leaves
+    #pragma omp parallel for num_threads(num_threads) schedule(dynamic, 1)
+    for (i = 0; i < leaves; ++i) {
+        BloomFilter leaf;
+        if (__atomic_load_n(&status, __ATOMIC_RELAXED) == BLOOM_FAILURE) {
+            continue;
+        }
+        if (bloom_filter_import(&leaf, filepaths[i]) == BLOOM_FAILURE) {
+            __atomic_store_n(&status, BLOOM_FAILURE, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (__check_if_union_or_intersection_ok(&tree->params, &tree->params, &leaf) == BLOOM_FAILURE) {
+            fprintf(stderr, "Error: %s does not match the other bloom filters of the tree!\n", filepaths[i]);
+            __atomic_store_n(&status, BLOOM_FAILURE, __ATOMIC_RELAXED);
+        } else {
+            memcpy(__tree_node(tree, 0, (uint64_t)i), leaf.bloom, leaf.bloom_length);
+        }
+        bloom_filter_destroy(&leaf);
+    }
+    if (status == BLOOM_SUCCESS) {
+        status = __tree_build_levels(tree, num_threads);
+    }
+    if (status == BLOOM_FAILURE) {
+        bloom_filter_tree_destroy(tree);
+    }
+    return status;
+}
+
+int bloom_filter_tree_build_from_directory(BloomFilterTree *tree, const char *directory, unsigned int fanout, const char *tree_filepath, int num_threads) {
+    DIR *dir = opendir(directory);
+    if (dir == NULL) {
+        fprintf(stderr, "Can't open directory %s!\n", directory);
+        return BLOOM_FAILURE;
+    }
+    size_t i, num_files = 0, capacity = 64;
+    int res = BLOOM_SUCCESS;
+    char **filepaths = (char**)calloc(capacity, sizeof(char*));
+    struct dirent *entry;
+    while (filepaths != NULL && (entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (len <= 4 || strcmp(entry->d_name + len - 4, ".blm") != 0) {
+            continue;
+        }
+        if (num_files == capacity) {
+            char **grown = (char**)realloc(filepaths, 2 * capacity * sizeof(char*));
+            if (grown == NULL) {
+                res = BLOOM_FAILURE;
+                break;
+            }
+            filepaths = grown;
+            capacity *= 2;
+        }
+        filepaths[num_files] = (char*)calloc(strlen(directory) + len + 2, sizeof(char));
+        if (filepaths[num_files] == NULL) {
+            res = BLOOM_FAILURE;
+            break;
+        }
+        sprintf(filepaths[num_files++], "%s/%s", directory, entry->d_name);
+    }
+    closedir(dir);
+    if (filepaths == NULL) {
+        return BLOOM_FAILURE;
+    }
+    if (res == BLOOM_SUCCESS) {
+        // directory order is arbitrary; leaf ids follow the names
+        qsort(filepaths, num_files, sizeof(char*), __compare_strings);
+        res = bloom_filter_tree_build_from_files(tree, (const char * const *)filepaths, num_files, fanout, tree_filepath, num_threads);
+    }
+    for (i = 0; i < num_files; ++i) {
+        free(filepaths[i]);
+    }
+    free(filepaths);
+    return res;
+}
+
+int bloom_filter_tree_destroy(BloomFilterTree *tree) {
+    if (tree->__is_on_disk == 0) {
+        free(tree->nodes);
+    } else if (tree->nodes != NULL) {
+        munmap(tree->nodes - BLOOM_TREE_HEADER_SIZE, tree->__filesize);
+    }
+    tree->nodes = NULL;
+    tree->number_leaves = 0;
+    tree->number_nodes = 0;
+    tree->number_levels = 0;
+    tree->__is_on_disk = 0;
+    tree->__filesize = 0;
+    return BLOOM_SUCCESS;
+}
+
+int bloom_filter_tree_check_string(BloomFilterTree *tree, const char *str, uint64_t *ids, uint64_t *num_ids) {
+    BloomKey key;
+    if (bloom_key_init(&key, &tree->params, str) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    int res = __tree_query(tree, &key, ids, num_ids);
+    bloom_key_destroy(&key);
+    return res;
+}
+
+int bloom_filter_tree_check_bytes(BloomFilterTree *tree, const void *key, size_t len, uint64_t *ids, uint64_t *num_ids) {
+    BloomKey hashed;
+    if (bloom_key_init_bytes(&hashed, &tree->params, key, len) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    int res = __tree_query(tree, &hashed, ids, num_ids);
+    bloom_key_destroy(&hashed);
+    return res;
+}
+
+int bloom_filter_tree_check_u64(BloomFilterTree *tree, uint64_t key, uint64_t *ids, uint64_t *num_ids) {
+    BloomKey hashed;
+    if (bloom_key_init_u64(&hashed, &tree->params, key) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    int res = __tree_query(tree, &hashed, ids, num_ids);
+    bloom_key_destroy(&hashed);
+    return res;
+}
+
+int bloom_filter_tree_check_key(BloomFilterTree *tree, const BloomKey *key, uint64_t *ids, uint64_t *num_ids) {
+    if (__key_fits(&tree->params, key) == BLOOM_FAILURE) {
+        fprintf(stderr, "Error: the key was hashed for an incompatible bloom filter!\n");
+        return BLOOM_FAILURE;
+    }
+    return __tree_query(tree, key, ids, num_ids);
+}
+
+int bloom_filter_tree_export(BloomFilterTree *tree, const char *filepath) {
+    FILE *fp;
+    fp = fopen(filepath, "w+b");
+    if (fp == NULL) {
+        fprintf(stderr, "Can't open file %s!\n", filepath);
+        return BLOOM_FAILURE;
+    }
+    unsigned char header[BLOOM_TREE_HEADER_SIZE];
+    __tree_write_header(tree, header);
+    fwrite(header, BLOOM_TREE_HEADER_SIZE, 1, fp);
+    fwrite(tree->nodes, tree->node_bytes, tree->number_nodes, fp);
+    fclose(fp);
+    return BLOOM_SUCCESS;
+}
+
+int bloom_filter_tree_import(BloomFilterTree *tree, const char *filepath) {
+    FILE *fp;
+    fp = fopen(filepath, "r+b");
+    if (fp == NULL) {
+        fprintf(stderr, "Can't open file %s!\n", filepath);
+        return BLOOM_FAILURE;
+    }
+    unsigned char header[BLOOM_TREE_HEADER_SIZE];
+    uint64_t number_leaves;
+    unsigned int fanout;
+    int res = BLOOM_FAILURE;
+    fseek(fp, 0, SEEK_END);
+    uint64_t filesize = (uint64_t)ftell(fp);
+    rewind(fp);
+    tree->nodes = NULL;
+    if (fread(header, BLOOM_TREE_HEADER_SIZE, 1, fp) == 1 && __tree_read_header(tree, header, &number_leaves, &fanout) == BLOOM_SUCCESS &&
+            __tree_layout(tree, number_leaves, fanout) == BLOOM_SUCCESS && filesize == BLOOM_TREE_HEADER_SIZE + tree->number_nodes * tree->node_bytes) {
+        tree->nodes = (unsigned char*)__aligned_calloc(tree->number_nodes * tree->node_bytes);
+        if (tree->nodes != NULL && fread(tree->nodes, tree->node_bytes, tree->number_nodes, fp) == tree->number_nodes) {
+            res = BLOOM_SUCCESS;
+        }
+    }
+    fclose(fp);
+    tree->__is_on_disk = 0;
+    tree->__filesize = 0;
+    if (res == BLOOM_FAILURE) {
+        bloom_filter_tree_destroy(tree);
+    }
+    return res;
+}
+
+/*  Map the file read only; nodes are read from disk the first time a query reaches
+    them, so a query that is pruned near the root reads only a few pages */
+int bloom_filter_tree_import_on_disk(BloomFilterTree *tree, const char *filepath) {
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Can't open file %s!\n", filepath);
+        return BLOOM_FAILURE;
+    }
+    struct stat buf;
+    unsigned char header[BLOOM_TREE_HEADER_SIZE];
+    uint64_t number_leaves;
+    unsigned int fanout;
+    tree->__is_on_disk = 1;
+    tree->nodes = NULL;
+    if (fstat(fd, &buf) != 0 || pread(fd, header, BLOOM_TREE_HEADER_SIZE, 0) != BLOOM_TREE_HEADER_SIZE ||
+            __tree_read_header(tree, header, &number_leaves, &fanout) == BLOOM_FAILURE || __tree_layout(tree, number_leaves, fanout) == BLOOM_FAILURE ||
+            (uint64_t)buf.st_size != BLOOM_TREE_HEADER_SIZE + tree->number_nodes * tree->node_bytes) {
+        close(fd);
+        bloom_filter_tree_destroy(tree);
+        return BLOOM_FAILURE;
+    }
+    tree->__filesize = (uint64_t)buf.st_size;
+    unsigned char *mapped = (unsigned char*)mmap((caddr_t)0, tree->__filesize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == (unsigned char*)MAP_FAILED) {
+        perror("mmap: ");
+        bloom_filter_tree_destroy(tree);
+        return BLOOM_FAILURE;
+    }
+    madvise(mapped, tree->__filesize, MADV_RANDOM);  // do not read ahead into nodes that may be pruned
+    tree->nodes = mapped + BLOOM_TREE_HEADER_SIZE;
+    return BLOOM_SUCCESS;
+}
+
+/*******************************************************************************
+*    PRIVATE FUNCTIONS
+*******************************************************************************/
+static void __calculate_optimal_hashes(BloomFilter *bf) {
+    // calc optimized values
+    long n = bf->estimated_elements;
+    float p = bf->false_positive_probability;
+    uint64_t m = ceil((-n * logl(p)) / LOG_TWO_SQUARED);  // AKA pow(log(2), 2);
+    unsigned int k = round(LOG_TWO * m / n);             // AKA log(2.0);
+    // set paramenters
+    bf->number_hashes = k; // should check to make sure it is at least 1...
+    if (bf->index_mapping == BLOOM_INDEX_POW2) {
+        uint64_t pow2 = 8;
+        while (pow2 < m) {
+            pow2 <<= 1;
+        }
+        m = pow2;
+    }
+    bf->number_bits = m;
+    long num_pos = ceil(m / (CHAR_LEN * 1.0));
+    bf->bloom_length = num_pos;
+}
+
+static int __init_in_memory(BloomFilter *bf, uint64_t estimated_elements, float false_positive_rate, BloomHashFunction hash_function, BloomHashType hash_type, BloomIndexMapping index_mapping) {
+    if(estimated_elements == 0 || estimated_elements > UINT64_MAX || false_positive_rate <= 0.0 || false_positive_rate >= 1.0) {
+        return BLOOM_FAILURE;
+    }
+    if (__set_options(bf, (uint32_t)hash_type | ((uint32_t)index_mapping << 8)) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    bf->estimated_elements = estimated_elements;
+    bf->false_positive_probability = false_positive_rate;
+    __calculate_optimal_hashes(bf);
+    bf->bloom = __alloc_bloom(bf);
+    bf->elements_added = 0;
+    bloom_filter_set_hash_function(bf, hash_function);
+    bf->__is_on_disk = 0; // not on disk
+    bf->__thread_safe = 0;
+    bf->__counters = NULL;
+    bf->__track_bits = 0;
+    return BLOOM_SUCCESS;
+}
+
+static int __init_on_disk(BloomFilter *bf, uint64_t estimated_elements, float false_positive_rate, const char *filepath, BloomHashFunction hash_function, BloomHashType hash_type, BloomIndexMapping index_mapping) {
+    if(estimated_elements == 0 || estimated_elements > UINT64_MAX || false_positive_rate <= 0.0 || false_positive_rate >= 1.0) {
+        return BLOOM_FAILURE;
+    }
+    if (__set_options(bf, (uint32_t)hash_type | ((uint32_t)index_mapping << 8)) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    bf->estimated_elements = estimated_elements;
+    bf->false_positive_probability = false_positive_rate;
+    __calculate_optimal_hashes(bf);
+    bf->elements_added = 0;
+    bf->__counters = NULL;
+    bf->__track_bits = 0;
+    FILE *fp;
+    fp = fopen(filepath, "w+b");
+    if (fp == NULL) {
+        fprintf(stderr, "Can't open file %s!\n", filepath);
+        return BLOOM_FAILURE;
+    }
+    __write_to_file(bf, fp, 1);
+    fclose(fp);
+    // slightly ineffecient to redo some of the calculations...
+    return bloom_filter_import_on_disk_alt(bf, filepath, hash_function);
+}
+
+/* the original defaults are written without an options block to keep the file format */
+static int __has_options(BloomFilter *bf) {
+    return bf->hash_type != BLOOM_HASH_FNV1A || bf->index_mapping != BLOOM_INDEX_MODULO;
+}
+
+/* options: hash type (bits 0 - 7), index mapping (bits 8 - 15) */
+static uint32_t __get_options(BloomFilter *bf) {
+    return ((uint32_t)bf->hash_type & 0xFF) | (((uint32_t)bf->index_mapping & 0xFF) << 8);
+}
+
+static int __set_options(BloomFilter *bf, uint32_t options) {
+    uint32_t hash_type = options & 0xFF;
+    uint32_t index_mapping = (options >> 8) & 0xFF;
+    if (hash_type > BLOOM_HASH_MURMUR3_128 || index_mapping > BLOOM_INDEX_POW2 || (options >> 16) != 0) {
+        return BLOOM_FAILURE;
+    }
+    bf->hash_type = (BloomHashType)hash_type;
+    bf->index_mapping = (BloomIndexMapping)index_mapping;
+    return BLOOM_SUCCESS;
+}
+
+/* the mapped bit positions of key idx of the batch */
+static void __batch_bits(BloomFilter *bf, const BloomBatch *batch, size_t idx, uint64_t *bits) {
+    unsigned int i;
+    if (batch->ints != NULL) {
+        uint64_t h1, h2;
+        __hash_u64(batch->ints[idx], &h1, &h2);
+        for (i = 0; i < bf->number_hashes; ++i) {
+            bits[i] = __map_bit(bf, h1 + i * h2);
+        }
+        return;
+    }
+    if (batch->key_at != NULL) {
+        char buffer[BLOOM_KEY_BUFFER_SIZE];
+        size_t len = 0;
+        const char *key = batch->key_at(idx, buffer, &len, batch->user_data);
+        bf->hash_function_bytes(bf->number_hashes, key, len, bits);
+    } else {
+        size_t len = (batch->lengths == NULL) ? strlen(batch->keys[idx]) : batch->lengths[idx];
+        bf->hash_function_bytes(bf->number_hashes, batch->keys[idx], len, bits);
+    }
+    for (i = 0; i < bf->number_hashes; ++i) {
+        bits[i] = __map_bit(bf, bits[i]);
+    }
+}
+
+static int __add_batch(BloomFilter *bf, const BloomBatch *batch, size_t num_keys) {
+    if (__add_batch_bits(bf, batch, 0, num_keys, 0, NULL) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    __add_elements_added(bf, num_keys);
+    return BLOOM_SUCCESS;
+}
+
+static int __add_if_absent_batch(BloomFilter *bf, const BloomBatch *batch, size_t num_keys, unsigned char *results) {
+    if (__add_batch_bits(bf, batch, 0, num_keys, 0, results) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    size_t i, added = 0;
+    for (i = 0; i < num_keys; ++i) {
+        added += results[i];
+    }
+    __add_elements_added(bf, added);
+    return BLOOM_SUCCESS;
+}
+
+/*  Hash and prefetch the next window of keys before setting the bits of the current
+    one so that the cache misses of a whole window are in flight at the same time.
+    Bits of a private bit array (not shared with other threads) are set without atomics.
+    If results is not NULL, results[i] is set to 1 if key i set a bit that was unset */
+static int __add_batch_bits(BloomFilter *bf, const BloomBatch *batch, size_t first, size_t num_keys, int is_private, unsigned char *results) {
+    uint64_t stack_bits[2 * BLOOM_BATCH_WINDOW * BLOOM_MAX_STACK_HASHES];
+    uint64_t k = bf->number_hashes, window_bits = BLOOM_BATCH_WINDOW * k;
+    uint64_t *bits = (k > BLOOM_MAX_STACK_HASHES) ? (uint64_t*)calloc(2 * window_bits, sizeof(uint64_t)) : stack_bits;
+    if (bits == NULL) {
+        return BLOOM_FAILURE;
+    }
+    size_t start, i, count = 0;
+    for (start = 0; start < num_keys + BLOOM_BATCH_WINDOW; start += BLOOM_BATCH_WINDOW) {
+        // hash and prefetch the window at start
+        uint64_t *next = bits + (start / BLOOM_BATCH_WINDOW % 2) * window_bits;
+        size_t next_count = (start < num_keys) ? num_keys - start : 0;
+        next_count = next_count > BLOOM_BATCH_WINDOW ? BLOOM_BATCH_WINDOW : next_count;
+        for (i = 0; i < next_count; ++i) {
+            __batch_bits(bf, batch, first + start + i, next + i * k);
+        }
+        for (i = 0; i < next_count * k; ++i) {
+            BLOOM_PREFETCH(bf->bloom + next[i] / 8, 1);
+        }
+        // set the bits of the previous window
+        uint64_t *current = bits + ((start / BLOOM_BATCH_WINDOW + 1) % 2) * window_bits;
+        if (is_private) {
+            for (i = 0; i < count * k; ++i) {
+                bf->bloom[current[i] / 8] |= (1 << (current[i] % 8));
+            }
+        } else if (results != NULL) {
+            for (i = 0; i < count; ++i) {
+                int added = 0;
+                uint64_t j;
+                for (j = 0; j < k; ++j) {
+                    added |= __test_and_set_mapped_bit(bf, current[i * k + j]);
+                }
+                results[start - BLOOM_BATCH_WINDOW + i] = (unsigned char)added;
+            }
+        } else {
+            for (i = 0; i < count * k; ++i) {
+                __set_mapped_bit(bf, current[i]);
+            }
+        }
+        count = next_count;
+    }
+    if (bits != stack_bits) {
+        free(bits);
+    }
+    return BLOOM_SUCCESS;
+}
+
+/*  Thread t adds keys [t * n / T, (t + 1) * n / T) to its own copy of the bit array
+    (thread 0 uses the filter's), then each thread ORs every copy into its own slice
+    of the filter's words; setting bits commutes, so this is the serial result */
+static int __parallel_build(BloomFilter *bf, const BloomBatch *batch, size_t num_keys, int num_threads) {
+#if defined(_OPENMP)
+    num_threads = (num_threads < 1) ? 1 : num_threads;
+#else
+    num_threads = 1;
+#endif
+    if (num_threads == 1 || num_keys < (size_t)num_threads) {
+        return __add_batch(bf, batch, num_keys);
+    }
+    int t, status = BLOOM_SUCCESS;
+    unsigned char **shards = (unsigned char**)calloc(num_threads, sizeof(unsigned char*));
+    if (shards == NULL) {
+        return BLOOM_FAILURE;
+    }
+    shards[0] = bf->bloom;
+    for (t = 1; t < num_threads; ++t) {
+        shards[t] = __alloc_bloom(bf);
+        if (shards[t] == NULL) {
+            status = BLOOM_FAILURE;
+            break;
+        }
+    }
+    if (status == BLOOM_SUCCESS) {
+        uint64_t words = bf->bloom_length / 8;
+        #pragma omp parallel num_threads(num_threads) private(t)
+        {
+            int id = 0, threads = 1;
+#if defined(_OPENMP)
+            id = omp_get_thread_num();
+            threads = omp_get_num_threads();  // the runtime may give fewer threads
+#endif
+            BloomFilter shard = *bf;
+            shard.bloom = shards[id];
+            size_t first = num_keys * id / threads, last = num_keys * (id + 1) / threads;
+            if (__add_batch_bits(&shard, batch, first, last - first, 1, NULL) == BLOOM_FAILURE) {
+                #pragma omp atomic write
+                status = BLOOM_FAILURE;
+            }
+            #pragma omp barrier
+            for (t = 1; t < threads; ++t) {
+                __bulk_slice(BLOOM_BULK_OR, bf->bloom, bf->bloom, shards[t], words * id / threads, words * (id + 1) / threads);
+            }
+            #pragma omp single
+            {
+                uint64_t i;
+                for (i = words * 8; i < bf->bloom_length; ++i) {
+                    for (t = 1; t < threads; ++t) {
+                        bf->bloom[i] |= shards[t][i];
+                    }
+                }
+            }
+        }
+    }
+    for (t = 1; t < num_threads; ++t) {
+        free(shards[t]);
+    }
+    free(shards);
+    __recount_bits_set(bf);  // the private copies were not tracked
+    if (status == BLOOM_SUCCESS) {
+        __add_elements_added(bf, num_keys);
+    }
+    return status;
+}
+
+/*  Run a bulk operation over the first 'words' words; with more than one bulk thread
+    (and OpenMP) each thread takes one contiguous, cache line aligned slice so that
+    it streams through its own pages. The counting operations return the bits set. */
+static uint64_t __bulk_words(BloomBulkOp op, unsigned char *res, const unsigned char *a, const unsigned char *b, uint64_t words) {
+    int t, threads = __bulk_thread_count(words);
+    if (threads <= 1) {
+        return __bulk_slice(op, res, a, b, 0, words);
+    }
+    if (op == BLOOM_BULK_COUNT) {
+        bloom_filter_get_popcount_kernel();  // pick the kernel before the threads use it
+    }
+    uint64_t count = 0;
+    #pragma omp parallel for num_threads(threads) schedule(static, 1) reduction(+:count)
+    for (t = 0; t < threads; ++t) {
+        uint64_t first = __bulk_slice_start(words, t, threads), last = __bulk_slice_start(words, t + 1, threads);
+        count += __bulk_slice(op, res, a, b, first, last);
+    }
+    return count;
+}
+
+static int __bulk_thread_count(uint64_t words) {
+    int threads = bulk_threads;
+    if ((uint64_t)threads > words / BLOOM_BULK_THREAD_WORDS) {
+        threads = (int)(words / BLOOM_BULK_THREAD_WORDS);
+    }
+    return threads;
+}
+
+/* slice t of a bulk operation starts on a cache line; the last one ends at words */
+static uint64_t __bulk_slice_start(uint64_t words, int t, int threads) {
+    if (t == threads) {
+        return words;
+    }
+    return (words * t / threads) & ~(uint64_t)(BLOOM_CACHE_LINE / 8 - 1);
+}
+
+/*  Combine all of the filters into res in one pass: each block of the output is
+    built from every filter in a cache resident buffer (so res may be one of the
+    filters), stored, and its bits counted for the estimated elements */
+static int __combine_many(BloomFilter *res, BloomFilter **filters, size_t num_filters, int intersect) {
+    size_t f;
+    if (num_filters == 0) {
+        return BLOOM_FAILURE;
+    }
+    for (f = 0; f < num_filters; ++f) {
+        if (__check_if_union_or_intersection_ok(res, filters[0], filters[f]) == BLOOM_FAILURE) {
+            return BLOOM_FAILURE;
+        }
+    }
+    uint64_t i, words = res->bloom_length / 8, bits = 0;
+    int t, threads = __bulk_thread_count(words);
+    bloom_filter_get_popcount_kernel();  // pick the kernel before any threads use it
+    if (threads <= 1) {
+        bits = __combine_many_slice(res, filters, num_filters, intersect, 0, words);
+    } else {
+        #pragma omp parallel for num_threads(threads) schedule(static, 1) reduction(+:bits)
+        for (t = 0; t < threads; ++t) {
+            uint64_t first = __bulk_slice_start(words, t, threads), last = __bulk_slice_start(words, t + 1, threads);
+            bits += __combine_many_slice(res, filters, num_filters, intersect, first, last);
+        }
+    }
+    for (i = words * 8; i < res->bloom_length; ++i) {
+        unsigned char c = filters[0]->bloom[i];
+        for (f = 1; f < num_filters; ++f) {
+            c = intersect ? (c & filters[f]->bloom[i]) : (c | filters[f]->bloom[i]);
+        }
+        res->bloom[i] = c;
+        bits += __sum_bits_set_char(c);
+    }
+    __discard_elements_added(res);  // the estimate replaces any adds not yet folded in
+    res->elements_added = bloom_filter_estimate_elements_by_values(res->number_bits, bits, res->number_hashes);
+    __update_elements_added_on_disk(res);
+    if (res->__track_bits) {
+        __fold_elements_added(res);  // drop the stripes' counts of bits set
+        res->__bits_set = bits;
+    }
+    return BLOOM_SUCCESS;
+}
+
+static uint64_t __combine_many_slice(BloomFilter *res, BloomFilter **filters, size_t num_filters, int intersect, uint64_t first, uint64_t last) {
+    uint64_t block[BLOOM_MANY_BLOCK_WORDS];
+    uint64_t start, i, n, bits = 0;
+    size_t f;
+    for (start = first; start < last; start += n) {
+        n = (last - start < BLOOM_MANY_BLOCK_WORDS) ? last - start : BLOOM_MANY_BLOCK_WORDS;
+        memcpy(block, filters[0]->bloom + start * 8, n * 8);
+        for (f = 1; f < num_filters; ++f) {
+            const unsigned char *src = filters[f]->bloom + start * 8;
+            if (intersect) {
+                for (i = 0; i < n; ++i) {
+                    block[i] &= __load_word(src, i);
+                }
+            } else {
+                for (i = 0; i < n; ++i) {
+                    block[i] |= __load_word(src, i);
+                }
+            }
+        }
+        memcpy(res->bloom + start * 8, block, n * 8);
+        bits += __popcount_words((const unsigned char*)block, n);
+    }
+    return bits;
+}
+
+/*  The bits set in A, B, and A & B in one pass over both filters (no compatibility
+    check); A | B follows as |A| + |B| - |A & B| */
+static void __pair_counts(BloomFilter *bf1, BloomFilter *bf2, BloomPairCounts *counts) {
+    uint64_t i, words = bf1->bloom_length / 8;
+    uint64_t a = 0, b = 0, both = 0;
+    int t, threads = __bulk_thread_count(words);
+    if (threads <= 1) {
+        uint64_t slice[3];
+        __popcount_pair_words(bf1->bloom, bf2->bloom, words, slice);
+        a = slice[0];
+        b = slice[1];
+        both = slice[2];
+    } else {
+        bloom_filter_get_popcount_kernel();  // pick the kernel before the threads use it
+        #pragma omp parallel for num_threads(threads) schedule(static, 1) reduction(+:a, b, both)
+        for (t = 0; t < threads; ++t) {
+            uint64_t slice[3];
+            uint64_t first = __bulk_slice_start(words, t, threads), last = __bulk_slice_start(words, t + 1, threads);
+            __popcount_pair_words(bf1->bloom + first * 8, bf2->bloom + first * 8, last - first, slice);
+            a += slice[0];
+            b += slice[1];
+            both += slice[2];
+        }
+    }
+    for (i = words * 8; i < bf1->bloom_length; ++i) {
+        a += __sum_bits_set_char(bf1->bloom[i]);
+        b += __sum_bits_set_char(bf2->bloom[i]);
+        both += __sum_bits_set_char(bf1->bloom[i] & bf2->bloom[i]);
+    }
+    counts->bits_a = a;
+    counts->bits_b = b;
+    counts->bits_intersection = both;
+    counts->bits_union = a + b - both;
+}
+
+/* the word loops are simple enough for the compiler to vectorize */
+static uint64_t __bulk_slice(BloomBulkOp op, unsigned char *res, const unsigned char *a, const unsigned char *b, uint64_t first, uint64_t last) {
+    uint64_t i, count = 0;
+    switch (op) {
+        case BLOOM_BULK_OR:
+            for (i = first; i < last; ++i) {
+                __store_word(res, i, __load_word(a, i) | __load_word(b, i));
+            }
+            break;
+        case BLOOM_BULK_AND:
+            for (i = first; i < last; ++i) {
+                __store_word(res, i, __load_word(a, i) & __load_word(b, i));
+            }
+            break;
+        case BLOOM_BULK_CLEAR:
+            memset(res + first * 8, 0, (last - first) * 8);
+            break;
+        case BLOOM_BULK_COUNT:
+            count = __popcount_words(a + first * 8, last - first);
+            break;
+    }
+    return count;
+}
+
+/*  Stage the bit positions of a chunk of keys, counting sort them by the region of
+    the filter they fall in, then set each region's bits together; the filter is
+    swept in order instead of touched at random. Setting bits commutes, so the
+    result is the same as adding the keys one at a time. The staging buffers are
+    large (2 x 64 MB) so that each region receives many bits per chunk. */
+static int __bulk_load(BloomFilter *bf, const BloomBatch *batch, size_t num_keys) {
+    if (bf->bloom_length < BLOOM_BULK_MIN_BYTES) {  // mostly cache resident; partitioning does not pay off
+        return __add_batch(bf, batch, num_keys);
+    }
+    uint64_t k = bf->number_hashes;
+    uint64_t region = BLOOM_BULK_REGION;
+    unsigned int shift = 3;  // bit position to partition; region is a power of 2 bytes
+    while ((bf->bloom_length + region - 1) / region > BLOOM_BULK_MAX_PARTITIONS) {
+        region *= 2;
+    }
+    while ((1ULL << shift) < region * 8) {
+        ++shift;
+    }
+    uint64_t partitions = (bf->bloom_length + region - 1) / region;
+    uint64_t chunk = BLOOM_BULK_STAGED / k + 1;
+    chunk = num_keys < chunk ? num_keys : chunk;
+    uint64_t *staged = (uint64_t*)malloc(chunk * k * sizeof(uint64_t) + 1);
+    uint64_t *sorted = (uint64_t*)malloc(chunk * k * sizeof(uint64_t) + 1);
+    uint64_t *offsets = (uint64_t*)calloc(partitions + 1, sizeof(uint64_t));
+    if (staged == NULL || sorted == NULL || offsets == NULL) {
+        free(staged);
+        free(sorted);
+        free(offsets);
+        return BLOOM_FAILURE;
+    }
+    size_t start, i;
+    uint64_t p;
+    for (start = 0; start < num_keys; start += chunk) {
+        size_t count = (num_keys - start < chunk) ? num_keys - start : chunk;
+        uint64_t bits = count * k;
+        for (i = 0; i < count; ++i) {
+            __batch_bits(bf, batch, start + i, staged + i * k);
+        }
+        // histogram and exclusive prefix sum of the partitions
+        memset(offsets, 0, (partitions + 1) * sizeof(uint64_t));
+        for (i = 0; i < bits; ++i) {
+            ++offsets[(staged[i] >> shift) + 1];
+        }
+        for (p = 1; p <= partitions; ++p) {
+            offsets[p] += offsets[p - 1];
+        }
+        for (i = 0; i < bits; ++i) {
+            sorted[offsets[staged[i] >> shift]++] = staged[i];
+        }
+        // offsets[p] is now the end of partition p, i.e. the bits are in filter order by region
+        for (i = 0; i < bits; ++i) {
+            __set_mapped_bit(bf, sorted[i]);
+        }
+    }
+    free(staged);
+    free(sorted);
+    free(offsets);
+    __add_elements_added(bf, num_keys);
+    return BLOOM_SUCCESS;
+}
+
+/*  Asynchronous memory access chaining: each of BLOOM_BATCH_LOOKUPS slots holds one
+    lookup. A slot checks one (already prefetched) bit and then either finishes or
+    prefetches its next bit and yields to the next slot, so while one lookup waits
+    on memory the others make progress. A finished slot takes the next key. */
+static int __check_batch(BloomFilter *bf, const BloomBatch *batch, size_t num_keys, unsigned char *results, int bitmap) {
+    uint64_t stack_bits[BLOOM_BATCH_LOOKUPS * BLOOM_MAX_STACK_HASHES];
+    uint64_t k = bf->number_hashes;
+    uint64_t *bits = (k > BLOOM_MAX_STACK_HASHES) ? (uint64_t*)calloc(BLOOM_BATCH_LOOKUPS * k, sizeof(uint64_t)) : stack_bits;
+    if (bits == NULL) {
+        return BLOOM_FAILURE;
+    }
+    size_t key[BLOOM_BATCH_LOOKUPS];
+    unsigned int next_bit[BLOOM_BATCH_LOOKUPS];
+    int active[BLOOM_BATCH_LOOKUPS];
+    size_t next_key = 0, remaining = num_keys;
+    unsigned int s;
+
+    if (bitmap) {
+        memset(results, 0, (num_keys + 7) / 8);
+    }
+    for (s = 0; s < BLOOM_BATCH_LOOKUPS; ++s) {
+        active[s] = 0;
+    }
+    while (remaining > 0) {
+        for (s = 0; s < BLOOM_BATCH_LOOKUPS; ++s) {
+            uint64_t *slot = bits + s * k;
+            if (!active[s]) {  // start the next lookup: hash and prefetch the first bit
+                if (next_key == num_keys) {
+                    continue;
+                }
+                key[s] = next_key++;
+                __batch_bits(bf, batch, key[s], slot);
+                BLOOM_PREFETCH(bf->bloom + slot[0] / 8, 0);
+                next_bit[s] = 0;
+                active[s] = 1;
+                continue;
+            }
+            int found = __check_mapped_bit(bf, slot[next_bit[s]]) != 0;
+            if (found && ++next_bit[s] < k) {
+                BLOOM_PREFETCH(bf->bloom + slot[next_bit[s]] / 8, 0);
+                continue;
+            }
+            // the lookup is finished
+            if (bitmap) {
+                results[key[s] / 8] |= (unsigned char)(found << (key[s] % 8));
+            } else {
+                results[key[s]] = (unsigned char)found;
+            }
+            active[s] = 0;
+            --remaining;
+        }
+    }
+    if (bits != stack_bits) {
+        free(bits);
+    }
+    return BLOOM_SUCCESS;
+}
+
+/* use the stack buffer unless there are too many hashes; free the result if it differs */
+static uint64_t* __hash_buffer(BloomFilter *bf, uint64_t *stack_buffer) {
+    if (bf->number_hashes > BLOOM_MAX_STACK_HASHES) {
+        return (uint64_t*)calloc(bf->number_hashes, sizeof(uint64_t));
+    }
+    return stack_buffer;
+}
+
+static __inline__ uint64_t __map_bit(BloomFilter *bf, uint64_t hash) {
+    switch (bf->index_mapping) {
+        case BLOOM_INDEX_FASTRANGE:
+            return __mulhi64(hash, bf->number_bits);
+        case BLOOM_INDEX_POW2:
+            return hash & (bf->number_bits - 1);
+        default:
+            return hash % bf->number_bits;
+    }
+}
+
+static int __key_init(BloomKey *key, BloomFilter *bf) {
+    key->number_hashes = bf->number_hashes;
+    key->number_bits = bf->number_bits;
+    key->index_mapping = bf->index_mapping;
+    key->hash_function = bf->hash_function;
+    key->hash_function_noalloc = bf->hash_function_noalloc;
+    key->hash_function_bytes = bf->hash_function_bytes;
+    key->hash_type = bf->hash_type;
+    key->__is_integer = 0;
+    key->__heap = NULL;
+    if (bf->number_hashes > BLOOM_KEY_INLINE_HASHES) {
+        key->__heap = (uint64_t*)calloc(2 * (size_t)bf->number_hashes, sizeof(uint64_t));
+        if (key->__heap == NULL) {
+            key->number_hashes = 0;
+            return BLOOM_FAILURE;
+        }
+    }
+    return BLOOM_SUCCESS;
+}
+
+/*  A key can be used with a filter that hashes the same way and uses at most as
+    many hashes; integer keys always use the built in mixer */
+static int __key_fits(BloomFilter *bf, const BloomKey *key) {
+    if (bf->number_hashes > key->number_hashes) {
+        return BLOOM_FAILURE;
+    } else if (key->__is_integer) {
+        return BLOOM_SUCCESS;
+    } else if (bf->hash_function != key->hash_function || bf->hash_function_noalloc != key->hash_function_noalloc) {
+        return BLOOM_FAILURE;
+    } else if (bf->hash_function_bytes != key->hash_function_bytes || bf->hash_type != key->hash_type) {
+        return BLOOM_FAILURE;
+    }
+    return BLOOM_SUCCESS;
+}
+
+/* the mapped bits are reused for filters of the same size and mapping */
+static __inline__ uint64_t __key_bit(BloomFilter *bf, const BloomKey *key, unsigned int i) {
+    const uint64_t *hashes = BLOOM_KEY_HASHES(key);
+    if (bf->number_bits == key->number_bits && bf->index_mapping == key->index_mapping) {
+        return hashes[key->number_hashes + i];
+    }
+    return __map_bit(bf, hashes[i]);
+}
+
+static __inline__ void __set_bit(BloomFilter *bf, uint64_t hash) {
+    __set_mapped_bit(bf, __map_bit(bf, hash));
+}
+
+static __inline__ void __set_mapped_bit(BloomFilter *bf, uint64_t bit) {
+    if (bf->__thread_safe || bf->__track_bits) {
+        __test_and_set_mapped_bit(bf, bit);
+        return;
+    }
+    #pragma omp atomic update
+    bf->bloom[bit / 8] |= (1 << (bit % 8)); // set the bit
+}
+
+/*  Set the bit and return 1 if this call changed it from 0 to 1. Of many threads
+    setting the same bit, only the one whose atomic or flipped it gets 1 */
+static __inline__ int __test_and_set_mapped_bit(BloomFilter *bf, uint64_t bit) {
+    int flipped;
+    if (bf->__thread_safe) {
+        // test before the read-modify-write so set bits do not bounce the cache line
+        bloom_atomic_t *word = (bloom_atomic_t*)bf->bloom + bit / BLOOM_ATOMIC_BITS;
+        bloom_atomic_t mask = (bloom_atomic_t)1 << (bit % BLOOM_ATOMIC_BITS);
+        if ((__atomic_load_n(word, __ATOMIC_RELAXED) & mask) != 0) {
+            return 0;
+        }
+        flipped = (__atomic_fetch_or(word, mask, __ATOMIC_RELAXED) & mask) == 0;
+    } else {
+        // atomic without OpenMP too, so that one of the threads adding a new key sees it flip
+        unsigned char mask = (unsigned char)(1 << (bit % 8));
+        flipped = (__atomic_fetch_or(bf->bloom + bit / 8, mask, __ATOMIC_RELAXED) & mask) == 0;
+    }
+    if (flipped && bf->__track_bits) {
+        __add_bits_set(bf);
+    }
+    return flipped;
+}
+
+static __inline__ void __add_bits_set(BloomFilter *bf) {
+    if (bf->__counters != NULL) {
+        __atomic_fetch_add(__counter_stripe(bf) + 1, 1, __ATOMIC_RELAXED);
+    } else if (bf->__thread_safe) {
+        __atomic_fetch_add(&bf->__bits_set, 1, __ATOMIC_RELAXED);
+    } else {
+        #pragma omp atomic update
+        bf->__bits_set++;
+    }
+}
+
+/* rescan the bits set after the bit array changed other than through adds */
+static void __recount_bits_set(BloomFilter *bf) {
+    if (bf->__track_bits == 0) {
+        return;  // counted when tracking is turned on
+    }
+    __fold_elements_added(bf);  // drop the stripes' counts of bits set
+    bf->__track_bits = 0;
+    bf->__bits_set = bloom_filter_count_set_bits(bf);
+    bf->__track_bits = 1;
+}
+
+static __inline__ int __check_bit(BloomFilter *bf, uint64_t hash) {
+    return __check_mapped_bit(bf, __map_bit(bf, hash));
+}
+
+static __inline__ int __check_mapped_bit(BloomFilter *bf, uint64_t bit) {
+    if (bf->__thread_safe) {
+        return CHECK_BIT_CHAR(__atomic_load_n(bf->bloom + bit / 8, __ATOMIC_RELAXED), bit % 8);
+    }
+    return CHECK_BIT(bf->bloom, bit);
+}
+
+static void __increment_elements_added(BloomFilter *bf) {
+    __add_elements_added(bf, 1);
+}
+
+static void __add_elements_added(BloomFilter *bf, uint64_t count) {
+    if (bf->__counters != NULL) {
+        __atomic_fetch_add(__counter_stripe(bf), count, __ATOMIC_RELAXED);  // only contended past 64 threads
+        return;  // the file trailer is written when the count is folded
+    }
+    uint64_t total;
+    if (bf->__thread_safe) {
+        total = __atomic_add_fetch(&bf->elements_added, count, __ATOMIC_RELAXED);
+    } else {
+        #pragma omp atomic capture
+        total = bf->elements_added += count;
+    }
+    // write the trailer each time the count crosses a multiple of the sync interval
+    uint64_t interval = bf->__sync_interval;
+    if (bf->__is_on_disk == 1 && interval != 0 && (total - count) / interval != total / interval) {
+        __update_elements_added_on_disk(bf);
+    }
+}
+
+/* this thread's stripe: [0] counts elements added and [1] bits set */
+static __inline__ uint64_t* __counter_stripe(BloomFilter *bf) {
+    if (bloom_thread_stripe == 0) {
+        bloom_thread_stripe = __atomic_add_fetch(&bloom_next_stripe, 1, __ATOMIC_RELAXED);
+    }
+    return bf->__counters + ((bloom_thread_stripe - 1) % BLOOM_COUNTER_STRIPES) * BLOOM_COUNTER_STRIDE;
+}
+
+static void __fold_elements_added(BloomFilter *bf) {
+    if (bf->__counters == NULL) {
+        return;
+    }
+    uint64_t i, total = 0, bits = 0;
+    for (i = 0; i < BLOOM_COUNTER_STRIPES; ++i) {
+        total += __atomic_exchange_n(bf->__counters + i * BLOOM_COUNTER_STRIDE, 0, __ATOMIC_RELAXED);
+        bits += __atomic_exchange_n(bf->__counters + i * BLOOM_COUNTER_STRIDE + 1, 0, __ATOMIC_RELAXED);
+    }
+    if (bits != 0) {
+        __atomic_fetch_add(&bf->__bits_set, bits, __ATOMIC_RELAXED);
+    }
+    if (total != 0) {
+        __atomic_fetch_add(&bf->elements_added, total, __ATOMIC_RELAXED);
+        __update_elements_added_on_disk(bf);
+    }
+}
+
+/* drop the stripes' counts of elements added; their counts of bits set are kept */
+static void __discard_elements_added(BloomFilter *bf) {
+    if (bf->__counters == NULL) {
+        return;
+    }
+    uint64_t i;
+    for (i = 0; i < BLOOM_COUNTER_STRIPES; ++i) {
+        __atomic_exchange_n(bf->__counters + i * BLOOM_COUNTER_STRIDE, 0, __ATOMIC_RELAXED);
+    }
+}
+
+static int __sum_bits_set_char(unsigned char c) {
+    return bits_set_table[c];
+}
+
+static int __check_if_union_or_intersection_ok(BloomFilter *res, BloomFilter *bf1, BloomFilter *bf2) {
+    if (res->number_hashes != bf1->number_hashes || bf1->number_hashes != bf2->number_hashes) {
+        return BLOOM_FAILURE;
+    } else if (res->number_bits != bf1->number_bits || bf1->number_bits != bf2->number_bits) {
+        return BLOOM_FAILURE;
+    } else if (res->hash_function != bf1->hash_function || bf1->hash_function != bf2->hash_function) {
+        return BLOOM_FAILURE;
+    } else if (res->hash_function_noalloc != bf1->hash_function_noalloc || bf1->hash_function_noalloc != bf2->hash_function_noalloc) {
+        return BLOOM_FAILURE;
+    } else if (res->hash_function_bytes != bf1->hash_function_bytes || bf1->hash_function_bytes != bf2->hash_function_bytes) {
+        return BLOOM_FAILURE;
+    } else if (res->hash_type != bf1->hash_type || bf1->hash_type != bf2->hash_type) {
+        return BLOOM_FAILURE;
+    } else if (res->index_mapping != bf1->index_mapping || bf1->index_mapping != bf2->index_mapping) {
+        return BLOOM_FAILURE;
+    }
+    return BLOOM_SUCCESS;
+}
+
+/* zeroed memory aligned to a cache line; release with free() */
+static void* __aligned_calloc(size_t bytes) {
+    void *ptr = NULL;
+    if (posix_memalign(&ptr, BLOOM_CACHE_LINE, bytes == 0 ? BLOOM_CACHE_LINE : bytes) != 0) {
+        return NULL;
+    }
+    memset(ptr, 0, bytes);
+    return ptr;
+}
+
+/*  The bit array of a BloomFilter in memory: cache line aligned and padded with zeros
+    to a whole number of cache lines so that it can be processed a word at a time */
+static unsigned char* __alloc_bloom(BloomFilter *bf) {
+    uint64_t padded = (bf->bloom_length + BLOOM_CACHE_LINE - 1) / BLOOM_CACHE_LINE * BLOOM_CACHE_LINE;
+    return (unsigned char*)__aligned_calloc(padded);
+}
+
+/* word access through memcpy is alias safe and compiles to a single load or store */
+static __inline__ uint64_t __load_word(const unsigned char *bytes, uint64_t i) {
+    uint64_t word;
+    memcpy(&word, bytes + i * sizeof(uint64_t), sizeof(uint64_t));
+    return word;
+}
+
+static __inline__ void __store_word(unsigned char *bytes, uint64_t i, uint64_t word) {
+    memcpy(bytes + i * sizeof(uint64_t), &word, sizeof(uint64_t));
+}
+
+static __inline__ uint64_t __popcount64(uint64_t word) {
+    word = word - ((word >> 1) & 0x5555555555555555ULL);
+    word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+    word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (word * 0x0101010101010101ULL) >> 56;
+}
+
+/*******************************************************************************
+*    Popcount kernels; all count the bits set in `words` 64 bit words. The pair
+*    kernels count the bits set in a, b, and a & b into counts[0 .. 2] in one pass
+*******************************************************************************/
+static uint64_t __popcount_portable(const unsigned char *bytes, uint64_t words) {
+    uint64_t i, res = 0;
+    for (i = 0; i < words; ++i) {
+        res += __popcount64(__load_word(bytes, i));
+    }
+    return res;
+}
+
+static void __popcount_pair_portable(const unsigned char *a, const unsigned char *b, uint64_t words, uint64_t *counts) {
+    uint64_t i;
+    counts[0] = counts[1] = counts[2] = 0;
+    for (i = 0; i < words; ++i) {
+        uint64_t x = __load_word(a, i), y = __load_word(b, i);
+        counts[0] += __popcount64(x);
+        counts[1] += __popcount64(y);
+        counts[2] += __popcount64(x & y);
+    }
+}
+
+/* out[i] is the AND of rows[r][first + i] over all of the rows */
+static void __and_rows_portable(uint64_t *out, const uint64_t * const *rows, unsigned int number_rows, uint64_t first, uint64_t words) {
+    uint64_t i;
+    unsigned int r;
+    for (i = 0; i < words; ++i) {
+        out[i] = rows[0][first + i];
+    }
+    for (r = 1; r < number_rows; ++r) {
+        for (i = 0; i < words; ++i) {
+            out[i] &= rows[r][first + i];
+        }
+    }
+}
+
+#if defined(BLOOM_X86_DISPATCH)
+__attribute__((target("popcnt")))
+static uint64_t __popcount_popcnt(const unsigned char *bytes, uint64_t words) {
+    uint64_t i, res = 0;
+    for (i = 0; i < words; ++i) {
+        res += __builtin_popcountll(__load_word(bytes, i));
+    }
+    return res;
+}
+
+__attribute__((target("popcnt")))
+static void __popcount_pair_popcnt(const unsigned char *a, const unsigned char *b, uint64_t words, uint64_t *counts) {
+    uint64_t i, ca = 0, cb = 0, cab = 0;
+    for (i = 0; i < words; ++i) {
+        uint64_t x = __load_word(a, i), y = __load_word(b, i);
+        ca += __builtin_popcountll(x);
+        cb += __builtin_popcountll(y);
+        cab += __builtin_popcountll(x & y);
+    }
+    counts[0] = ca;
+    counts[1] = cb;
+    counts[2] = cab;
+}
+
+/* per 64 bit lane counts of a vector using a nibble lookup table */
+__attribute__((target("avx2")))
+static __inline__ __m256i __popcount256(__m256i v) {
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    __m256i lo = _mm256_and_si256(v, low_mask);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+    __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+    return _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+}
+
+/* carry save adder: h:l = a + b + c */
+__attribute__((target("avx2")))
+static __inline__ void __csa256(__m256i *h, __m256i *l, __m256i a, __m256i b, __m256i c) {
+    __m256i u = _mm256_xor_si256(a, b);
+    *h = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(u, c));
+    *l = _mm256_xor_si256(u, c);
+}
+
+/*  Harley-Seal: sum 16 vectors at a time with carry save adders so only one in 16
+    needs a full count (Mula, Kurz, Lemire https://arxiv.org/abs/1611.07612) */
+__attribute__((target("avx2,popcnt")))
+static uint64_t __popcount_avx2(const unsigned char *bytes, uint64_t words) {
+    const __m256i *data = (const __m256i*)bytes;
+    uint64_t i, vectors = words / 4;
+    __m256i total = _mm256_setzero_si256();
+    __m256i ones = _mm256_setzero_si256(), twos = _mm256_setzero_si256();
+    __m256i fours = _mm256_setzero_si256(), eights = _mm256_setzero_si256();
+    __m256i sixteens, twos_a, twos_b, fours_a, fours_b, eights_a, eights_b;
+    for (i = 0; i + 16 <= vectors; i += 16) {
+        __csa256(&twos_a, &ones, ones, _mm256_loadu_si256(data + i), _mm256_loadu_si256(data + i + 1));
+        __csa256(&twos_b, &ones, ones, _mm256_loadu_si256(data + i + 2), _mm256_loadu_si256(data + i + 3));
+        __csa256(&fours_a, &twos, twos, twos_a, twos_b);
+        __csa256(&twos_a, &ones, ones, _mm256_loadu_si256(data + i + 4), _mm256_loadu_si256(data + i + 5));
+        __csa256(&twos_b, &ones, ones, _mm256_loadu_si256(data + i + 6), _mm256_loadu_si256(data + i + 7));
+        __csa256(&fours_b, &twos, twos, twos_a, twos_b);
+        __csa256(&eights_a, &fours, fours, fours_a, fours_b);
+        __csa256(&twos_a, &ones, ones, _mm256_loadu_si256(data + i + 8), _mm256_loadu_si256(data + i + 9));
+        __csa256(&twos_b, &ones, ones, _mm256_loadu_si256(data + i + 10), _mm256_loadu_si256(data + i + 11));
+        __csa256(&fours_a, &twos, twos, twos_a, twos_b);
+        __csa256(&twos_a, &ones, ones, _mm256_loadu_si256(data + i + 12), _mm256_loadu_si256(data + i + 13));
+        __csa256(&twos_b, &ones, ones, _mm256_loadu_si256(data + i + 14), _mm256_loadu_si256(data + i + 15));
+        __csa256(&fours_b, &twos, twos, twos_a, twos_b);
+        __csa256(&eights_b, &fours, fours, fours_a, fours_b);
+        __csa256(&sixteens, &eights, eights, eights_a, eights_b);
+        total = _mm256_add_epi64(total, __popcount256(sixteens));
+    }
+    total = _mm256_slli_epi64(total, 4);
+    total = _mm256_add_epi64(total, _mm256_slli_epi64(__popcount256(eights), 3));
+    total = _mm256_add_epi64(total, _mm256_slli_epi64(__popcount256(fours), 2));
+    total = _mm256_add_epi64(total, _mm256_slli_epi64(__popcount256(twos), 1));
+    total = _mm256_add_epi64(total, __popcount256(ones));
+    for (; i < vectors; ++i) {
+        total = _mm256_add_epi64(total, __popcount256(_mm256_loadu_si256(data + i)));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, total);
+    uint64_t res = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    for (i = vectors * 4; i < words; ++i) {
+        res += __builtin_popcountll(__load_word(bytes, i));
+    }
+    return res;
+}
+
+__attribute__((target("avx2,popcnt")))
+static void __popcount_pair_avx2(const unsigned char *a, const unsigned char *b, uint64_t words, uint64_t *counts) {
+    const __m256i *va = (const __m256i*)a, *vb = (const __m256i*)b;
+    uint64_t i, vectors = words / 4;
+    __m256i ta = _mm256_setzero_si256(), tb = _mm256_setzero_si256(), tab = _mm256_setzero_si256();
+    for (i = 0; i < vectors; ++i) {
+        __m256i x = _mm256_loadu_si256(va + i), y = _mm256_loadu_si256(vb + i);
+        ta = _mm256_add_epi64(ta, __popcount256(x));
+        tb = _mm256_add_epi64(tb, __popcount256(y));
+        tab = _mm256_add_epi64(tab, __popcount256(_mm256_and_si256(x, y)));
+    }
+    uint64_t la[4], lb[4], lab[4];
+    _mm256_storeu_si256((__m256i*)la, ta);
+    _mm256_storeu_si256((__m256i*)lb, tb);
+    _mm256_storeu_si256((__m256i*)lab, tab);
+    counts[0] = la[0] + la[1] + la[2] + la[3];
+    counts[1] = lb[0] + lb[1] + lb[2] + lb[3];
+    counts[2] = lab[0] + lab[1] + lab[2] + lab[3];
+    for (i = vectors * 4; i < words; ++i) {
+        uint64_t x = __load_word(a, i), y = __load_word(b, i);
+        counts[0] += __builtin_popcountll(x);
+        counts[1] += __builtin_popcountll(y);
+        counts[2] += __builtin_popcountll(x & y);
+    }
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static uint64_t __popcount_avx512(const unsigned char *bytes, uint64_t words) {
+    const uint64_t *data = (const uint64_t*)bytes;
+    __m512i total = _mm512_setzero_si512();
+    uint64_t i;
+    for (i = 0; i + 8 <= words; i += 8) {
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(_mm512_loadu_si512((const void*)(data + i))));
+    }
+    if (i < words) {
+        __mmask8 mask = (__mmask8)((1U << (words - i)) - 1);
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(_mm512_maskz_loadu_epi64(mask, data + i)));
+    }
+    uint64_t lanes[8];
+    _mm512_storeu_si512((void*)lanes, total);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7];
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static void __popcount_pair_avx512(const unsigned char *a, const unsigned char *b, uint64_t words, uint64_t *counts) {
+    const uint64_t *da = (const uint64_t*)a, *db = (const uint64_t*)b;
+    __m512i ta = _mm512_setzero_si512(), tb = _mm512_setzero_si512(), tab = _mm512_setzero_si512();
+    uint64_t i, j;
+    for (i = 0; i < words; i += 8) {
+        __mmask8 mask = (words - i >= 8) ? (__mmask8)0xff : (__mmask8)((1U << (words - i)) - 1);
+        __m512i x = _mm512_maskz_loadu_epi64(mask, da + i), y = _mm512_maskz_loadu_epi64(mask, db + i);
+        ta = _mm512_add_epi64(ta, _mm512_popcnt_epi64(x));
+        tb = _mm512_add_epi64(tb, _mm512_popcnt_epi64(y));
+        tab = _mm512_add_epi64(tab, _mm512_popcnt_epi64(_mm512_and_si512(x, y)));
+    }
+    uint64_t la[8], lb[8], lab[8];
+    _mm512_storeu_si512((void*)la, ta);
+    _mm512_storeu_si512((void*)lb, tb);
+    _mm512_storeu_si512((void*)lab, tab);
+    counts[0] = counts[1] = counts[2] = 0;
+    for (j = 0; j < 8; ++j) {
+        counts[0] += la[j];
+        counts[1] += lb[j];
+        counts[2] += lab[j];
+    }
+}
+
+__attribute__((target("avx2")))
+static void __and_rows_avx2(uint64_t *out, const uint64_t * const *rows, unsigned int number_rows, uint64_t first, uint64_t words) {
+    uint64_t i, vectors = words / 4;
+    unsigned int r;
+    for (i = 0; i < vectors; ++i) {
+        __m256i acc = _mm256_loadu_si256((const __m256i*)(rows[0] + first) + i);
+        for (r = 1; r < number_rows; ++r) {
+            acc = _mm256_and_si256(acc, _mm256_loadu_si256((const __m256i*)(rows[r] + first) + i));
+        }
+        _mm256_storeu_si256((__m256i*)out + i, acc);
+    }
+    for (i = vectors * 4; i < words; ++i) {
+        out[i] = rows[0][first + i];
+        for (r = 1; r < number_rows; ++r) {
+            out[i] &= rows[r][first + i];
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+static void __and_rows_avx512(uint64_t *out, const uint64_t * const *rows, unsigned int number_rows, uint64_t first, uint64_t words) {
+    uint64_t i;
+    unsigned int r;
+    for (i = 0; i < words; i += 8) {
+        __mmask8 mask = (words - i >= 8) ? (__mmask8)0xff : (__mmask8)((1U << (words - i)) - 1);
+        __m512i acc = _mm512_maskz_loadu_epi64(mask, rows[0] + first + i);
+        for (r = 1; r < number_rows; ++r) {
+            acc = _mm512_and_si512(acc, _mm512_maskz_loadu_epi64(mask, rows[r] + first + i));
+        }
+        _mm512_mask_storeu_epi64(out + i, mask, acc);
+    }
+}
+#endif
+
+static BloomPopcountKernel __popcount_detect(void) {
+#if defined(BLOOM_X86_DISPATCH)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512vpopcntdq")) {
+        return BLOOM_POPCOUNT_AVX512;
+    } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        return BLOOM_POPCOUNT_AVX2;
+    } else if (__builtin_cpu_supports("popcnt")) {
+        return BLOOM_POPCOUNT_POPCNT;
+    }
+#endif
+    return BLOOM_POPCOUNT_PORTABLE;
+}
+
+/* NULL if the kernel is not available on this CPU or build */
+static BloomPopcountFunction __popcount_function(BloomPopcountKernel kernel) {
+    switch (kernel) {
+        case BLOOM_POPCOUNT_PORTABLE:
+            return __popcount_portable;
+#if defined(BLOOM_X86_DISPATCH)
+        case BLOOM_POPCOUNT_POPCNT:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("popcnt") ? __popcount_popcnt : NULL;
+        case BLOOM_POPCOUNT_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt") ? __popcount_avx2 : NULL;
+        case BLOOM_POPCOUNT_AVX512:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx512vpopcntdq") ? __popcount_avx512 : NULL;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+/* the pair kernel matching each popcount kernel */
+static BloomPopcountPairFunction __popcount_pair_function(BloomPopcountKernel kernel) {
+    switch (kernel) {
+#if defined(BLOOM_X86_DISPATCH)
+        case BLOOM_POPCOUNT_POPCNT:
+            return __popcount_pair_popcnt;
+        case BLOOM_POPCOUNT_AVX2:
+            return __popcount_pair_avx2;
+        case BLOOM_POPCOUNT_AVX512:
+            return __popcount_pair_avx512;
+#endif
+        default:
+            return __popcount_pair_portable;
+    }
+}
+
+/* the row AND kernel of the same vector width as each popcount kernel */
+static BloomAndRowsFunction __and_rows_function(BloomPopcountKernel kernel) {
+    switch (kernel) {
+#if defined(BLOOM_X86_DISPATCH)
+        case BLOOM_POPCOUNT_AVX2:
+            return __and_rows_avx2;
+        case BLOOM_POPCOUNT_AVX512:
+            return __and_rows_avx512;
+#endif
+        default:
+            return __and_rows_portable;
+    }
+}
+
+static void __and_rows(uint64_t *out, const uint64_t * const *rows, unsigned int number_rows, uint64_t first, uint64_t words) {
+    if (and_rows_function == NULL) {
+        bloom_filter_set_popcount_kernel(BLOOM_POPCOUNT_AUTO);
+    }
+    and_rows_function(out, rows, number_rows, first, words);
+}
+
+static uint64_t __popcount_words(const unsigned char *bytes, uint64_t words) {
+    if (popcount_function == NULL) {
+        bloom_filter_set_popcount_kernel(BLOOM_POPCOUNT_AUTO);
+    }
+    return popcount_function(bytes, words);
+}
+
+static void __popcount_pair_words(const unsigned char *a, const unsigned char *b, uint64_t words, uint64_t *counts) {
+    if (popcount_pair_function == NULL) {
+        bloom_filter_set_popcount_kernel(BLOOM_POPCOUNT_AUTO);
+    }
+    popcount_pair_function(a, b, words, counts);
+}
+
+/*  The fewest blocks whose false positive rate, using the best number of hashes, is
+    low enough. Starting at the size of a standard bloom filter the size is doubled
+    (from a 25% step) until it is large enough and then bisected; the rate falls as
+    blocks are added. Fails if a rate could not be calculated (returned as 1.0), as
+    the search would otherwise never end. */
+static int __blocked_calculate_optimal_size(BlockedBloomFilter *bf) {
+    uint64_t n = bf->estimated_elements;
+    double p = bf->false_positive_probability;
+    uint64_t m = ceil((-(double)n * log(p)) / LOG_TWO_SQUARED);
+    uint64_t blocks = (m + BLOOM_BLOCK_BITS - 1) / BLOOM_BLOCK_BITS;
+    unsigned int k = 1, hi_k = 1;
+    double fpr = __blocked_best_hashes(n, blocks, &k);
+    if (fpr >= 1.0) {
+        return BLOOM_FAILURE;
+    } else if (fpr > p) {
+        uint64_t lo = blocks, step = blocks / 4 + 1, hi = blocks + step;
+        while ((fpr = __blocked_best_hashes(n, hi, &hi_k)) > p) {
+            if (fpr >= 1.0) {
+                return BLOOM_FAILURE;
+            }
+            lo = hi;
+            step *= 2;
+            hi += step;
+        }
+        while (hi - lo > 1) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            fpr = __blocked_best_hashes(n, mid, &k);
+            if (fpr >= 1.0) {
+                return BLOOM_FAILURE;
+            } else if (fpr > p) {
+                lo = mid;
+            } else {
+                hi = mid;
+                hi_k = k;
+            }
+        }
+        blocks = hi;
+        k = hi_k;
+    }
+    bf->number_hashes = k;
+    bf->number_blocks = blocks;
+    bf->number_bits = blocks * BLOOM_BLOCK_BITS;
+    return BLOOM_SUCCESS;
+}
+
+/* the lowest false positive rate of n elements in the blocks and the hashes giving it */
+static double __blocked_best_hashes(uint64_t n, uint64_t blocks, unsigned int *number_hashes) {
+    unsigned int max_k = (unsigned int)ceil(LOG_TWO * (double)blocks * BLOOM_BLOCK_BITS / n) + 1;
+    double best = 2.0;
+    for (unsigned int i = 1; i <= max_k; ++i) {
+        double fpr = blocked_bloom_filter_false_positive_rate(n, blocks, i);
+        if (fpr < best) {
+            best = fpr;
+            *number_hashes = i;
+        }
+    }
+    return best;
+}
+
+static double __poisson_pmf(double j, double lambda) {
+    if (lambda == 0) {
+        return j == 0 ? 1.0 : 0.0;
+    }
+    return exp(j * log(lambda) - lambda - lgamma(j + 1));  // log space so large means do not underflow
+}
+
+static int __blocked_alloc(BlockedBloomFilter *bf) {
+    bf->bloom = (uint64_t*)__aligned_calloc(__blocked_bytes(bf));
+    if (bf->bloom == NULL) {
+        return BLOOM_FAILURE;
+    }
+    bf->elements_added = 0;
+    return BLOOM_SUCCESS;
+}
+
+static uint64_t __blocked_bytes(BlockedBloomFilter *bf) {
+    return bf->number_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t);
+}
+
+/*  The high bits of the hash pick the block; remixes of it supply 9 bits per hash
+    for the bit positions within the 512 bit block */
+static int __blocked_add(BlockedBloomFilter *bf, uint64_t hash) {
+    uint64_t *block = bf->bloom + __mulhi64(hash, bf->number_blocks) * BLOOM_BLOCK_WORDS;
+    uint64_t g = 0;
+    for (unsigned int i = 0; i < bf->number_hashes; ++i) {
+        if (i % BLOOM_BLOCK_HASHES_PER_MIX == 0) {
+            g = __fmix64(hash + (i / BLOOM_BLOCK_HASHES_PER_MIX + 1) * 0x9E3779B97F4A7C15ULL);
+        }
+        unsigned int bit = g & (BLOOM_BLOCK_BITS - 1);
+        g >>= 9;
+        #pragma omp atomic update
+        block[bit / 64] |= (1ULL << (bit % 64));
+    }
+    #pragma omp atomic update
+    bf->elements_added++;
+    return BLOOM_SUCCESS;
+}
+
+static int __blocked_check(BlockedBloomFilter *bf, uint64_t hash) {
+    const uint64_t *block = bf->bloom + __mulhi64(hash, bf->number_blocks) * BLOOM_BLOCK_WORDS;
+    uint64_t g = 0;
+    for (unsigned int i = 0; i < bf->number_hashes; ++i) {
+        if (i % BLOOM_BLOCK_HASHES_PER_MIX == 0) {
+            g = __fmix64(hash + (i / BLOOM_BLOCK_HASHES_PER_MIX + 1) * 0x9E3779B97F4A7C15ULL);
+        }
+        unsigned int bit = g & (BLOOM_BLOCK_BITS - 1);
+        g >>= 9;
+        if ((block[bit / 64] & (1ULL << (bit % 64))) == 0) {
+            return BLOOM_FAILURE;
+        }
+    }
+    return BLOOM_SUCCESS;
+}
+
+/* Parquet split block bloom filter salts */
+static const uint32_t sbbf_salts[SBBF_BLOCK_WORDS] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU, 0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+static int __sbbf_alloc(SplitBlockBloomFilter *bf, uint64_t number_bytes) {
+    bf->bloom = (uint32_t*)__aligned_calloc(number_bytes);
+    if (bf->bloom == NULL) {
+        return BLOOM_FAILURE;
+    }
+    bf->number_bytes = number_bytes;
+    bf->number_blocks = number_bytes / SBBF_BLOCK_BYTES;
+    bf->elements_added = 0;
+    return BLOOM_SUCCESS;
+}
+
+/* invert the expected fill of a word: set bits = 32 * (1 - (31/32)^(n / blocks)) */
+static uint64_t __sbbf_estimate_elements(SplitBlockBloomFilter *bf) {
+    double fill = (double)split_block_bloom_filter_count_set_bits(bf) / (bf->number_bytes * 8);
+    return (fill >= 1.0) ? UINT64_MAX : (uint64_t)(log(1.0 - fill) / log(1.0 - 1.0 / 32) * bf->number_blocks);
+}
+
+/* the upper 32 bits of the hash select the block (Parquet) */
+static uint32_t* __sbbf_block(SplitBlockBloomFilter *bf, uint64_t hash) {
+    return bf->bloom + (((hash >> 32) * bf->number_blocks) >> 32) * SBBF_BLOCK_WORDS;
+}
+
+static __inline__ void __sbbf_insert(uint32_t *block, uint32_t key) {
+    if (sbbf_insert_function == NULL) {
+        bloom_filter_set_popcount_kernel(BLOOM_POPCOUNT_AUTO);
+    }
+    sbbf_insert_function(block, key);
+}
+
+static __inline__ int __sbbf_check(const uint32_t *block, uint32_t key) {
+    if (sbbf_check_function == NULL) {
+        bloom_filter_set_popcount_kernel(BLOOM_POPCOUNT_AUTO);
+    }
+    return sbbf_check_function(block, key);
+}
+
+static void __sbbf_insert_portable(uint32_t *block, uint32_t key) {
+    for (int i = 0; i < SBBF_BLOCK_WORDS; ++i) {
+        #pragma omp atomic update
+        block[i] |= 1U << ((key * sbbf_salts[i]) >> 27);
+    }
+}
+
+static int __sbbf_check_portable(const uint32_t *block, uint32_t key) {
+    for (int i = 0; i < SBBF_BLOCK_WORDS; ++i) {
+        if ((block[i] & (1U << ((key * sbbf_salts[i]) >> 27))) == 0) {
+            return BLOOM_FAILURE;
+        }
+    }
+    return BLOOM_SUCCESS;
+}
+
+/*  Word i gets bit (key * salt[i]) >> 27. SSE has no variable shift so 1 << s is
+    made by building the float 2^s and converting it back to an integer. */
+#if defined(BLOOM_X86_DISPATCH)
+__attribute__((target("avx2")))
+static __inline__ __m256i __sbbf_mask_avx2(uint32_t key) {
+    __m256i salts = _mm256_loadu_si256((const __m256i*)sbbf_salts);
+    __m256i bits = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32((int)key), salts), 27);
+    return _mm256_sllv_epi32(_mm256_set1_epi32(1), bits);
+}
+
+#if !defined(_OPENMP)
+__attribute__((target("avx2")))
+static void __sbbf_insert_avx2(uint32_t *block, uint32_t key) {
+    __m256i *vec = (__m256i*)block;
+    _mm256_store_si256(vec, _mm256_or_si256(_mm256_load_si256(vec), __sbbf_mask_avx2(key)));
+}
+#endif
+
+__attribute__((target("avx2")))
+static int __sbbf_check_avx2(const uint32_t *block, uint32_t key) {
+    return _mm256_testc_si256(_mm256_load_si256((const __m256i*)block), __sbbf_mask_avx2(key)) ? BLOOM_SUCCESS : BLOOM_FAILURE;
+}
+
+__attribute__((target("sse4.1")))
+static __inline__ __m128i __sbbf_mask_sse41(uint32_t key, int half) {
+    __m128i salts = _mm_loadu_si128((const __m128i*)(sbbf_salts + 4 * half));
+    __m128i bits = _mm_srli_epi32(_mm_mullo_epi32(_mm_set1_epi32((int)key), salts), 27);
+    __m128i exponent = _mm_add_epi32(_mm_slli_epi32(bits, 23), _mm_set1_epi32(0x3f800000));
+    return _mm_cvttps_epi32(_mm_castsi128_ps(exponent));
+}
+
+#if !defined(_OPENMP)
+__attribute__((target("sse4.1")))
+static void __sbbf_insert_sse41(uint32_t *block, uint32_t key) {
+    __m128i *vec = (__m128i*)block;
+    _mm_store_si128(vec, _mm_or_si128(_mm_load_si128(vec), __sbbf_mask_sse41(key, 0)));
+    _mm_store_si128(vec + 1, _mm_or_si128(_mm_load_si128(vec + 1), __sbbf_mask_sse41(key, 1)));
+}
+#endif
+
+__attribute__((target("sse4.1")))
+static int __sbbf_check_sse41(const uint32_t *block, uint32_t key) {
+    const __m128i *vec = (const __m128i*)block;
+    int set = _mm_testc_si128(_mm_load_si128(vec), __sbbf_mask_sse41(key, 0)) & _mm_testc_si128(_mm_load_si128(vec + 1), __sbbf_mask_sse41(key, 1));
+    return set ? BLOOM_SUCCESS : BLOOM_FAILURE;
+}
+#endif
+
+/*  The block kernel of the same vector width as each popcount kernel; the popcnt
+    kernel pairs with SSE4.1 when the CPU has it. With OpenMP the words are updated
+    atomically, so inserts always use the scalar version. */
+static BloomSbbfInsertFunction __sbbf_insert_function(BloomPopcountKernel kernel) {
+    switch (kernel) {
+#if defined(BLOOM_X86_DISPATCH) && !defined(_OPENMP)
+        case BLOOM_POPCOUNT_POPCNT:
+            return __builtin_cpu_supports("sse4.1") ? __sbbf_insert_sse41 : __sbbf_insert_portable;
+        case BLOOM_POPCOUNT_AVX2:
+        case BLOOM_POPCOUNT_AVX512:
+            return __sbbf_insert_avx2;
+#endif
+        default:
+            return __sbbf_insert_portable;
+    }
+}
+
+static BloomSbbfCheckFunction __sbbf_check_function(BloomPopcountKernel kernel) {
+    switch (kernel) {
+#if defined(BLOOM_X86_DISPATCH)
+        case BLOOM_POPCOUNT_POPCNT:
+            return __builtin_cpu_supports("sse4.1") ? __sbbf_check_sse41 : __sbbf_check_portable;
+        case BLOOM_POPCOUNT_AVX2:
+        case BLOOM_POPCOUNT_AVX512:
+            return __sbbf_check_avx2;
+#endif
+        default:
+            return __sbbf_check_portable;
+    }
+}
+
+/* the Parquet bitset is little endian 32 bit words; dst and src may be the same */
+static void __sbbf_copy_le(void *dst, const void *src, uint64_t number_bytes) {
+    if (dst != src) {
+        memcpy(dst, src, number_bytes);
+    }
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    uint32_t *words = (uint32_t*)dst;
+    for (uint64_t i = 0; i < number_bytes / sizeof(uint32_t); ++i) {
+        words[i] = __builtin_bswap32(words[i]);
+    }
+#endif
+}
+
+/* NOTE: this assumes that the file handler is open and ready to use */
+static void __write_to_file(BloomFilter *bf, FILE *fp, short on_disk) {
+    if (on_disk == 0) {
+        fwrite(bf->bloom, bf->bloom_length, 1, fp);
+    } else {
+        // will need to write out everything by hand
+        uint64_t i;
+        for (i = 0; i < bf->bloom_length; ++i) {
+            fputc(0, fp);
+        }
+    }
+    if (__has_options(bf)) {
+        uint32_t options[2] = {__get_options(bf), BLOOM_EXT_MAGIC};
+        fwrite(options, sizeof(uint32_t), 2, fp);
+    }
+    fwrite(&bf->estimated_elements, sizeof(uint64_t), 1, fp);
+    uint64_t elements_added = bloom_filter_elements_added(bf);
+    fwrite(&elements_added, sizeof(uint64_t), 1, fp);
+    fwrite(&bf->false_positive_probability, sizeof(float), 1, fp);
+}
+
+/* NOTE: this assumes that the file handler is open and ready to use */
+static void __read_from_file(BloomFilter *bf, FILE *fp, short on_disk, const char *filename) {
+    int offset = BLOOM_TRAILER_SIZE;
+    fseek(fp, offset * -1, SEEK_END);
+
+    fread(&bf->estimated_elements, sizeof(uint64_t), 1, fp);
+    fread(&bf->elements_added, sizeof(uint64_t), 1, fp);
+    fread(&bf->false_positive_probability, sizeof(float), 1, fp);
+
+    // determine if there is an options block before the trailer
+    bf->hash_type = BLOOM_HASH_FNV1A;
+    bf->index_mapping = BLOOM_INDEX_MODULO;
+    long filesize = ftell(fp);
+    if (filesize >= (long)(BLOOM_TRAILER_SIZE + BLOOM_EXT_SIZE)) {
+        uint32_t options[2] = {0, 0};
+        fseek(fp, (long)(BLOOM_TRAILER_SIZE + BLOOM_EXT_SIZE) * -1, SEEK_END);
+        if (fread(options, sizeof(uint32_t), 2, fp) == 2 && options[1] == BLOOM_EXT_MAGIC) {
+            BloomFilter tmp = *bf;
+            if (__set_options(&tmp, options[0]) == BLOOM_SUCCESS) {
+                __calculate_optimal_hashes(&tmp);
+                if ((long)(tmp.bloom_length + BLOOM_TRAILER_SIZE + BLOOM_EXT_SIZE) == filesize) {
+                    bf->hash_type = tmp.hash_type;
+                    bf->index_mapping = tmp.index_mapping;
+                }
+            }
+        }
+    }
+    __calculate_optimal_hashes(bf);
+    rewind(fp);
+    if(on_disk == 0) {
+        bf->bloom = __alloc_bloom(bf);
+        size_t read;
+        read = fread(bf->bloom, sizeof(char), bf->bloom_length, fp);
+        if (read != bf->bloom_length) {
+            perror("__read_from_file: ");
+            exit(1);
+        }
+    } else {
+        struct stat buf;
+        int fd = open(filename, O_RDWR);
+        if (fd < 0) {
+            perror("open: ");
+            exit(1);
+        }
+        fstat(fd, &buf);
+        bf->__filesize = buf.st_size;
+        bf->bloom = (unsigned char*)mmap((caddr_t)0, bf->__filesize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (bf->bloom == (unsigned char*) - 1) {
+            perror("mmap: ");
+            exit(1);
+        }
+        // close the file descriptor
+        close(fd);
+    }
+}
+
+static void __update_elements_added_on_disk(BloomFilter* bf) {
+    if (bf->__is_on_disk == 1) { // only do this if it is on disk!
+        // the whole file is mapped and the trailer is always last; no syscall needed
+        int offset = sizeof(uint64_t) + sizeof(float);
+        uint64_t elements_added = __atomic_load_n(&bf->elements_added, __ATOMIC_RELAXED);
+        memcpy(bf->bloom + bf->__filesize - offset, &elements_added, sizeof(uint64_t));
+    }
+}
+
+/* NOTE: The caller will free the results */
+static uint64_t* __default_hash(int num_hashes, const char *str) {
+    uint64_t *results = (uint64_t*)calloc(num_hashes, sizeof(uint64_t));
+    __default_hash_noalloc(num_hashes, str, results);
+    return results;
+}
+
+static void __default_hash_noalloc(int num_hashes, const char *str, uint64_t *results) {
+    __default_hash_bytes(num_hashes, str, strlen(str), results);
+}
+
+static void __default_hash_bytes(int num_hashes, const void *key, size_t len, uint64_t *results) {
+    int i;
+    for (i = 0; i < num_hashes; ++i) {
+        results[i] = __fnv_1a_bytes((const unsigned char*)key, len, i);
+    }
+}
+
+static uint64_t __fnv_1a_bytes(const unsigned char *key, size_t len, int seed) {
+    // FNV-1a hash (http://www.isthe.com/chongo/tech/comp/fnv/)
+    size_t i;
+    uint64_t h = FNV_OFFSET + (31 * seed); // FNV_OFFSET 64 bit with magic number seed
+    for (i = 0; i < len; ++i){
+            h = h ^ key[i];
+            h = h * FNV_PRIME; // FNV_PRIME 64 bit
+    }
+    return h;
+}
+
+/*  Kirsch-Mitzenmacher double hashing: two FNV-1a lanes are calculated in a single
+    pass over the key and every hash is derived as h1 + i * h2
+    (https://www.eecs.harvard.edu/~michaelm/postscripts/rsa2008.pdf) */
+static void __double_fnv_1a_hash(int num_hashes, const char *str, uint64_t *results) {
+    const unsigned char *key = (const unsigned char*)str;
+    uint64_t h1 = FNV_OFFSET, h2 = FNV_OFFSET ^ 0x9E3779B97F4A7C15ULL;
+    for (; *key != '\0'; ++key) {  // no need to find the length first
+        h1 = (h1 ^ *key) * FNV_PRIME;
+        h2 = (h2 ^ *key) * FNV_PRIME;
+    }
+    __double_hash_finalize(h1, h2, num_hashes, results);
+}
+
+static void __double_fnv_1a_hash_bytes(int num_hashes, const void *key, size_t len, uint64_t *results) {
+    const unsigned char *k = (const unsigned char*)key;
+    uint64_t h1 = FNV_OFFSET, h2 = FNV_OFFSET ^ 0x9E3779B97F4A7C15ULL;
+    size_t i;
+    for (i = 0; i < len; ++i) {
+        h1 = (h1 ^ k[i]) * FNV_PRIME;
+        h2 = (h2 ^ k[i]) * FNV_PRIME;
+    }
+    __double_hash_finalize(h1, h2, num_hashes, results);
+}
+
+static void __double_hash_finalize(uint64_t h1, uint64_t h2, int num_hashes, uint64_t *results) {
+    // FNV-1a has weak low bits; finalize both lanes. Keep h2 odd so it never degenerates
+    h1 = __fmix64(h1);
+    h2 = __fmix64(h2) | 1;
+    int i;
+    for (i = 0; i < num_hashes; ++i) {
+        results[i] = h1 + (uint64_t)i * h2;
+    }
+}
+
+static void __xxh64_hash_bytes(int num_hashes, const void *key, size_t len, uint64_t *results) {
+    __double_hash_from_64(__xxh64(key, len, 0), num_hashes, results);
+}
+
+/* both halves of the 128 bit hash are used as the double hashing bases */
+static void __murmur3_hash_bytes(int num_hashes, const void *key, size_t len, uint64_t *results) {
+    uint64_t h1, h2;
+    __murmur3_128(key, len, 0, &h1, &h2);
+    h2 |= 1;
+    int i;
+    for (i = 0; i < num_hashes; ++i) {
+        results[i] = h1 + (uint64_t)i * h2;
+    }
+}
+
+/*  XXH64 produces a single well mixed 64 bit value; the second double hashing
+    base is derived from it so the key is still only read once */
+static void __double_hash_from_64(uint64_t h, int num_hashes, uint64_t *results) {
+    uint64_t h2 = __fmix64(h ^ 0x9E3779B97F4A7C15ULL) | 1;
+    int i;
+    for (i = 0; i < num_hashes; ++i) {
+        results[i] = h + (uint64_t)i * h2;
+    }
+}
+
+/* XXH64 (https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md) */
+#define XXH_PRIME64_1 11400714785074694791ULL
+#define XXH_PRIME64_2 14029467366897019727ULL
+#define XXH_PRIME64_3 1609587929392839161ULL
+#define XXH_PRIME64_4 9650029242287828579ULL
+#define XXH_PRIME64_5 2870177450012600261ULL
+
+static __inline__ uint64_t __xxh64_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    acc = __rotl64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+static __inline__ uint64_t __xxh64_merge_round(uint64_t acc, uint64_t val) {
+    acc ^= __xxh64_round(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+static uint64_t __xxh64(const void *key, size_t len, uint64_t seed) {
+    const unsigned char *p = (const unsigned char*)key;
+    const unsigned char *end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        const unsigned char *limit = end - 32;
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = seed + XXH_PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME64_1;
+        do {
+            v1 = __xxh64_round(v1, __read64(p));
+            v2 = __xxh64_round(v2, __read64(p + 8));
+            v3 = __xxh64_round(v3, __read64(p + 16));
+            v4 = __xxh64_round(v4, __read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = __rotl64(v1, 1) + __rotl64(v2, 7) + __rotl64(v3, 12) + __rotl64(v4, 18);
+        h = __xxh64_merge_round(h, v1);
+        h = __xxh64_merge_round(h, v2);
+        h = __xxh64_merge_round(h, v3);
+        h = __xxh64_merge_round(h, v4);
+    } else {
+        h = seed + XXH_PRIME64_5;
+    }
+    h += (uint64_t)len;
+
+    while (p + 8 <= end) {
+        h ^= __xxh64_round(0, __read64(p));
+        h = __rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= __read32(p) * XXH_PRIME64_1;
+        h = __rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p) * XXH_PRIME64_5;
+        h = __rotl64(h, 11) * XXH_PRIME64_1;
+        ++p;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+/* MurmurHash3 x64 128 (https://github.com/aappleby/smhasher) */
+#define MURMUR3_C1 0x87c37b91114253d5ULL
+#define MURMUR3_C2 0x4cf5ad432745937fULL
+
+static void __murmur3_128(const void *key, size_t len, uint64_t seed, uint64_t *out1, uint64_t *out2) {
+    const unsigned char *p = (const unsigned char*)key;
+    size_t i, nblocks = len / 16;
+    uint64_t h1 = seed, h2 = seed, k1, k2;
+
+    for (i = 0; i < nblocks; ++i, p += 16) {
+        k1 = __read64(p);
+        k2 = __read64(p + 8);
+        k1 *= MURMUR3_C1; k1 = __rotl64(k1, 31); k1 *= MURMUR3_C2; h1 ^= k1;
+        h1 = __rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+        k2 *= MURMUR3_C2; k2 = __rotl64(k2, 33); k2 *= MURMUR3_C1; h2 ^= k2;
+        h2 = __rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    size_t tail = len & 15;
+    k1 = k2 = 0;
+    for (i = tail; i > 8; --i) {
+        k2 ^= ((uint64_t)p[i - 1]) << ((i - 9) * 8);
+    }
+    if (tail > 8) {
+        k2 *= MURMUR3_C2; k2 = __rotl64(k2, 33); k2 *= MURMUR3_C1; h2 ^= k2;
+    }
+    for (i = (tail > 8 ? 8 : tail); i > 0; --i) {
+        k1 ^= ((uint64_t)p[i - 1]) << ((i - 1) * 8);
+    }
+    if (tail > 0) {
+        k1 *= MURMUR3_C1; k1 = __rotl64(k1, 31); k1 *= MURMUR3_C2; h1 ^= k1;
+    }
+
+    h1 ^= (uint64_t)len;
+    h2 ^= (uint64_t)len;
+    h1 += h2;
+    h2 += h1;
+    h1 = __fmix64(h1);
+    h2 = __fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+    *out1 = h1;
+    *out2 = h2;
+}
+
+/* little endian reads that do not require aligned keys */
+static __inline__ uint64_t __read64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static __inline__ uint64_t __read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+static __inline__ uint64_t __rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+/* high 64 bits of the 128 bit product */
+static __inline__ uint64_t __mulhi64(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+    __extension__ typedef unsigned __int128 uint128;
+    return (uint64_t)(((uint128)a * b) >> 64);
+#else
+    uint64_t a_lo = (uint32_t)a, a_hi = a >> 32, b_lo = (uint32_t)b, b_hi = b >> 32;
+    uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo, lo_hi = a_lo * b_hi;
+    uint64_t cross = (lo_lo >> 32) + (uint32_t)hi_lo + lo_hi;
+    return a_hi * b_hi + (hi_lo >> 32) + (cross >> 32);
+#endif
+}
+
+/*  Integer keys are mixed directly into the two double hashing bases; the 0 key
+    is offset so that it does not map to the fixed point of the finalizer */
+static void __hash_u64(uint64_t key, uint64_t *h1, uint64_t *h2) {
+    *h1 = __fmix64(key + 0x9E3779B97F4A7C15ULL);
+    *h2 = __fmix64(key + 0xC2B2AE3D27D4EB4FULL) | 1;
+}
+
+static void __hash_u128(uint64_t high, uint64_t low, uint64_t *h1, uint64_t *h2) {
+    *h1 = __fmix64(low ^ __fmix64(high + 0x9E3779B97F4A7C15ULL));
+    *h2 = __fmix64(high ^ __fmix64(low + 0xC2B2AE3D27D4EB4FULL)) | 1;
+}
+
+/* MurmurHash3 64 bit finalizer (https://github.com/aappleby/smhasher) */
+static uint64_t __fmix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/*  The indexes keep the parameters and hash functions of a filter without its bit
+    array so that keys are hashed and mapped by the filter code */
+static void __copy_params(BloomFilter *params, BloomFilter *like) {
+    memset(params, 0, sizeof(BloomFilter));
+    params->estimated_elements = like->estimated_elements;
+    params->false_positive_probability = like->false_positive_probability;
+    params->number_hashes = like->number_hashes;
+    params->number_bits = like->number_bits;
+    params->bloom_length = like->bloom_length;
+    params->hash_function = like->hash_function;
+    params->hash_function_noalloc = like->hash_function_noalloc;
+    params->hash_function_bytes = like->hash_function_bytes;
+    params->hash_type = like->hash_type;
+    params->index_mapping = like->index_mapping;
+}
+
+/*  Rows of up to a cache line are a power of 2 words so that none straddles two
+    lines; longer rows are whole cache lines */
+static uint64_t __bsi_row_words(uint64_t capacity) {
+    uint64_t words = capacity == 0 ? 1 : (capacity + 63) / 64;
+    uint64_t line = BLOOM_CACHE_LINE / sizeof(uint64_t);
+    if (words > line) {
+        return (words + line - 1) / line * line;
+    }
+    uint64_t pow2 = 1;
+    while (pow2 < words) {
+        pow2 <<= 1;
+    }
+    return pow2;
+}
+
+static uint64_t __bsi_rows_bytes(BitSlicedBloomIndex *idx, uint64_t row_words) {
+    return idx->params.number_bits * row_words * sizeof(uint64_t);
+}
+
+/*  Widen the rows, at least doubling them, when there is no room for number_filters.
+    In memory the rows are copied into a new array; on disk the file is extended and
+    the rows moved out in place, last row first so none is overwritten. */
+static int __bsi_reserve(BitSlicedBloomIndex *idx, uint64_t number_filters) {
+    uint64_t old_words = idx->row_words;
+    if (number_filters <= old_words * 64) {
+        return BLOOM_SUCCESS;
+    }
+    uint64_t r, row_words = __bsi_row_words(number_filters > old_words * 128 ? number_filters : old_words * 128);
+    uint64_t bytes = __bsi_rows_bytes(idx, row_words);
+    if (idx->__is_on_disk == 0) {
+        uint64_t *rows = (uint64_t*)__aligned_calloc(bytes);
+        if (rows == NULL) {
+            return BLOOM_FAILURE;
+        }
+        for (r = 0; r < idx->params.number_bits; ++r) {
+            memcpy(rows + r * row_words, idx->rows + r * old_words, old_words * sizeof(uint64_t));
+        }
+        free(idx->rows);
+        idx->rows = rows;
+        idx->row_words = row_words;
+        return BLOOM_SUCCESS;
+    }
+    munmap((unsigned char*)idx->rows - BLOOM_BSI_HEADER_SIZE, idx->__filesize);
+    idx->rows = NULL;
+    if (ftruncate(fileno(idx->filepointer), (off_t)(BLOOM_BSI_HEADER_SIZE + bytes)) != 0) {
+        perror("ftruncate: ");
+        return BLOOM_FAILURE;
+    }
+    idx->__filesize = BLOOM_BSI_HEADER_SIZE + bytes;
+    if (__bsi_map(idx) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    for (r = idx->params.number_bits; r-- > 0;) {
+        memmove(idx->rows + r * row_words, idx->rows + r * old_words, old_words * sizeof(uint64_t));
+        memset(idx->rows + r * row_words + old_words, 0, (row_words - old_words) * sizeof(uint64_t));
+    }
+    idx->row_words = row_words;
+    __bsi_write_header(idx, (unsigned char*)idx->rows - BLOOM_BSI_HEADER_SIZE);
+    return BLOOM_SUCCESS;
+}
+
+static int __bsi_map(BitSlicedBloomIndex *idx) {
+    unsigned char *mapped = (unsigned char*)mmap((caddr_t)0, idx->__filesize, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(idx->filepointer), 0);
+    if (mapped == (unsigned char*)MAP_FAILED) {
+        perror("mmap: ");
+        idx->rows = NULL;
+        return BLOOM_FAILURE;
+    }
+    idx->rows = (uint64_t*)(mapped + BLOOM_BSI_HEADER_SIZE);
+    return BLOOM_SUCCESS;
+}
+
+/*  header: magic, options, number of hashes, false positive rate (4 bytes each), then
+    the number of bits, estimated elements, number of filters, and row words (8 bytes
+    each), zero padded to BLOOM_BSI_HEADER_SIZE */
+static void __bsi_write_header(BitSlicedBloomIndex *idx, unsigned char *header) {
+    uint32_t magic = BLOOM_BSI_MAGIC, options = __get_options(&idx->params), hashes = idx->params.number_hashes;
+    memset(header, 0, BLOOM_BSI_HEADER_SIZE);
+    memcpy(header, &magic, sizeof(uint32_t));
+    memcpy(header + 4, &options, sizeof(uint32_t));
+    memcpy(header + 8, &hashes, sizeof(uint32_t));
+    memcpy(header + 12, &idx->params.false_positive_probability, sizeof(float));
+    memcpy(header + 16, &idx->params.number_bits, sizeof(uint64_t));
+    memcpy(header + 24, &idx->params.estimated_elements, sizeof(uint64_t));
+    memcpy(header + 32, &idx->number_filters, sizeof(uint64_t));
+    memcpy(header + 40, &idx->row_words, sizeof(uint64_t));
+}
+
+static int __bsi_read_header(BitSlicedBloomIndex *idx, const unsigned char *header) {
+    uint32_t magic, options, hashes;
+    memcpy(&magic, header, sizeof(uint32_t));
+    memcpy(&options, header + 4, sizeof(uint32_t));
+    memcpy(&hashes, header + 8, sizeof(uint32_t));
+    memset(&idx->params, 0, sizeof(BloomFilter));
+    if (magic != BLOOM_BSI_MAGIC || __set_options(&idx->params, options) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    idx->params.number_hashes = hashes;
+    memcpy(&idx->params.false_positive_probability, header + 12, sizeof(float));
+    memcpy(&idx->params.number_bits, header + 16, sizeof(uint64_t));
+    memcpy(&idx->params.estimated_elements, header + 24, sizeof(uint64_t));
+    memcpy(&idx->number_filters, header + 32, sizeof(uint64_t));
+    memcpy(&idx->row_words, header + 40, sizeof(uint64_t));
+    idx->params.bloom_length = (idx->params.number_bits + CHAR_LEN - 1) / CHAR_LEN;
+    bloom_filter_set_hash_function(&idx->params, NULL);
+    if (hashes == 0 || idx->params.number_bits == 0 || idx->number_filters > idx->row_words * 64) {
+        return BLOOM_FAILURE;
+    }
+    return BLOOM_SUCCESS;
+}
+
+/*  Word w of each of the filters forms a 64 x 64 bit block; transposed, word b of
+    the block holds bit b of every filter, which is ORed into row (64 w + b) at
+    the column of the first filter */
+static void __bsi_append_group(BitSlicedBloomIndex *idx, BloomFilter **filters, size_t count) {
+    uint64_t block[BLOOM_BSI_GROUP];
+    uint64_t w, b, words = (idx->params.number_bits + 63) / 64;
+    uint64_t shift = idx->number_filters % 64;
+    uint64_t *column = idx->rows + idx->number_filters / 64;
+    size_t j;
+    for (w = 0; w < words; ++w) {
+        uint64_t any = 0;
+        for (j = 0; j < BLOOM_BSI_GROUP; ++j) {
+            block[j] = (j < count) ? __bsi_filter_word(filters[j], w) : 0;
+            any |= block[j];
+        }
+        if (any == 0) {
+            continue;
+        }
+        __transpose64(block);
+        uint64_t bits = (idx->params.number_bits - w * 64 < 64) ? idx->params.number_bits - w * 64 : 64;
+        for (b = 0; b < bits; ++b) {
+            uint64_t *row = column + (w * 64 + b) * idx->row_words;
+            row[0] |= block[b] << shift;
+            if (shift != 0 && count > 64 - shift) {
+                row[1] |= block[b] >> (64 - shift);
+            }
+        }
+    }
+    idx->number_filters += count;
+}
+
+/* bits 64 w to 64 w + 63 of the filter; the bit array need not be whole words */
+static __inline__ uint64_t __bsi_filter_word(BloomFilter *bf, uint64_t word) {
+    uint64_t i, res = 0, start = word * 8;
+    uint64_t end = (start + 8 < bf->bloom_length) ? start + 8 : bf->bloom_length;
+    for (i = end; i-- > start;) {
+        res = (res << 8) | bf->bloom[i];
+    }
+    return res;
+}
+
+/*  AND the key's rows a block of words at a time and collect the ids of the set bits;
+    the first line of every row is prefetched before any is read */
+static int __bsi_query(BitSlicedBloomIndex *idx, const BloomKey *key, uint64_t *ids, uint64_t *num_ids) {
+    unsigned int i, k = idx->params.number_hashes;
+    const uint64_t *stack_rows[BLOOM_MAX_STACK_HASHES];
+    const uint64_t **rows = (k > BLOOM_MAX_STACK_HASHES) ? (const uint64_t**)calloc(k, sizeof(uint64_t*)) : stack_rows;
+    if (rows == NULL) {
+        return BLOOM_FAILURE;
+    }
+    for (i = 0; i < k; ++i) {
+        rows[i] = idx->rows + __key_bit(&idx->params, key, i) * idx->row_words;
+        BLOOM_PREFETCH(rows[i], 0);
+    }
+    uint64_t block[BLOOM_BSI_BLOCK_WORDS];
+    uint64_t w, j, found = 0, used_words = (idx->number_filters + 63) / 64;
+    for (w = 0; w < used_words; w += BLOOM_BSI_BLOCK_WORDS) {
+        uint64_t words = (used_words - w < BLOOM_BSI_BLOCK_WORDS) ? used_words - w : BLOOM_BSI_BLOCK_WORDS;
+        __and_rows(block, rows, k, w, words);
+        for (j = 0; j < words; ++j) {
+            uint64_t bits = block[j];
+            while (bits != 0) {
+                ids[found++] = (w + j) * 64 + (uint64_t)__builtin_ctzll(bits);
+                bits &= bits - 1;
+            }
+        }
+    }
+    *num_ids = found;
+    if (rows != stack_rows) {
+        free((void*)rows);
+    }
+    return BLOOM_SUCCESS;
+}
+
+/*  Transpose a 64 x 64 bit matrix in place: bit j of word i swaps with bit i of
+    word j (Hacker's Delight 7-3), swapping ever smaller blocks */
+static void __transpose64(uint64_t *block) {
+    uint64_t mask = 0x00000000FFFFFFFFULL;
+    unsigned int j, k;
+    for (j = 32; j != 0; j >>= 1, mask ^= (mask << j)) {
+        for (k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+            uint64_t t = ((block[k] >> j) ^ block[k | j]) & mask;
+            block[k | j] ^= t;
+            block[k] ^= t << j;
+        }
+    }
+}
+
+/*  Lay out the tree and allocate its nodes, or create and map the file of a tree on
+    disk; the file is written through the mapping as it is built */
+static int __tree_create(BloomFilterTree *tree, BloomFilter *like, uint64_t number_leaves, unsigned int fanout, const char *filepath) {
+    __copy_params(&tree->params, like);
+    tree->nodes = NULL;
+    tree->__is_on_disk = 0;
+    tree->__filesize = 0;
+    if (__tree_layout(tree, number_leaves, fanout) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    uint64_t bytes = tree->number_nodes * tree->node_bytes;
+    if (filepath == NULL) {
+        tree->nodes = (unsigned char*)__aligned_calloc(bytes);
+        return tree->nodes == NULL ? BLOOM_FAILURE : BLOOM_SUCCESS;
+    }
+    int fd = open(filepath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Can't open file %s!\n", filepath);
+        return BLOOM_FAILURE;
+    }
+    tree->__filesize = BLOOM_TREE_HEADER_SIZE + bytes;
+    unsigned char *mapped = (unsigned char*)MAP_FAILED;
+    if (ftruncate(fd, (off_t)tree->__filesize) == 0) {
+        mapped = (unsigned char*)mmap((caddr_t)0, tree->__filesize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (mapped == (unsigned char*)MAP_FAILED) {
+        perror("mmap: ");
+        return BLOOM_FAILURE;
+    }
+    __tree_write_header(tree, mapped);
+    tree->nodes = mapped + BLOOM_TREE_HEADER_SIZE;
+    tree->__is_on_disk = 1;
+    return BLOOM_SUCCESS;
+}
+
+/*  Each level is built from the one below, its nodes split over the threads */
+static int __tree_build_levels(BloomFilterTree *tree, int num_threads) {
+#if defined(_OPENMP)
+    num_threads = (num_threads < 1) ? 1 : num_threads;
+#else
+    num_threads = 1;
+#endif
+    int status = BLOOM_SUCCESS;
+    unsigned int level;
+    bloom_filter_get_popcount_kernel();  // pick the kernel before any threads use it
+    for (level = 1; level < tree->number_levels; ++level) {
+        int64_t j, size = (int64_t)tree->__level_size[level];
+        if (num_threads == 1) {
+            for (j = 0; j < size && status == BLOOM_SUCCESS; ++j) {
+                status = __tree_build_node(tree, level, (uint64_t)j);
+            }
+            continue;
+        }
+        #pragma omp parallel for num_threads(num_threads) schedule(dynamic, 1)
+        for (j = 0; j < size; ++j) {
+            if (__tree_build_node(tree, level, (uint64_t)j) == BLOOM_FAILURE) {
+                __atomic_store_n(&status, BLOOM_FAILURE, __ATOMIC_RELAXED);
+            }
+        }
+    }
+    return status;
+}
+
+/* A node is the union of its children */
+static int __tree_build_node(BloomFilterTree *tree, unsigned int level, uint64_t index) {
+    BloomFilter node, children[BLOOM_TREE_MAX_FANOUT];
+    BloomFilter *ptrs[BLOOM_TREE_MAX_FANOUT];
+    uint64_t c, first = index * tree->fanout, last = first + tree->fanout;
+    last = (last < tree->__level_size[level - 1]) ? last : tree->__level_size[level - 1];
+    __copy_params(&node, &tree->params);
+    node.bloom = __tree_node(tree, level, index);
+    for (c = first; c < last; ++c) {
+        __copy_params(&children[c - first], &tree->params);
+        children[c - first].bloom = __tree_node(tree, level - 1, c);
+        ptrs[c - first] = &children[c - first];
+    }
+    return bloom_filter_union_many(&node, ptrs, last - first);
+}
+
+static __inline__ unsigned char* __tree_node(BloomFilterTree *tree, unsigned int level, uint64_t index) {
+    return tree->nodes + (tree->__level_offset[level] + index) * tree->node_bytes;
+}
+
+/*  header: magic, options, number of hashes, false positive rate (4 bytes each), then
+    the number of bits, estimated elements, and number of leaves (8 bytes each) and
+    the fanout (4 bytes), zero padded to BLOOM_TREE_HEADER_SIZE */
+static void __tree_write_header(BloomFilterTree *tree, unsigned char *header) {
+    uint32_t magic = BLOOM_TREE_MAGIC, options = __get_options(&tree->params), hashes = tree->params.number_hashes, fanout = tree->fanout;
+    memset(header, 0, BLOOM_TREE_HEADER_SIZE);
+    memcpy(header, &magic, sizeof(uint32_t));
+    memcpy(header + 4, &options, sizeof(uint32_t));
+    memcpy(header + 8, &hashes, sizeof(uint32_t));
+    memcpy(header + 12, &tree->params.false_positive_probability, sizeof(float));
+    memcpy(header + 16, &tree->params.number_bits, sizeof(uint64_t));
+    memcpy(header + 24, &tree->params.estimated_elements, sizeof(uint64_t));
+    memcpy(header + 32, &tree->number_leaves, sizeof(uint64_t));
+    memcpy(header + 40, &fanout, sizeof(uint32_t));
+}
+
+static int __tree_read_header(BloomFilterTree *tree, const unsigned char *header, uint64_t *number_leaves, unsigned int *fanout) {
+    uint32_t magic, options, hashes, stored_fanout;
+    memcpy(&magic, header, sizeof(uint32_t));
+    memcpy(&options, header + 4, sizeof(uint32_t));
+    memcpy(&hashes, header + 8, sizeof(uint32_t));
+    memset(&tree->params, 0, sizeof(BloomFilter));
+    if (magic != BLOOM_TREE_MAGIC || __set_options(&tree->params, options) == BLOOM_FAILURE) {
+        return BLOOM_FAILURE;
+    }
+    tree->params.number_hashes = hashes;
+    memcpy(&tree->params.false_positive_probability, header + 12, sizeof(float));
+    memcpy(&tree->params.number_bits, header + 16, sizeof(uint64_t));
+    memcpy(&tree->params.estimated_elements, header + 24, sizeof(uint64_t));
+    memcpy(number_leaves, header + 32, sizeof(uint64_t));
+    memcpy(&stored_fanout, header + 40, sizeof(uint32_t));
+    *fanout = stored_fanout;
+    tree->params.bloom_length = (tree->params.number_bits + CHAR_LEN - 1) / CHAR_LEN;
+    bloom_filter_set_hash_function(&tree->params, NULL);
+    return (hashes == 0 || tree->params.number_bits == 0) ? BLOOM_FAILURE : BLOOM_SUCCESS;
+}
+
+/*  Level 0 holds the leaves and each level above has one node per fanout nodes below
+    it, up to a single root. Nodes are stored from the root level down so that the top
+    of the tree, which every query reads, is together at the start. */
+static int __tree_layout(BloomFilterTree *tree, uint64_t number_leaves, unsigned int fanout) {
+    if (number_leaves == 0 || fanout < 2 || fanout > BLOOM_TREE_MAX_FANOUT) {
+        return BLOOM_FAILURE;
+    }
+    unsigned int level = 0;
+    tree->number_leaves = number_leaves;
+    tree->fanout = fanout;
+    tree->__level_size[0] = number_leaves;
+    while (tree->__level_size[level] > 1) {
+        if (level + 1 == BLOOM_TREE_MAX_LEVELS) {
+            return BLOOM_FAILURE;
+        }
+        ++level;
+        tree->__level_size[level] = (tree->__level_size[level - 1] + fanout - 1) / fanout;
+    }
+    tree->number_levels = level + 1;
+    tree->number_nodes = 0;
+    for (level = tree->number_levels; level-- > 0;) {
+        tree->__level_offset[level] = tree->number_nodes;
+        tree->number_nodes += tree->__level_size[level];
+    }
+    tree->node_bytes = (tree->params.bloom_length + BLOOM_CACHE_LINE - 1) / BLOOM_CACHE_LINE * BLOOM_CACHE_LINE;
+    return BLOOM_SUCCESS;
+}
+
+static int __tree_query(BloomFilterTree *tree, const BloomKey *key, uint64_t *ids, uint64_t *num_ids) {
+    unsigned int i, k = tree->params.number_hashes;
+    uint64_t stack_bits[BLOOM_MAX_STACK_HASHES];
+    uint64_t *bits = (k > BLOOM_MAX_STACK_HASHES) ? (uint64_t*)calloc(k, sizeof(uint64_t)) : stack_bits;
+    if (bits == NULL) {
+        return BLOOM_FAILURE;
+    }
+    for (i = 0; i < k; ++i) {
+        bits[i] = __key_bit(&tree->params, key, i);
+    }
+    unsigned int top = tree->number_levels - 1;
+    *num_ids = 0;
+    if (__tree_node_has(__tree_node(tree, top, 0), bits, k)) {
+        __tree_descend(tree, top, 0, bits, k, ids, num_ids);
+    }
+    if (bits != stack_bits) {
+        free(bits);
+    }
+    return BLOOM_SUCCESS;
+}
+
+/*  The node matched; prefetch the key's bits in all of its children before checking
+    any so that their cache misses (or page faults) overlap */
+static void __tree_descend(BloomFilterTree *tree, unsigned int level, uint64_t index, const uint64_t *bits, unsigned int k, uint64_t *ids, uint64_t *found) {
+    if (level == 0) {
+        ids[(*found)++] = index;
+        return;
+    }
+    uint64_t c, first = index * tree->fanout, last = first + tree->fanout;
+    unsigned int i;
+    last = (last < tree->__level_size[level - 1]) ? last : tree->__level_size[level - 1];
+    for (c = first; c < last; ++c) {
+        const unsigned char *child = __tree_node(tree, level - 1, c);
+        for (i = 0; i < k; ++i) {
+            BLOOM_PREFETCH(child + bits[i] / 8, 0);
+        }
+    }
+    for (c = first; c < last; ++c) {
+        if (__tree_node_has(__tree_node(tree, level - 1, c), bits, k)) {
+            __tree_descend(tree, level - 1, c, bits, k, ids, found);
+        }
+    }
+}
+
+static __inline__ int __tree_node_has(const unsigned char *node, const uint64_t *bits, unsigned int k) {
+    unsigned int i;
+    for (i = 0; i < k; ++i) {
+        if (CHECK_BIT(node, bits[i]) == 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int __compare_strings(const void *a, const void *b) {
+    return strcmp(*(const char * const *)a, *(const char * const *)b);
 }
@@ -19,6 +19,7 @@ extern "C" {
 #endif
 
 #include <inttypes.h>       /* PRIu64 */
+#include <stddef.h>         /* size_t */
 
 /* https://gcc.gnu.org/onlinedocs/gcc/Alternate-Keywords.html#Alternate-Keywords */
 #ifndef __GNUC__
@@ -36,26 +37,84 @@ extern "C" {
 
 #define BLOOM_SUCCESS 0
 #define BLOOM_FAILURE -1
+#define BLOOM_PRESENT 1  /* returned by the add if absent functions */
 
 #define bloom_filter_get_version()    (BLOOMFILTER_VERSION)
 
+/*  Largest number of hashes that will be calculated into a stack buffer; filters
+    needing more hashes fall back to a heap allocation per operation */
+#define BLOOM_MAX_STACK_HASHES 64
+
 typedef uint64_t* (*BloomHashFunction) (int num_hashes, const char *str);
 
+/*  Hash function that writes the `num_hashes` hashes into the caller supplied
+    results buffer instead of allocating them */
+typedef void (*BloomHashFunctionNoAlloc) (int num_hashes, const char *str, uint64_t *results);
+
+/*  Hash function for keys of an explicit length which may contain embedded NUL
+    bytes; strings are hashed as their bytes (without the terminating NUL) */
+typedef void (*BloomHashFunctionBytes) (int num_hashes, const void *key, size_t len, uint64_t *results);
+
+/*  Supplies key 'idx' of a collection and sets its length; it may return memory it
+    owns or write the key into 'buffer' (BLOOM_KEY_BUFFER_SIZE bytes). It is called
+    from many threads at once by bloom_filter_parallel_build_callback */
+#define BLOOM_KEY_BUFFER_SIZE 256
+typedef const char* (*BloomKeyCallback) (size_t idx, char *buffer, size_t *length, void *user_data);
+
+/*  Built in hashing strategies; the type is recorded when exporting so that an
+    imported bloom filter hashes exactly the same way it did when it was built */
+typedef enum bloom_hash_type {
+    BLOOM_HASH_FNV1A = 0,           /* one seeded FNV-1a pass over the key per hash */
+    BLOOM_HASH_FNV1A_DOUBLE = 1,    /* a single pass over the key; hash i is h1 + i * h2 */
+    BLOOM_HASH_XXH64 = 2,           /* XXH64 (32 bytes per step) with double hashing */
+    BLOOM_HASH_MURMUR3_128 = 3      /* MurmurHash3 x64 128 (16 bytes per step); the halves are h1 and h2 */
+} BloomHashType;
+
+/*  How a hash is mapped to a bit in the bloom filter; the mapping is recorded when
+    exporting. The original modulo mapping requires a 64 bit division per hash. */
+typedef enum bloom_index_mapping {
+    BLOOM_INDEX_MODULO = 0,         /* hash % bits */
+    BLOOM_INDEX_FASTRANGE = 1,      /* (hash * bits) >> 64; https://github.com/lemire/fastrange */
+    BLOOM_INDEX_POW2 = 2            /* bits are rounded up to a power of 2; hash & (bits - 1).
+                                       Uses the low bits of the hash; not recommended with BLOOM_HASH_FNV1A */
+} BloomIndexMapping;
+
+/*  Kernels used to count set bits; by default the fastest one the CPU supports is
+    selected at runtime (x86 with GCC or Clang), otherwise a portable version is used */
+typedef enum bloom_popcount_kernel {
+    BLOOM_POPCOUNT_AUTO = 0,        /* detect the CPU on first use */
+    BLOOM_POPCOUNT_PORTABLE = 1,    /* bit twiddling on 64 bit words */
+    BLOOM_POPCOUNT_POPCNT = 2,      /* the popcnt instruction */
+    BLOOM_POPCOUNT_AVX2 = 3,        /* Harley-Seal carry save adders over 256 bit vectors */
+    BLOOM_POPCOUNT_AVX512 = 4       /* AVX-512 VPOPCNTDQ */
+} BloomPopcountKernel;
+
 typedef struct bloom_filter {
     /* bloom parameters */
     uint64_t estimated_elements;
     float false_positive_probability;
     unsigned int number_hashes;
     uint64_t number_bits;
-    /* bloom filter */
+    /* bloom filter; in memory it is 64 byte aligned and zero padded to whole words */
     unsigned char *bloom;
     unsigned long bloom_length;
     uint64_t elements_added;
     BloomHashFunction hash_function;
+    BloomHashFunctionNoAlloc hash_function_noalloc;
+    BloomHashFunctionBytes hash_function_bytes;
+    BloomHashType hash_type;
+    BloomIndexMapping index_mapping;
     /* on disk handeling */
     short __is_on_disk;
     FILE *filepointer;
     uint64_t __filesize;
+    /* concurrency; see bloom_filter_set_thread_safe */
+    short __thread_safe;
+    uint64_t *__counters;
+    uint64_t __sync_interval;
+    /* running count of the bits set; see bloom_filter_set_track_bits */
+    short __track_bits;
+    uint64_t __bits_set;
 } BloomFilter;
 
 
@@ -68,11 +127,22 @@ static __inline__ int bloom_filter_init(BloomFilter *bf, uint64_t estimated_elem
     return bloom_filter_init_alt(bf, estimated_elements, false_positive_rate, NULL);
 }
 
+/*  Initialize a bloom filter in memory using one of the built in hash types and
+    index mappings; both are stored when the bloom filter is exported */
+int bloom_filter_init_options(BloomFilter *bf, uint64_t estimated_elements, float false_positive_rate, BloomHashType hash_type, BloomIndexMapping index_mapping);
+static __inline__ int bloom_filter_init_hash_type(BloomFilter *bf, uint64_t estimated_elements, float false_positive_rate, BloomHashType hash_type) {
+    return bloom_filter_init_options(bf, estimated_elements, false_positive_rate, hash_type, BLOOM_INDEX_MODULO);
+}
+
 /* Initialize a bloom filter directly into file; useful if the bloom filter is larger than available RAM */
 int bloom_filter_init_on_disk_alt(BloomFilter *bf, uint64_t estimated_elements, float false_positive_rate, const char *filepath, BloomHashFunction hash_function);
 static __inline__ int bloom_filter_init_on_disk(BloomFilter *bf, uint64_t estimated_elements, float false_positive_rate, const char *filepath) {
     return bloom_filter_init_on_disk_alt(bf, estimated_elements, false_positive_rate, filepath, NULL);
 }
+int bloom_filter_init_on_disk_options(BloomFilter *bf, uint64_t estimated_elements, float false_positive_rate, const char *filepath, BloomHashType hash_type, BloomIndexMapping index_mapping);
+static __inline__ int bloom_filter_init_on_disk_hash_type(BloomFilter *bf, uint64_t estimated_elements, float false_positive_rate, const char *filepath, BloomHashType hash_type) {
+    return bloom_filter_init_on_disk_options(bf, estimated_elements, false_positive_rate, filepath, hash_type, BLOOM_INDEX_MODULO);
+}
 
 /* Import a previously exported bloom filter from a file into memory */
 int bloom_filter_import_alt(BloomFilter *bf, const char *filepath, BloomHashFunction hash_function);
@@ -101,15 +171,54 @@ static __inline__ int bloom_filter_import_hex_string(BloomFilter *bf, char *hex)
     return bloom_filter_import_hex_string_alt(bf, hex, NULL);
 }
 
-/* Set or change the hashing function */
+/*  Set or change the hashing function; passing NULL uses the built in hash for
+    the bloom filter's hash type */
 void bloom_filter_set_hash_function(BloomFilter *bf, BloomHashFunction hash_function);
 
+/*  Set or change the hashing function to one that does not allocate; passing NULL
+    restores the default hashing function */
+void bloom_filter_set_hash_function_noalloc(BloomFilter *bf, BloomHashFunctionNoAlloc hash_function);
+
+/*  Set or change the hashing function to one that accepts a key and its length;
+    this is required to use the bytes functions. Passing NULL restores the default */
+void bloom_filter_set_hash_function_bytes(BloomFilter *bf, BloomHashFunctionBytes hash_function);
+
 /* Print out statistics about the bloom filter */
 void bloom_filter_stats(BloomFilter *bf);
 
 /* Release all memory used by the bloom filter */
 int bloom_filter_destroy(BloomFilter *bf);
 
+/*  Make adds safe to call from many threads of any runtime (pthreads, std::thread,
+    OpenMP, ...) without compiling with -fopenmp. Bits are set with lock free atomic
+    ORs on 64 bit words, skipped when the bit is already set. Each thread counts its
+    adds in its own cache line; read the total with bloom_filter_elements_added (the
+    stats, export, and false positive rate functions do so). Turn it on before the
+    threads start. Off by default; initializing or importing resets it. */
+void bloom_filter_set_thread_safe(BloomFilter *bf, int thread_safe);
+
+/*  The exact number of elements added; the same as elements_added unless the filter
+    is thread safe, where the per thread counts are first folded into elements_added */
+uint64_t bloom_filter_elements_added(BloomFilter *bf);
+
+/*  Keep a running count of the bits set: adds count the bits they flip from 0 to 1
+    (exactly, even from many threads), and union, intersect, and the parallel build
+    recount. bloom_filter_count_set_bits, bloom_filter_estimate_elements, and the
+    stats are then O(1) instead of a scan of the filter. Turning it on scans the
+    filter once; turn it on before any threads start. Off by default; initializing or
+    importing resets it. */
+void bloom_filter_set_track_bits(BloomFilter *bf, int track_bits);
+
+/*  On disk filters keep the element count in the mapped file trailer. It is written
+    every 'interval' adds (1, every add, by default), when the filter is destroyed, and
+    by bloom_filter_sync; 0 writes it only then. Concurrent adds between writes may
+    leave a slightly stale count in the file until the next sync or destroy. */
+void bloom_filter_set_sync_interval(BloomFilter *bf, uint64_t interval);
+
+/*  Write the element count to an on disk filter and flush the mapping to the file;
+    does nothing for in memory filters */
+int bloom_filter_sync(BloomFilter *bf);
+
 /* reset filter to unused state */
 int bloom_filter_clear(BloomFilter *bf);
 
@@ -125,12 +234,142 @@ int bloom_filter_check_string(BloomFilter *bf, const char *str);
 /* Check if a string is in the bloom filter using the passed hashes */
 int bloom_filter_check_string_alt(BloomFilter *bf, uint64_t *hashes, unsigned int number_hashes_passed);
 
+/*  Add or check a key of len bytes; the key does not need to be NUL terminated and
+    may contain NUL bytes. For the built in hashes, a string and its bytes are the
+    same key */
+int bloom_filter_add_bytes(BloomFilter *bf, const void *key, size_t len);
+int bloom_filter_check_bytes(BloomFilter *bf, const void *key, size_t len);
+
+/*  Add or check num_keys keys of the passed lengths; if lengths is NULL the keys
+    are treated as NUL terminated strings. Check sets results[i] to 1 if the key
+    is possibly in the bloom filter and 0 if it is not.
+
+    Adding hashes a window of keys ahead and prefetches their bits so that the
+    cache misses overlap; elements_added is updated once per batch */
+int bloom_filter_add_batch(BloomFilter *bf, const char * const *keys, const size_t *lengths, size_t num_keys);
+int bloom_filter_check_batch(BloomFilter *bf, const char * const *keys, const size_t *lengths, size_t num_keys, unsigned char *results);
+
+/* Add num_keys integer keys; the same as bloom_filter_add_u64 on each key */
+int bloom_filter_add_batch_u64(BloomFilter *bf, const uint64_t *keys, size_t num_keys);
+
+/*  Add a key and report whether it was new, hashing it and touching its bits once
+    instead of a check followed by an add. Returns BLOOM_SUCCESS if at least one of
+    its bits was unset (and only then counts it in elements_added), BLOOM_PRESENT if
+    it was possibly already in the filter, or BLOOM_FAILURE on error. Bits are set
+    with an atomic or, so of many threads adding the same new key at least one gets
+    BLOOM_SUCCESS (more than one may, if their adds interleave); elements_added is
+    only exact under concurrent adds with bloom_filter_set_thread_safe or OpenMP.
+    The batch forms set results[i] to 1 if key i was new and 0 if it was present,
+    in key order. */
+int bloom_filter_add_if_absent(BloomFilter *bf, const char *str);
+int bloom_filter_add_if_absent_alt(BloomFilter *bf, uint64_t *hashes, unsigned int number_hashes_passed);
+int bloom_filter_add_bytes_if_absent(BloomFilter *bf, const void *key, size_t len);
+int bloom_filter_add_batch_if_absent(BloomFilter *bf, const char * const *keys, const size_t *lengths, size_t num_keys, unsigned char *results);
+int bloom_filter_add_batch_u64_if_absent(BloomFilter *bf, const uint64_t *keys, size_t num_keys, unsigned char *results);
+
+/*  Bulk load many keys into a filter far larger than the cache (in memory or on
+    disk). The bit positions of a chunk of keys are staged and radix partitioned by
+    region of the filter, then applied region by region so each page is touched once
+    per chunk. The bits set are identical to adding the keys one at a time. Filters
+    under 64 MB are loaded with bloom_filter_add_batch instead. */
+int bloom_filter_bulk_load(BloomFilter *bf, const char * const *keys, const size_t *lengths, size_t num_keys);
+int bloom_filter_bulk_load_u64(BloomFilter *bf, const uint64_t *keys, size_t num_keys);
+
+/*  Add num_keys keys using num_threads OpenMP threads. Each thread adds its share of
+    the keys to a private copy of the bit array without atomics, then the copies are
+    ORed together by all threads. The bits set and the element count are exactly
+    those of adding the keys one at a time; it needs (num_threads - 1) extra copies
+    of the bit array. Without OpenMP the keys are added by the calling thread. */
+int bloom_filter_parallel_build(BloomFilter *bf, const char * const *keys, const size_t *lengths, size_t num_keys, int num_threads);
+int bloom_filter_parallel_build_u64(BloomFilter *bf, const uint64_t *keys, size_t num_keys, int num_threads);
+int bloom_filter_parallel_build_callback(BloomFilter *bf, BloomKeyCallback key_at, void *user_data, size_t num_keys, int num_threads);
+
+/*  Checks interleave the lookups of many keys (asynchronous memory access chaining)
+    so that their cache misses overlap. The bitmap forms set bit (i % 8) of
+    bitmap[i / 8] for a possible member and clear it otherwise; bitmap must hold
+    (num_keys + 7) / 8 bytes */
+int bloom_filter_check_batch_bitmap(BloomFilter *bf, const char * const *keys, const size_t *lengths, size_t num_keys, unsigned char *bitmap);
+int bloom_filter_check_batch_u64(BloomFilter *bf, const uint64_t *keys, size_t num_keys, unsigned char *results);
+int bloom_filter_check_batch_u64_bitmap(BloomFilter *bf, const uint64_t *keys, size_t num_keys, unsigned char *bitmap);
+
+/*  A key hashed once so that it can be checked against (or added to) many filters
+    without hashing it again: its hashes and the bit positions they map to in
+    filters the size of the one it was initialized with. It can be used with any
+    filter that has the same hash function and no more hashes; other sizes or index
+    mappings map the stored hashes again. Keys with more than
+    BLOOM_KEY_INLINE_HASHES hashes allocate; release them with bloom_key_destroy. */
+#define BLOOM_KEY_INLINE_HASHES 16
+
+typedef struct bloom_key {
+    unsigned int number_hashes;
+    uint64_t number_bits;
+    BloomIndexMapping index_mapping;
+    BloomHashFunction hash_function;
+    BloomHashFunctionNoAlloc hash_function_noalloc;
+    BloomHashFunctionBytes hash_function_bytes;
+    BloomHashType hash_type;
+    short __is_integer;
+    /* the hashes followed by their mapped bits */
+    uint64_t *__heap;
+    uint64_t __stack[2 * BLOOM_KEY_INLINE_HASHES];
+} BloomKey;
+
+int bloom_key_init(BloomKey *key, BloomFilter *bf, const char *str);
+int bloom_key_init_bytes(BloomKey *key, BloomFilter *bf, const void *data, size_t len);
+int bloom_key_init_u64(BloomKey *key, BloomFilter *bf, uint64_t value);
+int bloom_key_destroy(BloomKey *key);
+
+int bloom_filter_add_key(BloomFilter *bf, const BloomKey *key);
+int bloom_filter_check_key(BloomFilter *bf, const BloomKey *key);
+
+/*  Check a key against num_filters filters, setting results[i] to 1 if it is possibly
+    in filters[i] and 0 if not. The bits of the next few filters are prefetched while
+    checking the current one. Returns BLOOM_FAILURE, without checking any, if the key
+    does not fit one of the filters. */
+int bloom_filter_check_many_filters(const BloomKey *key, BloomFilter **filters, size_t num_filters, unsigned char *results);
+
+/*  Add or check fixed width integer keys without formatting them as strings; the
+    integer is mixed directly and no memory is allocated. Integer keys always use
+    the built in integer mixer (regardless of the hash function) so they are not
+    the same key as the string or bytes of the number. A 32 bit key is the same
+    as the 64 bit key of the same value. */
+int bloom_filter_add_u64(BloomFilter *bf, uint64_t key);
+int bloom_filter_check_u64(BloomFilter *bf, uint64_t key);
+static __inline__ int bloom_filter_add_u32(BloomFilter *bf, uint32_t key) {
+    return bloom_filter_add_u64(bf, key);
+}
+static __inline__ int bloom_filter_check_u32(BloomFilter *bf, uint32_t key) {
+    return bloom_filter_check_u64(bf, key);
+}
+int bloom_filter_add_u128(BloomFilter *bf, uint64_t high, uint64_t low);
+int bloom_filter_check_u128(BloomFilter *bf, uint64_t high, uint64_t low);
+
 /* Calculates the current false positive rate based on the number of inserted elements */
 float bloom_filter_current_false_positive_rate(BloomFilter *bf);
 
 /* Count the number of bits set to 1 */
 uint64_t bloom_filter_count_set_bits(BloomFilter *bf);
 
+/*  Choose the set bit counting kernel used by all of the filters, which also selects
+    the vector width the bit sliced index ANDs its rows with and the split block
+    filter kernels (SSE4.1 with popcnt, AVX2 with AVX2 and AVX-512); returns BLOOM_FAILURE
+    if the kernel is not supported by this CPU or build. BLOOM_POPCOUNT_AUTO restores
+    the default. */
+int bloom_filter_set_popcount_kernel(BloomPopcountKernel kernel);
+
+/* The set bit counting kernel currently in use */
+BloomPopcountKernel bloom_filter_get_popcount_kernel(void);
+
+/*  Set the number of OpenMP threads used by the bulk operations on standard filters:
+    union, intersect, clear, and the set bit counts. Each thread works on one contiguous
+    slice of the bit array; filters under 512 KB use one thread. The default, 1, runs
+    them on the calling thread, as does a build without OpenMP. Returns BLOOM_FAILURE
+    if num_threads is less than 1. */
+int bloom_filter_set_bulk_threads(int num_threads);
+
+/* The number of threads used by the bulk operations */
+int bloom_filter_get_bulk_threads(void);
+
 /*  Estimate the number of unique elements in a Bloom Filter instead of using the overall count
     https://en.wikipedia.org/wiki/Bloom_filter#Approximating_the_number_of_items_in_a_Bloom_filter
     m = bits in Bloom filter
@@ -146,6 +385,13 @@ void bloom_filter_set_elements_to_estimated(BloomFilter *bf);
     NOTE: It is up to the caller to free the allocated memory */
 uint64_t* bloom_filter_calculate_hashes(BloomFilter *bf, const char *str, unsigned int number_hashes);
 
+/*  Generate the desired number of hashes for the provided string into the passed
+    results buffer; results must be able to hold at least number_hashes elements */
+int bloom_filter_calculate_hashes_into(BloomFilter *bf, const char *str, unsigned int number_hashes, uint64_t *results);
+
+/* Generate the desired number of hashes for a key of len bytes into the passed results buffer */
+int bloom_filter_calculate_hashes_bytes(BloomFilter *bf, const void *key, size_t len, unsigned int number_hashes, uint64_t *results);
+
 /* Calculate the size the bloom filter will take on disk when exported in bytes */
 uint64_t bloom_filter_export_size(BloomFilter *bf);
 
@@ -164,12 +410,307 @@ uint64_t bloom_filter_count_union_bits_set(BloomFilter *bf1, BloomFilter *bf2);
 int bloom_filter_intersect(BloomFilter *res, BloomFilter *bf1, BloomFilter *bf2);
 uint64_t bloom_filter_count_intersection_bits_set(BloomFilter *bf1, BloomFilter *bf2);
 
+/*  Union or intersect num_filters filters (in memory or on disk) into res in a single
+    pass over each; res may be one of the filters. The number of inserted elements is
+    updated to the estimated elements from the bits set in the result. */
+int bloom_filter_union_many(BloomFilter *res, BloomFilter **filters, size_t num_filters);
+int bloom_filter_intersect_many(BloomFilter *res, BloomFilter **filters, size_t num_filters);
+
 /*  Calculate the Jacccard Index of the Bloom Filters
     NOTE: The closer to 1 the index, the closer in bloom filters. If it is 1, then
     the Bloom Filters contain the same elements, 0.5 would mean about 1/2 the same
     elements are in common. 0 would mean the Bloom Filters are completely different. */
 float bloom_filter_jaccard_index(BloomFilter *bf1, BloomFilter *bf2);
 
+/*  The bits set in two Bloom Filters, their union, and their intersection; all are
+    counted in a single pass over both filters */
+typedef struct bloom_pair_counts {
+    uint64_t bits_a;
+    uint64_t bits_b;
+    uint64_t bits_union;
+    uint64_t bits_intersection;
+} BloomPairCounts;
+int bloom_filter_count_pair_bits_set(BloomFilter *bf1, BloomFilter *bf2, BloomPairCounts *counts);
+
+/*  The fraction of the bits set in bf1 that are also set in bf2; close to 1 when the
+    elements of bf1 are (nearly) all in bf2 */
+float bloom_filter_containment(BloomFilter *bf1, BloomFilter *bf2);
+
+/*  Estimate the number of unique elements in the union or intersection of the Bloom
+    Filters from the bits set in each and in their union (Swamidass & Baldi) */
+uint64_t bloom_filter_estimate_union_elements(BloomFilter *bf1, BloomFilter *bf2);
+uint64_t bloom_filter_estimate_intersection_elements(BloomFilter *bf1, BloomFilter *bf2);
+
+
+/*******************************************************************************
+    Blocked Bloom Filter
+    One hash selects a 64 byte (cache line) block and all of the bits for an
+    element are set inside that block; a check costs a single cache miss instead
+    of up to one per hash. Blocks fill unevenly which raises the false positive
+    rate, so the filter is sized larger to still meet the requested rate.
+    Keys are hashed with XXH64.
+*******************************************************************************/
+#define BLOOM_BLOCK_BITS 512
+#define BLOOM_BLOCK_WORDS (BLOOM_BLOCK_BITS / 64)
+
+typedef struct blocked_bloom_filter {
+    /* bloom parameters */
+    uint64_t estimated_elements;
+    float false_positive_probability;
+    unsigned int number_hashes;
+    uint64_t number_blocks;
+    uint64_t number_bits;
+    /* bloom filter; 64 byte aligned blocks of BLOOM_BLOCK_WORDS words */
+    uint64_t *bloom;
+    uint64_t elements_added;
+} BlockedBloomFilter;
+
+/*  Initialize a blocked bloom filter in memory with the fewest blocks whose expected
+    false positive rate is at most false_positive_rate */
+int blocked_bloom_filter_init(BlockedBloomFilter *bf, uint64_t estimated_elements, float false_positive_rate);
+
+/* Release all memory used by the blocked bloom filter */
+int blocked_bloom_filter_destroy(BlockedBloomFilter *bf);
+
+/* reset filter to unused state */
+int blocked_bloom_filter_clear(BlockedBloomFilter *bf);
+
+/* Add a string, bytes, or integer key to the blocked bloom filter */
+int blocked_bloom_filter_add_string(BlockedBloomFilter *bf, const char *str);
+int blocked_bloom_filter_add_bytes(BlockedBloomFilter *bf, const void *key, size_t len);
+int blocked_bloom_filter_add_u64(BlockedBloomFilter *bf, uint64_t key);
+
+/* Check to see if a string, bytes, or integer key is or is not in the blocked bloom filter */
+int blocked_bloom_filter_check_string(BlockedBloomFilter *bf, const char *str);
+int blocked_bloom_filter_check_bytes(BlockedBloomFilter *bf, const void *key, size_t len);
+int blocked_bloom_filter_check_u64(BlockedBloomFilter *bf, uint64_t key);
+
+/*  The expected false positive rate of a blocked bloom filter given the number of
+    elements, blocks, and hashes; accounts for the uneven filling of blocks. Returns
+    1.0 if its working memory cannot be allocated */
+double blocked_bloom_filter_false_positive_rate(uint64_t elements, uint64_t number_blocks, unsigned int number_hashes);
+
+/* Calculates the current false positive rate based on the number of inserted elements */
+float blocked_bloom_filter_current_false_positive_rate(BlockedBloomFilter *bf);
+
+/* Count the number of bits set to 1 */
+uint64_t blocked_bloom_filter_count_set_bits(BlockedBloomFilter *bf);
+
+/* Merge Blocked Bloom Filters - inserts information into res */
+int blocked_bloom_filter_union(BlockedBloomFilter *res, BlockedBloomFilter *bf1, BlockedBloomFilter *bf2);
+
+/* Export the blocked bloom filter to file and import it back into memory */
+int blocked_bloom_filter_export(BlockedBloomFilter *bf, const char *filepath);
+int blocked_bloom_filter_import(BlockedBloomFilter *bf, const char *filepath);
+
+/* Calculate the size the blocked bloom filter will take on disk when exported in bytes */
+uint64_t blocked_bloom_filter_export_size(BlockedBloomFilter *bf);
+
+/* Print out statistics about the blocked bloom filter */
+void blocked_bloom_filter_stats(BlockedBloomFilter *bf);
+
+
+/*******************************************************************************
+    Split Block Bloom Filter
+    The Apache Parquet split block bloom filter: 256 bit blocks of eight 32 bit
+    words with exactly one bit set in each word by eight salted multiplies. Keys
+    are hashed with XXH64 (seed 0) like Parquet; the u32 / u64 forms hash the 4 / 8
+    little endian bytes of an INT32 / INT64 value. The bitset is the Parquet
+    bitset (little endian words) and can be shared with other implementations.
+    On x86 the block operations use AVX2 or SSE4.1 when the CPU has them, chosen
+    with the kernel of bloom_filter_set_popcount_kernel; otherwise a scalar
+    version is used.
+*******************************************************************************/
+#define SBBF_BLOCK_BYTES 32
+#define SBBF_BLOCK_WORDS 8
+
+typedef struct split_block_bloom_filter {
+    /* bloom parameters */
+    uint64_t estimated_elements;
+    float false_positive_probability;
+    uint64_t number_blocks;
+    uint64_t number_bytes;
+    /* bloom filter; number_blocks blocks of SBBF_BLOCK_WORDS words */
+    uint32_t *bloom;
+    uint64_t elements_added;
+} SplitBlockBloomFilter;
+
+/*  Initialize a split block bloom filter; sized like the Parquet writers, including
+    rounding up to a power of 2 number of bytes. The Parquet formula does not account
+    for unevenly filled blocks so, without the rounding, the false positive rate at
+    estimated_elements can be slightly above false_positive_rate */
+int split_block_bloom_filter_init(SplitBlockBloomFilter *bf, uint64_t estimated_elements, float false_positive_rate);
+
+/* Release all memory used by the split block bloom filter */
+int split_block_bloom_filter_destroy(SplitBlockBloomFilter *bf);
+
+/* reset filter to unused state */
+int split_block_bloom_filter_clear(SplitBlockBloomFilter *bf);
+
+/* Add an already calculated XXH64 hash to the filter or check for it */
+int split_block_bloom_filter_add_hash(SplitBlockBloomFilter *bf, uint64_t hash);
+int split_block_bloom_filter_check_hash(SplitBlockBloomFilter *bf, uint64_t hash);
+
+/* Add a string, bytes (Parquet BYTE_ARRAY), or integer (Parquet INT32 / INT64) key to the filter */
+int split_block_bloom_filter_add_string(SplitBlockBloomFilter *bf, const char *str);
+int split_block_bloom_filter_add_bytes(SplitBlockBloomFilter *bf, const void *key, size_t len);
+int split_block_bloom_filter_add_u32(SplitBlockBloomFilter *bf, uint32_t key);
+int split_block_bloom_filter_add_u64(SplitBlockBloomFilter *bf, uint64_t key);
+
+/* Check to see if a string, bytes, or integer key is or is not in the filter */
+int split_block_bloom_filter_check_string(SplitBlockBloomFilter *bf, const char *str);
+int split_block_bloom_filter_check_bytes(SplitBlockBloomFilter *bf, const void *key, size_t len);
+int split_block_bloom_filter_check_u32(SplitBlockBloomFilter *bf, uint32_t key);
+int split_block_bloom_filter_check_u64(SplitBlockBloomFilter *bf, uint64_t key);
+
+/* The XXH64 (seed 0) hash used by the split block bloom filter */
+uint64_t split_block_bloom_filter_hash(const void *key, size_t len);
+
+/* The expected false positive rate given the number of elements and blocks */
+double split_block_bloom_filter_false_positive_rate(uint64_t elements, uint64_t number_blocks);
+
+/* Calculates the current false positive rate based on the number of inserted elements */
+float split_block_bloom_filter_current_false_positive_rate(SplitBlockBloomFilter *bf);
+
+/* Count the number of bits set to 1 */
+uint64_t split_block_bloom_filter_count_set_bits(SplitBlockBloomFilter *bf);
+
+/* Merge Split Block Bloom Filters - inserts information into res */
+int split_block_bloom_filter_union(SplitBlockBloomFilter *res, SplitBlockBloomFilter *bf1, SplitBlockBloomFilter *bf2);
+
+/*  Export the filter to file and import it back into memory; the file is the
+    Parquet bitset followed by the filter parameters */
+int split_block_bloom_filter_export(SplitBlockBloomFilter *bf, const char *filepath);
+int split_block_bloom_filter_import(SplitBlockBloomFilter *bf, const char *filepath);
+
+/*  Load a Parquet bitset (e.g. read from a column chunk) into a new filter; the
+    number of bytes must be a non-zero multiple of SBBF_BLOCK_BYTES */
+int split_block_bloom_filter_import_bitset(SplitBlockBloomFilter *bf, const void *bitset, uint64_t number_bytes);
+
+/* Write the Parquet bitset of the filter into bitset, which must hold number_bytes */
+int split_block_bloom_filter_export_bitset(SplitBlockBloomFilter *bf, void *bitset);
+
+/* Calculate the size the filter will take on disk when exported in bytes */
+uint64_t split_block_bloom_filter_export_size(SplitBlockBloomFilter *bf);
+
+/* Print out statistics about the split block bloom filter */
+void split_block_bloom_filter_stats(SplitBlockBloomFilter *bf);
+
+
+
+/*******************************************************************************
+    Bit Sliced Bloom Index
+    Many Bloom filters with the same size, hashes, and options stored transposed
+    (as in BIGSI): row i holds bit i of every filter, filter j being bit j of each
+    row. The filters that possibly contain a key are found by ANDing its k rows,
+    so a query reads k short rows instead of k bits of every filter. Filters are
+    appended to the end of the rows, which are widened as needed. An index on disk
+    is memory mapped and appends are written through the mapping.
+*******************************************************************************/
+typedef struct bit_sliced_bloom_index {
+    /* the size, hashes, and options every filter shares; it has no bit array */
+    BloomFilter params;
+    uint64_t number_filters;
+    /* number_bits rows of row_words words; room for row_words * 64 filters */
+    uint64_t row_words;
+    uint64_t *rows;
+    /* on disk handeling */
+    short __is_on_disk;
+    FILE *filepointer;
+    uint64_t __filesize;
+} BitSlicedBloomIndex;
+
+/*  Initialize an empty index for filters like the one passed, with room for capacity
+    filters before the rows need to be widened */
+int bit_sliced_bloom_index_init(BitSlicedBloomIndex *idx, BloomFilter *like, uint64_t capacity);
+int bit_sliced_bloom_index_init_on_disk(BitSlicedBloomIndex *idx, BloomFilter *like, uint64_t capacity, const char *filepath);
+
+/*  Build an index of exported Bloom filters, in memory or on disk at index_filepath
+    if it is not NULL; file i is filter i. Filters are read up to 64 at a time. */
+int bit_sliced_bloom_index_build_from_files(BitSlicedBloomIndex *idx, const char * const *filepaths, size_t num_files, const char *index_filepath);
+
+/* Release the memory or mapping used by the index */
+int bit_sliced_bloom_index_destroy(BitSlicedBloomIndex *idx);
+
+/*  Append filters to the index; the first gets id number_filters, the next one more,
+    and so on. Each must have the size, hashes, and options of the index. Up to 64
+    filters at a time are transposed a 64 x 64 bit block at a time. */
+int bit_sliced_bloom_index_append(BitSlicedBloomIndex *idx, BloomFilter *bf);
+int bit_sliced_bloom_index_append_many(BitSlicedBloomIndex *idx, BloomFilter **filters, size_t num_filters);
+
+/*  Find the filters that possibly contain a key; their ids, in increasing order, are
+    written to ids (which must hold number_filters ids) and their count to num_ids.
+    The rows are ANDed with the kernel chosen by bloom_filter_set_popcount_kernel. */
+int bit_sliced_bloom_index_check_string(BitSlicedBloomIndex *idx, const char *str, uint64_t *ids, uint64_t *num_ids);
+int bit_sliced_bloom_index_check_bytes(BitSlicedBloomIndex *idx, const void *key, size_t len, uint64_t *ids, uint64_t *num_ids);
+int bit_sliced_bloom_index_check_u64(BitSlicedBloomIndex *idx, uint64_t key, uint64_t *ids, uint64_t *num_ids);
+int bit_sliced_bloom_index_check_key(BitSlicedBloomIndex *idx, const BloomKey *key, uint64_t *ids, uint64_t *num_ids);
+
+/*  Export the index to file and import it back, into memory or memory mapped; the
+    file is a 64 byte header followed by the rows. Imported indexes hash with the
+    built in hash of their hash type. */
+int bit_sliced_bloom_index_export(BitSlicedBloomIndex *idx, const char *filepath);
+int bit_sliced_bloom_index_import(BitSlicedBloomIndex *idx, const char *filepath);
+int bit_sliced_bloom_index_import_on_disk(BitSlicedBloomIndex *idx, const char *filepath);
+
+
+/*******************************************************************************
+    Bloom Filter Tree
+    A sequence Bloom tree style index of many filters with the same size, hashes,
+    and options: the filters are the leaves and every other node is the union of
+    its (up to fanout) children. A query descends only into the nodes whose filter
+    possibly contains the key, so a key in none of the filters usually costs a few
+    node checks near the root instead of one per filter. The tree is stored as one
+    file of all of its nodes, which can be memory mapped so that only the nodes a
+    query reaches are read from disk.
+*******************************************************************************/
+#define BLOOM_TREE_MAX_FANOUT 64
+#define BLOOM_TREE_MAX_LEVELS 64
+
+typedef struct bloom_filter_tree {
+    /* the size, hashes, and options every node shares; it has no bit array */
+    BloomFilter params;
+    uint64_t number_leaves;
+    unsigned int fanout;
+    unsigned int number_levels;
+    uint64_t number_nodes;
+    /* nodes level by level from the root down to the leaves, node_bytes apart */
+    uint64_t node_bytes;
+    unsigned char *nodes;
+    uint64_t __level_size[BLOOM_TREE_MAX_LEVELS];    /* level 0 holds the leaves */
+    uint64_t __level_offset[BLOOM_TREE_MAX_LEVELS];  /* index of the first node of each level */
+    /* on disk handeling */
+    short __is_on_disk;
+    uint64_t __filesize;
+} BloomFilterTree;
+
+/*  Build a tree in memory with filters[i] as leaf i; fanout is the number of children
+    of a node, 2 to BLOOM_TREE_MAX_FANOUT. The nodes of a level are built by
+    num_threads OpenMP threads; without OpenMP by the calling thread. */
+int bloom_filter_tree_build(BloomFilterTree *tree, BloomFilter **filters, size_t num_filters, unsigned int fanout, int num_threads);
+
+/*  Build a tree of exported Bloom filters, in memory or written to tree_filepath (and
+    memory mapped) if it is not NULL; file i is leaf i. The directory form uses the
+    .blm files of the directory in name order. Files are read by num_threads threads. */
+int bloom_filter_tree_build_from_files(BloomFilterTree *tree, const char * const *filepaths, size_t num_files, unsigned int fanout, const char *tree_filepath, int num_threads);
+int bloom_filter_tree_build_from_directory(BloomFilterTree *tree, const char *directory, unsigned int fanout, const char *tree_filepath, int num_threads);
+
+/* Release the memory or mapping used by the tree */
+int bloom_filter_tree_destroy(BloomFilterTree *tree);
+
+/*  Find the leaves that possibly contain a key; their ids, in increasing order, are
+    written to ids (which must hold number_leaves ids) and their count to num_ids */
+int bloom_filter_tree_check_string(BloomFilterTree *tree, const char *str, uint64_t *ids, uint64_t *num_ids);
+int bloom_filter_tree_check_bytes(BloomFilterTree *tree, const void *key, size_t len, uint64_t *ids, uint64_t *num_ids);
+int bloom_filter_tree_check_u64(BloomFilterTree *tree, uint64_t key, uint64_t *ids, uint64_t *num_ids);
+int bloom_filter_tree_check_key(BloomFilterTree *tree, const BloomKey *key, uint64_t *ids, uint64_t *num_ids);
+
+/*  Export the tree to file and import it back into memory, or memory map it read only;
+    the file is a 64 byte header followed by the nodes. Imported trees hash with the
+    built in hash of their hash type. */
+int bloom_filter_tree_export(BloomFilterTree *tree, const char *filepath);
+int bloom_filter_tree_import(BloomFilterTree *tree, const char *filepath);
+int bloom_filter_tree_import_on_disk(BloomFilterTree *tree, const char *filepath);
 
 #ifdef __cplusplus
 } // extern "C"
@@ -0,0 +1,521 @@
+/*
+    Benchmarks for the different hashing and lookup strategies
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "../src/bloom.h"
+#include "timing.h"  /* URL: https://github.com/barrust/timing-c */
+
+
+#define ELEMENTS 1000000
+#define FALSE_POSITIVE_RATE 0.01
+#define LARGE_ELEMENTS 30000000  // filters well beyond the size of the last level cache
+
+/* private functions */
+/*  Many small collections indexed by filters sized for the whole set (as in a sequence
+    Bloom tree) so that the unions near the root are not saturated */
+static void benchmark_bloom_tree(void) {
+    Timing tm;
+    uint64_t num_filters = 10000, keys_per_filter = 4, f, i;
+    BloomFilter *filters = (BloomFilter*)calloc(num_filters, sizeof(BloomFilter));
+    BloomFilter **ptrs = (BloomFilter**)calloc(num_filters, sizeof(BloomFilter*));
+    for (f = 0; f < num_filters; ++f) {
+        bloom_filter_init_options(&filters[f], num_filters * keys_per_filter, 0.05, BLOOM_HASH_XXH64, BLOOM_INDEX_FASTRANGE);
+        ptrs[f] = &filters[f];
+        for (i = 0; i < keys_per_filter; ++i) {
+            bloom_filter_add_u64(&filters[f], f * keys_per_filter + i);
+        }
+    }
+    BloomFilterTree tree;
+    timing_start(&tm);
+    bloom_filter_tree_build(&tree, ptrs, num_filters, 8, 4);
+    timing_end(&tm);
+
+    printf("Filters containing a key, of %" PRIu64 " (%.0f MB):\n", num_filters, num_filters * filters[0].bloom_length / 1048576.0);
+    printf("    %-24s %12s\n", "operation", "us per key");
+    printf("    %-24s %12.2f\n", "build tree (total ms)", timing_get_difference(tm) * 1e3);
+    uint64_t *ids = (uint64_t*)calloc(num_filters, sizeof(uint64_t));
+    uint64_t found = 0, num_ids, queries = 1000, absent = num_filters * keys_per_filter;
+    timing_start(&tm);
+    for (i = 0; i < queries; ++i) {
+        for (f = 0; f < num_filters; ++f) {
+            found += bloom_filter_check_u64(&filters[f], absent + i) == BLOOM_SUCCESS ? 1 : 0;
+        }
+    }
+    timing_end(&tm);
+    printf("    %-24s %12.2f\n", "check each filter", timing_get_difference(tm) * 1e6 / queries);
+
+    timing_start(&tm);
+    for (i = 0; i < queries; ++i) {
+        bloom_filter_tree_check_u64(&tree, absent + i, ids, &num_ids);
+        found += num_ids;
+    }
+    timing_end(&tm);
+    printf("    %-24s %12.2f\n", "tree, absent keys", timing_get_difference(tm) * 1e6 / queries);
+
+    timing_start(&tm);
+    for (i = 0; i < queries; ++i) {
+        bloom_filter_tree_check_u64(&tree, i * 37, ids, &num_ids);
+        found += num_ids;
+    }
+    timing_end(&tm);
+    printf("    %-24s %12.2f\n", "tree, present keys", timing_get_difference(tm) * 1e6 / queries);
+    printf("\n");
+
+    bloom_filter_tree_destroy(&tree);
+    for (f = 0; f < num_filters; ++f) {
+        bloom_filter_destroy(&filters[f]);
+    }
+    free(filters);
+    free(ptrs);
+    free(ids);
+}
+
+static char** generate_keys(uint64_t num_keys, size_t key_len, uint64_t offset);
+static void free_keys(char **keys, uint64_t num_keys);
+static void benchmark_hash_types(size_t key_len);
+static void benchmark_index_mappings(void);
+static void benchmark_blocked(void);
+static void benchmark_popcount(void);
+static void benchmark_jaccard(void);
+static void benchmark_batch(void);
+static void benchmark_bulk_load(void);
+static void benchmark_check_many_filters(void);
+static void benchmark_bit_sliced_index(void);
+static void benchmark_bloom_tree(void);
+
+
+int main() {
+    printf("Benchmarking BloomFilter version %s\n\n", bloom_filter_get_version());
+
+    size_t key_lengths[] = {8, 64, 200};
+    for (int i = 0; i < 3; ++i) {
+        benchmark_hash_types(key_lengths[i]);
+    }
+    benchmark_index_mappings();
+    benchmark_blocked();
+    benchmark_popcount();
+    benchmark_jaccard();
+    benchmark_batch();
+    benchmark_bulk_load();
+    benchmark_check_many_filters();
+    benchmark_bit_sliced_index();
+    benchmark_bloom_tree();
+    return 0;
+}
+
+
+/*  Time hashing, insertion, and lookup of each built in hash type against the
+    original FNV-1a hash; also report the false positive rate achieved */
+static void benchmark_hash_types(size_t key_len) {
+    const char *names[] = {"fnv1a (legacy)", "fnv1a double", "xxh64", "murmur3 128"};
+    BloomHashType types[] = {BLOOM_HASH_FNV1A, BLOOM_HASH_FNV1A_DOUBLE, BLOOM_HASH_XXH64, BLOOM_HASH_MURMUR3_128};
+
+    char **keys = generate_keys(ELEMENTS, key_len, 0);
+    char **missing = generate_keys(ELEMENTS, key_len, ELEMENTS);
+
+    printf("Hash types with %lu byte keys:\n", (unsigned long)key_len);
+    printf("    %-16s %12s %12s %12s %10s\n", "hash", "hash (ns)", "add (ns)", "check (ns)", "fpr");
+    for (int t = 0; t < 4; ++t) {
+        Timing tm;
+        BloomFilter bf;
+        bloom_filter_init_hash_type(&bf, ELEMENTS, FALSE_POSITIVE_RATE, types[t]);
+
+        uint64_t hashes[BLOOM_MAX_STACK_HASHES];
+        volatile uint64_t sink = 0;  // keep the hashing from being optimized away
+        timing_start(&tm);
+        for (uint64_t i = 0; i < ELEMENTS; ++i) {
+            bloom_filter_calculate_hashes_into(&bf, keys[i], bf.number_hashes, hashes);
+            sink += hashes[bf.number_hashes - 1];
+        }
+        timing_end(&tm);
+        double hash_ns = timing_get_difference(tm) * 1e9 / ELEMENTS;
+
+        timing_start(&tm);
+        for (uint64_t i = 0; i < ELEMENTS; ++i) {
+            bloom_filter_add_bytes(&bf, keys[i], key_len);
+        }
+        timing_end(&tm);
+        double add_ns = timing_get_difference(tm) * 1e9 / ELEMENTS;
+
+        uint64_t false_positives = 0;
+        timing_start(&tm);
+        for (uint64_t i = 0; i < ELEMENTS; ++i) {
+            false_positives += bloom_filter_check_bytes(&bf, missing[i], key_len) == BLOOM_SUCCESS ? 1 : 0;
+        }
+        timing_end(&tm);
+        double check_ns = timing_get_difference(tm) * 1e9 / ELEMENTS;
+
+        printf("    %-16s %12.2f %12.2f %12.2f %10.5f\n", names[t], hash_ns, add_ns, check_ns, (double)false_positives / ELEMENTS);
+        bloom_filter_destroy(&bf);
+    }
+    printf("\n");
+
+    free_keys(keys, ELEMENTS);
+    free_keys(missing, ELEMENTS);
+}
+
+/* Time the bit mapping on pre-computed hashes so that only the mapping differs */
+static void benchmark_index_mappings(void) {
+    const char *names[] = {"modulo", "fastrange", "power of 2"};
+    BloomIndexMapping mappings[] = {BLOOM_INDEX_MODULO, BLOOM_INDEX_FASTRANGE, BLOOM_INDEX_POW2};
+
+    printf("Index mappings (xxh64, pre-computed hashes):\n");
+    printf("    %-16s %12s %12s %10s\n", "mapping", "add (ns)", "check (ns)", "fpr");
+    for (int m = 0; m < 3; ++m) {
+        Timing tm;
+        BloomFilter bf;
+        bloom_filter_init_options(&bf, ELEMENTS, FALSE_POSITIVE_RATE, BLOOM_HASH_XXH64, mappings[m]);
+        uint64_t *hashes = (uint64_t*)calloc((uint64_t)ELEMENTS * 2 * bf.number_hashes, sizeof(uint64_t));
+        for (uint64_t i = 0; i < ELEMENTS * 2; ++i) {
+            bloom_filter_calculate_hashes_bytes(&bf, &i, sizeof(i), bf.number_hashes, hashes + i * bf.number_hashes);
+        }
+
+        timing_start(&tm);
+        for (uint64_t i = 0; i < ELEMENTS; ++i) {
+            bloom_filter_add_string_alt(&bf, hashes + i * bf.number_hashes, bf.number_hashes);
+        }
+        timing_end(&tm);
+        double add_ns = timing_get_difference(tm) * 1e9 / ELEMENTS;
+
+        uint64_t false_positives = 0;
+        timing_start(&tm);
+        for (uint64_t i = ELEMENTS; i < ELEMENTS * 2; ++i) {
+            false_positives += bloom_filter_check_string_alt(&bf, hashes + i * bf.number_hashes, bf.number_hashes) == BLOOM_SUCCESS ? 1 : 0;
+        }
+        timing_end(&tm);
+        double check_ns = timing_get_difference(tm) * 1e9 / ELEMENTS;
+
+        printf("    %-16s %12.2f %12.2f %10.5f\n", names[m], add_ns, check_ns, (double)false_positives / ELEMENTS);
+        free(hashes);
+        bloom_filter_destroy(&bf);
+    }
+    printf("\n");
+}
+
+/*  Compare standard, blocked, and split block bloom filters on integer keys where
+    the filter is far larger than the cache; each standard check may miss the cache
+    once per hash while the blocked checks touch a single cache line. Build with
+    CCFLAGS=-mavx2 to use the vector split block kernels. */
+static void benchmark_blocked(void) {
+    Timing tm;
+    BloomFilter bf;
+    BlockedBloomFilter bbf;
+    SplitBlockBloomFilter sbf;
+    bloom_filter_init_options(&bf, LARGE_ELEMENTS, FALSE_POSITIVE_RATE, BLOOM_HASH_XXH64, BLOOM_INDEX_FASTRANGE);
+    blocked_bloom_filter_init(&bbf, LARGE_ELEMENTS, FALSE_POSITIVE_RATE);
+    split_block_bloom_filter_init(&sbf, LARGE_ELEMENTS, FALSE_POSITIVE_RATE);
+
+    printf("Standard vs blocked (%d u64 keys):\n", LARGE_ELEMENTS);
+    printf("    %-16s %12s %12s %12s %10s\n", "filter", "size (MB)", "add (ns)", "check (ns)", "fpr");
+
+    timing_start(&tm);
+    for (uint64_t i = 0; i < LARGE_ELEMENTS; ++i) {
+        bloom_filter_add_u64(&bf, i);
+    }
+    timing_end(&tm);
+    double add_ns = timing_get_difference(tm) * 1e9 / LARGE_ELEMENTS;
+    uint64_t false_positives = 0;
+    timing_start(&tm);
+    for (uint64_t i = LARGE_ELEMENTS; i < 2 * (uint64_t)LARGE_ELEMENTS; ++i) {
+        false_positives += bloom_filter_check_u64(&bf, i) == BLOOM_SUCCESS ? 1 : 0;
+    }
+    timing_end(&tm);
+    double check_ns = timing_get_difference(tm) * 1e9 / LARGE_ELEMENTS;
+    printf("    %-16s %12.2f %12.2f %12.2f %10.5f\n", "standard", bf.bloom_length / 1048576.0, add_ns, check_ns, (double)false_positives / LARGE_ELEMENTS);
+
+    timing_start(&tm);
+    for (uint64_t i = 0; i < LARGE_ELEMENTS; ++i) {
+        blocked_bloom_filter_add_u64(&bbf, i);
+    }
+    timing_end(&tm);
+    add_ns = timing_get_difference(tm) * 1e9 / LARGE_ELEMENTS;
+    false_positives = 0;
+    timing_start(&tm);
+    for (uint64_t i = LARGE_ELEMENTS; i < 2 * (uint64_t)LARGE_ELEMENTS; ++i) {
+        false_positives += blocked_bloom_filter_check_u64(&bbf, i) == BLOOM_SUCCESS ? 1 : 0;
+    }
+    timing_end(&tm);
+    check_ns = timing_get_difference(tm) * 1e9 / LARGE_ELEMENTS;
+    printf("    %-16s %12.2f %12.2f %12.2f %10.5f\n", "blocked", bbf.number_bits / 8 / 1048576.0, add_ns, check_ns, (double)false_positives / LARGE_ELEMENTS);
+
+    timing_start(&tm);
+    for (uint64_t i = 0; i < LARGE_ELEMENTS; ++i) {
+        split_block_bloom_filter_add_u64(&sbf, i);
+    }
+    timing_end(&tm);
+    add_ns = timing_get_difference(tm) * 1e9 / LARGE_ELEMENTS;
+    false_positives = 0;
+    timing_start(&tm);
+    for (uint64_t i = LARGE_ELEMENTS; i < 2 * (uint64_t)LARGE_ELEMENTS; ++i) {
+        false_positives += split_block_bloom_filter_check_u64(&sbf, i) == BLOOM_SUCCESS ? 1 : 0;
+    }
+    timing_end(&tm);
+    check_ns = timing_get_difference(tm) * 1e9 / LARGE_ELEMENTS;
+    printf("    %-16s %12.2f %12.2f %12.2f %10.5f\n", "split block", sbf.number_bytes / 1048576.0, add_ns, check_ns, (double)false_positives / LARGE_ELEMENTS);
+    printf("\n");
+
+    bloom_filter_destroy(&bf);
+    blocked_bloom_filter_destroy(&bbf);
+    split_block_bloom_filter_destroy(&sbf);
+}
+
+/* Throughput of each set bit counting kernel supported by this CPU on a large filter */
+static void benchmark_jaccard(void) {
+    BloomFilter bf1, bf2;
+    bloom_filter_init(&bf1, 100 * (uint64_t)ELEMENTS, FALSE_POSITIVE_RATE);
+    bloom_filter_init(&bf2, 100 * (uint64_t)ELEMENTS, FALSE_POSITIVE_RATE);
+    for (uint64_t i = 0; i < bf1.bloom_length; ++i) {
+        bf1.bloom[i] = (unsigned char)(i * 0x9E3779B1);
+        bf2.bloom[i] = (unsigned char)(i * 0x85EBCA77);
+    }
+
+    printf("Similarity of two filters (%.0f MB each):\n", bf1.bloom_length / 1048576.0);
+    printf("    %-32s %12s\n", "operation", "time (ms)");
+    Timing tm;
+    volatile float index = 0;
+    timing_start(&tm);
+    for (int r = 0; r < 5; ++r) {
+        index += (float)bloom_filter_count_union_bits_set(&bf1, &bf2) / bloom_filter_count_intersection_bits_set(&bf1, &bf2);
+    }
+    timing_end(&tm);
+    printf("    %-32s %12.2f\n", "union and intersection counts", timing_get_difference(tm) / 5 * 1e3);
+
+    timing_start(&tm);
+    for (int r = 0; r < 5; ++r) {
+        index += bloom_filter_jaccard_index(&bf1, &bf2);
+    }
+    timing_end(&tm);
+    printf("    %-32s %12.2f\n", "jaccard index (one pass)", timing_get_difference(tm) / 5 * 1e3);
+    printf("\n");
+    bloom_filter_destroy(&bf1);
+    bloom_filter_destroy(&bf2);
+}
+
+static void benchmark_popcount(void) {
+    const char *names[] = {"portable", "popcnt", "avx2", "avx512"};
+    BloomPopcountKernel kernels[] = {BLOOM_POPCOUNT_PORTABLE, BLOOM_POPCOUNT_POPCNT, BLOOM_POPCOUNT_AVX2, BLOOM_POPCOUNT_AVX512};
+    BloomFilter bf;
+    bloom_filter_init(&bf, 100 * (uint64_t)ELEMENTS, FALSE_POSITIVE_RATE);
+    for (uint64_t i = 0; i < bf.bloom_length; ++i) {
+        bf.bloom[i] = (unsigned char)(i * 0x9E3779B1);
+    }
+
+    printf("Count set bits (%.0f MB):\n", bf.bloom_length / 1048576.0);
+    printf("    %-16s %12s %12s\n", "kernel", "time (ms)", "GB/s");
+    for (int k = 0; k < 4; ++k) {
+        if (bloom_filter_set_popcount_kernel(kernels[k]) == BLOOM_FAILURE) {
+            printf("    %-16s %12s\n", names[k], "unsupported");
+            continue;
+        }
+        Timing tm;
+        volatile uint64_t bits = 0;
+        timing_start(&tm);
+        for (int r = 0; r < 5; ++r) {
+            bits += bloom_filter_count_set_bits(&bf);
+        }
+        timing_end(&tm);
+        double seconds = timing_get_difference(tm) / 5;
+        printf("    %-16s %12.2f %12.2f\n", names[k], seconds * 1e3, bf.bloom_length / seconds / 1e9);
+    }
+    printf("\n");
+    bloom_filter_set_popcount_kernel(BLOOM_POPCOUNT_AUTO);
+    bloom_filter_destroy(&bf);
+}
+
+/* One key at a time against the prefetching / interleaved batch functions on a filter larger than the cache */
+static void benchmark_batch(void) {
+    Timing tm;
+    BloomFilter single, batched;
+    bloom_filter_init_options(&single, LARGE_ELEMENTS, FALSE_POSITIVE_RATE, BLOOM_HASH_XXH64, BLOOM_INDEX_FASTRANGE);
+    bloom_filter_init_options(&batched, LARGE_ELEMENTS, FALSE_POSITIVE_RATE, BLOOM_HASH_XXH64, BLOOM_INDEX_FASTRANGE);
+    uint64_t *keys = (uint64_t*)calloc(LARGE_ELEMENTS, sizeof(uint64_t));
+    for (uint64_t i = 0; i < LARGE_ELEMENTS; ++i) {
+        keys[i] = i;
+    }
+
+    printf("Single vs batch (%d u64 keys):\n", LARGE_ELEMENTS);
+    printf("    %-16s %12s\n", "operation", "ns per key");
+    timing_start(&tm);
+    for (uint64_t i = 0; i < LARGE_ELEMENTS; ++i) {
+        bloom_filter_add_u64(&single, keys[i]);
+    }
+    timing_end(&tm);
+    printf("    %-16s %12.2f\n", "add", timing_get_difference(tm) * 1e9 / LARGE_ELEMENTS);
+
+    timing_start(&tm);
+    bloom_filter_add_batch_u64(&batched, keys, LARGE_ELEMENTS);
+    timing_end(&tm);
+    printf("    %-16s %12.2f\n", "add batch", timing_get_difference(tm) * 1e9 / LARGE_ELEMENTS);
+
+    uint64_t found = 0;
+    timing_start(&tm);
+    for (uint64_t i = 0; i < LARGE_ELEMENTS; ++i) {
+        found += bloom_filter_check_u64(&single, keys[i] + LARGE_ELEMENTS) == BLOOM_SUCCESS ? 1 : 0;
+    }
+    timing_end(&tm);
+    printf("    %-16s %12.2f\n", "check", timing_get_difference(tm) * 1e9 / LARGE_ELEMENTS);
+
+    unsigned char *bitmap = (unsigned char*)calloc(LARGE_ELEMENTS / 8 + 1, sizeof(char));
+    for (uint64_t i = 0; i < LARGE_ELEMENTS; ++i) {
+        keys[i] += LARGE_ELEMENTS;
+    }
+    timing_start(&tm);
+    bloom_filter_check_batch_u64_bitmap(&batched, keys, LARGE_ELEMENTS, bitmap);
+    timing_end(&tm);
+    printf("    %-16s %12.2f\n", "check batch", timing_get_difference(tm) * 1e9 / LARGE_ELEMENTS);
+    free(bitmap);
+    printf("\n");
+
+    free(keys);
+    bloom_filter_destroy(&single);
+    bloom_filter_destroy(&batched);
+}
+
+/* Prefetching batch against the radix partitioned bulk load on a filter of over a GB */
+static void benchmark_bulk_load(void) {
+    Timing tm;
+    BloomFilter bf;
+    bloom_filter_init_options(&bf, 1000000000, FALSE_POSITIVE_RATE, BLOOM_HASH_XXH64, BLOOM_INDEX_FASTRANGE);
+    uint64_t *keys = (uint64_t*)calloc(LARGE_ELEMENTS, sizeof(uint64_t));
+    for (uint64_t i = 0; i < LARGE_ELEMENTS; ++i) {
+        keys[i] = i;
+    }
+    bloom_filter_clear(&bf);  // fault in the pages so both runs start alike
+
+    printf("Batch vs bulk load (%d u64 keys, %.0f MB filter):\n", LARGE_ELEMENTS, bf.bloom_length / 1048576.0);
+    printf("    %-16s %12s\n", "operation", "ns per key");
+    timing_start(&tm);
+    bloom_filter_add_batch_u64(&bf, keys, LARGE_ELEMENTS);
+    timing_end(&tm);
+    printf("    %-16s %12.2f\n", "add batch", timing_get_difference(tm) * 1e9 / LARGE_ELEMENTS);
+
+    bloom_filter_clear(&bf);
+    timing_start(&tm);
+    bloom_filter_bulk_load_u64(&bf, keys, LARGE_ELEMENTS);
+    timing_end(&tm);
+    printf("    %-16s %12.2f\n", "bulk load", timing_get_difference(tm) * 1e9 / LARGE_ELEMENTS);
+    printf("\n");
+
+    free(keys);
+    bloom_filter_destroy(&bf);
+}
+
+/* URL like keys of a fixed length that only differ in the trailing identifier */
+/* One key against a filter per day: hashing it for each filter against hashing it once */
+static void benchmark_check_many_filters(void) {
+    Timing tm;
+    BloomFilter days[32];
+    BloomFilter *filters[32];
+    uint64_t num_keys = ELEMENTS / 4;
+    char **keys = generate_keys(num_keys, 16, 0);
+    for (int d = 0; d < 32; ++d) {
+        bloom_filter_init(&days[d], ELEMENTS, FALSE_POSITIVE_RATE);
+        filters[d] = &days[d];
+        bloom_filter_add_batch(&days[d], (const char * const *)keys, NULL, num_keys * (d + 1) / 32);
+    }
+
+    printf("One key against 32 filters (%.0f MB in all):\n", 32 * days[0].bloom_length / 1048576.0);
+    printf("    %-24s %12s\n", "operation", "ns per key");
+    uint64_t found = 0;
+    timing_start(&tm);
+    for (uint64_t i = 0; i < num_keys; ++i) {
+        for (int d = 0; d < 32; ++d) {
+            found += bloom_filter_check_string(&days[d], keys[i]) == BLOOM_SUCCESS ? 1 : 0;
+        }
+    }
+    timing_end(&tm);
+    printf("    %-24s %12.2f\n", "check each filter", timing_get_difference(tm) * 1e9 / num_keys);
+
+    BloomKey key;
+    unsigned char results[32];
+    timing_start(&tm);
+    for (uint64_t i = 0; i < num_keys; ++i) {
+        bloom_key_init(&key, &days[0], keys[i]);
+        bloom_filter_check_many_filters(&key, filters, 32, results);
+        bloom_key_destroy(&key);
+        found += results[i % 32];
+    }
+    timing_end(&tm);
+    printf("    %-24s %12.2f\n", "hash once, check many", timing_get_difference(tm) * 1e9 / num_keys);
+    printf("\n");
+
+    free_keys(keys, num_keys);
+    for (int d = 0; d < 32; ++d) {
+        bloom_filter_destroy(&days[d]);
+    }
+}
+
+/* Which of 2048 filters contain a key: checking each filter against the bit sliced index */
+static void benchmark_bit_sliced_index(void) {
+    Timing tm;
+    BloomFilter *filters = (BloomFilter*)calloc(2048, sizeof(BloomFilter));
+    BloomFilter **ptrs = (BloomFilter**)calloc(2048, sizeof(BloomFilter*));
+    uint64_t num_keys = 10000, f, i;
+    for (f = 0; f < 2048; ++f) {
+        bloom_filter_init_options(&filters[f], num_keys, FALSE_POSITIVE_RATE, BLOOM_HASH_XXH64, BLOOM_INDEX_FASTRANGE);
+        ptrs[f] = &filters[f];
+        for (i = 0; i < num_keys; ++i) {
+            bloom_filter_add_u64(&filters[f], f * num_keys / 2 + i);  // overlaps the next filter
+        }
+    }
+    BitSlicedBloomIndex idx;
+    timing_start(&tm);
+    bit_sliced_bloom_index_init(&idx, &filters[0], 2048);
+    bit_sliced_bloom_index_append_many(&idx, ptrs, 2048);
+    timing_end(&tm);
+
+    printf("Filters containing a key, of 2048 (%.0f MB):\n", 2048 * filters[0].bloom_length / 1048576.0);
+    printf("    %-24s %12s\n", "operation", "us per key");
+    printf("    %-24s %12.2f\n", "build index (total ms)", timing_get_difference(tm) * 1e3);
+    uint64_t *ids = (uint64_t*)calloc(2048, sizeof(uint64_t));
+    uint64_t found = 0, num_ids, queries = 2000;
+    timing_start(&tm);
+    for (i = 0; i < queries; ++i) {
+        for (f = 0; f < 2048; ++f) {
+            found += bloom_filter_check_u64(&filters[f], i * 5003) == BLOOM_SUCCESS ? 1 : 0;
+        }
+    }
+    timing_end(&tm);
+    printf("    %-24s %12.2f\n", "check each filter", timing_get_difference(tm) * 1e6 / queries);
+
+    timing_start(&tm);
+    for (i = 0; i < queries; ++i) {
+        bit_sliced_bloom_index_check_u64(&idx, i * 5003, ids, &num_ids);
+        found += num_ids;
+    }
+    timing_end(&tm);
+    printf("    %-24s %12.2f\n", "bit sliced index", timing_get_difference(tm) * 1e6 / queries);
+    printf("\n");
+
+    bit_sliced_bloom_index_destroy(&idx);
+    for (f = 0; f < 2048; ++f) {
+        bloom_filter_destroy(&filters[f]);
+    }
+    free(filters);
+    free(ptrs);
+    free(ids);
+}
+
+static char** generate_keys(uint64_t num_keys, size_t key_len, uint64_t offset) {
+    char **keys = (char**)calloc(num_keys, sizeof(char*));
+    for (uint64_t i = 0; i < num_keys; ++i) {
+        char id[32] = {0};
+        int id_len = sprintf(id, "%" PRIu64 "", i + offset);
+        keys[i] = (char*)calloc(key_len + 1, sizeof(char));
+        memset(keys[i], 'a', key_len);
+        memcpy(keys[i], "https://example.com/", key_len < 20 ? key_len : 20);
+        size_t start = key_len > (size_t)id_len ? key_len - id_len : 0;
+        memcpy(keys[i] + start, id, key_len - start);
+    }
+    return keys;
+}
+
+static void free_keys(char **keys, uint64_t num_keys) {
+    for (uint64_t i = 0; i < num_keys; ++i) {
+        free(keys[i]);
+    }
+    free(keys);
+}
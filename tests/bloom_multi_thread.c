@@ -7,6 +7,13 @@
 
 #define SIZE 100000000
 
+/* key i of the build is the number i + 1 */
+static const char* number_key(size_t idx, char *buffer, size_t *length, void *user_data) {
+    (void)user_data;
+    *length = sprintf(buffer, "%" PRIu64 "", (uint64_t)idx + 1);
+    return buffer;
+}
+
 int main() {
     printf("Testing BloomFilter version %s\n\n", bloom_filter_get_version());
 
@@ -41,16 +48,8 @@ int main() {
     omp_set_num_threads(THREADS);
     #endif
 
-    #pragma omp parallel for
-    for(uint64_t i = 1; i < SIZE; i++) {
-        char str[255] = {0};
-        sprintf(str, "%" PRIu64 "", i);
-        if (bloom_filter_add_string(&bf2, str) == BLOOM_FAILURE) {
-            #pragma omp critical
-            {
-                printf("Unable to add '%s'\n", str);
-            }
-        }
+    if (bloom_filter_parallel_build_callback(&bf2, number_key, NULL, SIZE - 1, THREADS) == BLOOM_FAILURE) {
+        printf("Unable to build the Bloom Filter\n");
     }
     timing_end(&t);
     #if defined (_OPENMP)
@@ -3,6 +3,7 @@
 #include <stdint.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <pthread.h>
 
 #include <openssl/md5.h>
 
@@ -14,7 +15,12 @@ static int calculate_md5sum(const char* filename, char* digest);
 static off_t fsize(const char* filename);
 
 static uint64_t* fake_hash(int num_hashes, const char *str);
+static void fake_hash_noalloc(int num_hashes, const char *str, uint64_t *results);
+static void fake_hash_bytes(int num_hashes, const void *key, size_t len, uint64_t *results);
 static uint64_t hasher(const char *key);
+static void* add_thread_range(void *arg);
+static void* add_if_absent_range(void *arg);
+static const char* number_key(size_t idx, char *buffer, size_t *length, void *user_data);
 
 
 BloomFilter b;
@@ -108,6 +114,197 @@ MU_TEST(test_bloom_hashes_start_collisions) {
     free(hashes_bar);
 }
 
+MU_TEST(test_bloom_hashes_into) {
+    uint64_t into[5] = {0};
+    uint64_t* hashes = bloom_filter_calculate_hashes(&b, "foo", 5);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_calculate_hashes_into(&b, "foo", 5, into));
+    for (int i = 0; i < 5; ++i)
+        mu_assert_int_eq(hashes[i], into[i]);
+    free(hashes);
+
+    // allocating user hash functions are copied into the buffer
+    BloomFilter bf;
+    bloom_filter_init_alt(&bf, 50000, 0.01, &fake_hash);
+    hashes = bloom_filter_calculate_hashes(&bf, "foo", 5);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_calculate_hashes_into(&bf, "foo", 5, into));
+    for (int i = 0; i < 5; ++i)
+        mu_assert_int_eq(hashes[i], into[i]);
+    free(hashes);
+    bloom_filter_destroy(&bf);
+}
+
+MU_TEST(test_bloom_hashes_noalloc) {
+    BloomFilter bf;
+    bloom_filter_init(&bf, 50000, 0.01);
+    bloom_filter_set_hash_function_noalloc(&bf, &fake_hash_noalloc);
+    mu_assert_null(bf.hash_function);
+    mu_assert_not_null(bf.hash_function_noalloc);
+
+    // the allocating interface still works on top of the non-allocating one
+    uint64_t* hashes = bloom_filter_calculate_hashes(&bf, "foo", 5);
+    uint64_t* expected = fake_hash(5, "foo");
+    for (int i = 0; i < 5; ++i)
+        mu_assert_int_eq(expected[i], hashes[i]);
+    free(hashes);
+    free(expected);
+
+    int errors = 0;
+    for (int i = 0; i < 3000; ++i) {
+        char key[10] = {0};
+        sprintf(key, "%d", i);
+        errors += bloom_filter_add_string(&bf, key) == BLOOM_SUCCESS ? 0 : 1;
+        errors += bloom_filter_check_string(&bf, key) == BLOOM_SUCCESS ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+
+    // different hashing so these cannot be combined
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_union(&b, &b, &bf));
+
+    // reset to the default hashing
+    bloom_filter_set_hash_function_noalloc(&bf, NULL);
+    mu_assert_not_null(bf.hash_function);
+    mu_assert_not_null(bf.hash_function_noalloc);
+    bloom_filter_destroy(&bf);
+}
+
+
+MU_TEST(test_bloom_hashes_double) {
+    BloomFilter bf;
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_init_hash_type(&bf, 50000, 0.01, BLOOM_HASH_FNV1A_DOUBLE));
+    mu_assert_int_eq(BLOOM_HASH_FNV1A_DOUBLE, bf.hash_type);
+    mu_assert_null(bf.hash_function);
+    mu_assert_not_null(bf.hash_function_noalloc);
+
+    // every hash is h1 + i * h2
+    uint64_t* hashes = bloom_filter_calculate_hashes(&bf, "foo", 5);
+    uint64_t h2 = hashes[1] - hashes[0];
+    for (int i = 1; i < 5; ++i)
+        mu_assert_int_eq(h2, hashes[i] - hashes[i - 1]);
+    mu_assert_int_eq(1, h2 & 1);
+    free(hashes);
+
+    // set and check with a reasonable false positive rate
+    int errors = 0;
+    for (int i = 0; i < 50000; ++i) {
+        char key[10] = {0};
+        sprintf(key, "%d", i);
+        errors += bloom_filter_add_string(&bf, key) == BLOOM_SUCCESS ? 0 : 1;
+    }
+    for (int i = 0; i < 50000; ++i) {
+        char key[10] = {0};
+        sprintf(key, "%d", i);
+        errors += bloom_filter_check_string(&bf, key) == BLOOM_SUCCESS ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+    for (int i = 50000; i < 60000; ++i) {
+        char key[10] = {0};
+        sprintf(key, "%d", i);
+        errors += bloom_filter_check_string(&bf, key) == BLOOM_SUCCESS ? 1 : 0;
+    }
+    mu_assert_int_between(50, 150, errors);
+
+    // different hash types cannot be combined
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_union(&b, &b, &bf));
+    bloom_filter_destroy(&bf);
+
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_init_hash_type(&bf, 50000, 0.01, (BloomHashType)99));
+}
+
+MU_TEST(test_bloom_hashes_families) {
+    BloomFilter bf;
+    uint64_t hashes[7] = {0};
+
+    // XXH64("abc", seed 0) is the first hash
+    bloom_filter_init_hash_type(&bf, 50000, 0.01, BLOOM_HASH_XXH64);
+    bloom_filter_calculate_hashes_into(&bf, "abc", 7, hashes);
+    mu_check(0x44bc2cf5ad770999ULL == hashes[0]);
+    bloom_filter_destroy(&bf);
+
+    // MurmurHash3 x64 128 provides both double hashing bases
+    bloom_filter_init_hash_type(&bf, 50000, 0.01, BLOOM_HASH_MURMUR3_128);
+    bloom_filter_calculate_hashes_into(&bf, "foo", 7, hashes);
+    mu_check(16316970633193145697ULL == hashes[0]);
+    mu_check(9128664383759220103ULL == hashes[1] - hashes[0]);
+    bloom_filter_destroy(&bf);
+
+    BloomHashType types[] = {BLOOM_HASH_XXH64, BLOOM_HASH_MURMUR3_128};
+    for (int t = 0; t < 2; ++t) {
+        bloom_filter_init_hash_type(&bf, 50000, 0.01, types[t]);
+        mu_assert_int_eq(types[t], bf.hash_type);
+        int errors = 0;
+        for (int i = 0; i < 50000; ++i) {
+            char key[10] = {0};
+            sprintf(key, "%d", i);
+            bloom_filter_add_string(&bf, key);
+        }
+        for (int i = 0; i < 50000; ++i) {
+            char key[10] = {0};
+            sprintf(key, "%d", i);
+            errors += bloom_filter_check_bytes(&bf, key, strlen(key)) == BLOOM_SUCCESS ? 0 : 1;
+        }
+        mu_assert_int_eq(0, errors);
+        for (int i = 50000; i < 60000; ++i) {
+            char key[10] = {0};
+            sprintf(key, "%d", i);
+            errors += bloom_filter_check_string(&bf, key) == BLOOM_SUCCESS ? 1 : 0;
+        }
+        mu_assert_int_between(50, 150, errors);
+
+        // the hash type is kept when exported
+        char* hex = bloom_filter_export_hex_string(&bf);
+        BloomFilter imp;
+        bloom_filter_import_hex_string(&imp, hex);
+        mu_assert_int_eq(types[t], imp.hash_type);
+        mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_string(&imp, "49999"));
+        mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_union(&imp, &imp, &bf));
+        mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_union(&imp, &imp, &b));
+        bloom_filter_destroy(&imp);
+        free(hex);
+        bloom_filter_destroy(&bf);
+    }
+}
+
+MU_TEST(test_bloom_index_mapping) {
+    BloomIndexMapping mappings[] = {BLOOM_INDEX_FASTRANGE, BLOOM_INDEX_POW2};
+    uint64_t bits[] = {479253, 524288};
+    for (int m = 0; m < 2; ++m) {
+        BloomFilter bf;
+        mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_init_options(&bf, 50000, 0.01, BLOOM_HASH_XXH64, mappings[m]));
+        mu_assert_int_eq(mappings[m], bf.index_mapping);
+        mu_assert_int_eq(bits[m], bf.number_bits);
+        mu_assert_int_eq(bits[m] / 8 + (bits[m] % 8 != 0), bf.bloom_length);
+        mu_assert_int_eq(7, bf.number_hashes);
+
+        int errors = 0;
+        for (int i = 0; i < 50000; ++i) {
+            char key[10] = {0};
+            sprintf(key, "%d", i);
+            bloom_filter_add_string(&bf, key);
+        }
+        for (int i = 0; i < 50000; ++i) {
+            char key[10] = {0};
+            sprintf(key, "%d", i);
+            errors += bloom_filter_check_string(&bf, key) == BLOOM_SUCCESS ? 0 : 1;
+        }
+        mu_assert_int_eq(0, errors);
+        for (int i = 50000; i < 60000; ++i) {
+            char key[10] = {0};
+            sprintf(key, "%d", i);
+            errors += bloom_filter_check_string(&bf, key) == BLOOM_SUCCESS ? 1 : 0;
+        }
+        mu_assert_int_between(30, 150, errors);
+
+        // same hash type but a different mapping is not compatible
+        BloomFilter other;
+        bloom_filter_init_options(&other, 50000, 0.01, BLOOM_HASH_XXH64, mappings[(m + 1) % 2]);
+        mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_union(&other, &other, &bf));
+        bloom_filter_destroy(&other);
+        bloom_filter_destroy(&bf);
+    }
+
+    BloomFilter bf;
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_init_options(&bf, 50000, 0.01, BLOOM_HASH_XXH64, (BloomIndexMapping)7));
+}
 
 /*******************************************************************************
 *   Test set and check
@@ -207,6 +404,712 @@ MU_TEST(test_bloom_check_failure) {
     free(hashes);
 }
 
+/*******************************************************************************
+*   Test bytes keys
+*******************************************************************************/
+MU_TEST(test_bloom_bytes_same_as_string) {
+    uint64_t str_hashes[7] = {0};
+    uint64_t byte_hashes[7] = {0};
+    bloom_filter_calculate_hashes_into(&b, "foo", 7, str_hashes);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_calculate_hashes_bytes(&b, "foo", 3, 7, byte_hashes));
+    for (int i = 0; i < 7; ++i)
+        mu_assert_int_eq(str_hashes[i], byte_hashes[i]);
+
+    BloomFilter bf;
+    bloom_filter_init_hash_type(&bf, 50000, 0.01, BLOOM_HASH_FNV1A_DOUBLE);
+    bloom_filter_calculate_hashes_into(&bf, "foo", 7, str_hashes);
+    bloom_filter_calculate_hashes_bytes(&bf, "foo", 3, 7, byte_hashes);
+    for (int i = 0; i < 7; ++i)
+        mu_assert_int_eq(str_hashes[i], byte_hashes[i]);
+
+    bloom_filter_add_bytes(&bf, "test", 4);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_string(&bf, "test"));
+    bloom_filter_destroy(&bf);
+}
+
+MU_TEST(test_bloom_bytes_embedded_nul) {
+    const char key[] = {'a', 'b', '\0', 'c', 'd'};
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_add_bytes(&b, key, 5));
+    mu_assert_int_eq(1, b.elements_added);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_bytes(&b, key, 5));
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_check_bytes(&b, key, 4));
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_check_string(&b, "ab"));
+
+    // a key in the middle of a larger buffer that is not NUL terminated
+    const char buffer[] = "xxxxtestxxxx";
+    bloom_filter_add_bytes(&b, buffer + 4, 4);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_string(&b, "test"));
+}
+
+MU_TEST(test_bloom_bytes_batch) {
+    const char *keys[] = {"this", "is", "a", "test", "of", "batches"};
+    size_t lengths[] = {4, 2, 1, 4, 2, 7};
+    unsigned char results[6] = {0};
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_add_batch(&b, keys, lengths, 3));
+    mu_assert_int_eq(3, b.elements_added);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_batch(&b, keys, lengths, 6, results));
+    unsigned char expected[] = {1, 1, 1, 0, 0, 0};
+    for (int i = 0; i < 6; ++i)
+        mu_assert_int_eq(expected[i], results[i]);
+
+    // without lengths the keys are strings
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_add_batch(&b, keys + 3, NULL, 3));
+    mu_assert_int_eq(6, b.elements_added);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_batch(&b, keys, NULL, 6, results));
+    for (int i = 0; i < 6; ++i)
+        mu_assert_int_eq(1, results[i]);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_string(&b, "batches"));
+}
+
+/* the prefetching batch must set exactly the bits of adding one key at a time */
+MU_TEST(test_bloom_batch_same_as_single) {
+    BloomFilter single, batched;
+    char **keys = (char**)calloc(1000, sizeof(char*));
+    uint64_t ints[1000];
+    bloom_filter_init_hash_type(&single, 50000, 0.01, BLOOM_HASH_XXH64);
+    bloom_filter_init_hash_type(&batched, 50000, 0.01, BLOOM_HASH_XXH64);
+    for (int i = 0; i < 1000; ++i) {
+        keys[i] = (char*)calloc(12, sizeof(char));
+        sprintf(keys[i], "key-%d", i);
+        ints[i] = i * 7919ULL;
+        bloom_filter_add_string(&single, keys[i]);
+        bloom_filter_add_u64(&single, ints[i]);
+    }
+    // batch sizes around the window size
+    size_t sizes[] = {1, 15, 16, 17, 951};
+    size_t pos = 0;
+    for (int s = 0; s < 5; ++s) {
+        mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_add_batch(&batched, (const char * const *)keys + pos, NULL, sizes[s]));
+        mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_add_batch_u64(&batched, ints + pos, sizes[s]));
+        pos += sizes[s];
+    }
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_add_batch_u64(&batched, ints, 0));
+    mu_assert_int_eq(2000, batched.elements_added);
+    mu_assert_int_eq(0, memcmp(single.bloom, batched.bloom, single.bloom_length));
+    for (int i = 0; i < 1000; ++i) {
+        free(keys[i]);
+    }
+    free(keys);
+    bloom_filter_destroy(&single);
+    bloom_filter_destroy(&batched);
+}
+
+/* interleaved lookups return the same answers as checking one key at a time */
+MU_TEST(test_bloom_check_batch_interleaved) {
+    uint64_t ints[3000];
+    char **keys = (char**)calloc(3000, sizeof(char*));
+    unsigned char results[3000], bitmap[375], bitmap_u64[375], results_u64[3000];
+    for (int i = 0; i < 3000; ++i) {
+        keys[i] = (char*)calloc(12, sizeof(char));
+        sprintf(keys[i], "%d", i);
+        ints[i] = i;
+    }
+    // a full filter so that false positives (bits checked to the end) occur too
+    bloom_filter_add_batch(&b, (const char * const *)keys, NULL, 1000);
+    bloom_filter_add_batch_u64(&b, ints, 1000);
+    for (int i = 0; i < 50000; ++i) {
+        bloom_filter_add_u64(&b, 1000000 + i);
+    }
+
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_batch(&b, (const char * const *)keys, NULL, 3000, results));
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_batch_bitmap(&b, (const char * const *)keys, NULL, 3000, bitmap));
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_batch_u64(&b, ints, 3000, results_u64));
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_batch_u64_bitmap(&b, ints, 3000, bitmap_u64));
+    int errors = 0, positives = 0;
+    for (int i = 0; i < 3000; ++i) {
+        int expected = bloom_filter_check_string(&b, keys[i]) == BLOOM_SUCCESS;
+        int expected_u64 = bloom_filter_check_u64(&b, ints[i]) == BLOOM_SUCCESS;
+        errors += results[i] == expected ? 0 : 1;
+        errors += ((bitmap[i / 8] >> (i % 8)) & 1) == expected ? 0 : 1;
+        errors += results_u64[i] == expected_u64 ? 0 : 1;
+        errors += ((bitmap_u64[i / 8] >> (i % 8)) & 1) == expected_u64 ? 0 : 1;
+        positives += expected;
+    }
+    mu_assert_int_eq(0, errors);
+    mu_check(positives > 1000 && positives < 3000);
+
+    // fewer keys than lookup slots
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_batch_u64(&b, ints, 3, results_u64));
+    mu_assert_int_eq(1, results_u64[0] & results_u64[1] & results_u64[2]);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_batch_u64(&b, ints, 0, results_u64));
+    for (int i = 0; i < 3000; ++i) {
+        free(keys[i]);
+    }
+    free(keys);
+}
+
+MU_TEST(test_bloom_check_many_filters) {
+    BloomFilter days[7], larger, fewer, other_hash, many_hashes;
+    BloomFilter *filters[9];
+    for (int d = 0; d < 7; ++d) {
+        bloom_filter_init(&days[d], 2000, 0.01);
+        filters[d] = &days[d];
+    }
+    bloom_filter_init(&larger, 20000, 0.01);  // same hashes, bits mapped again
+    filters[7] = &larger;
+    bloom_filter_init(&fewer, 2000, 0.1);  // a prefix of the key's hashes
+    filters[8] = &fewer;
+    bloom_filter_init_options(&other_hash, 2000, 0.01, BLOOM_HASH_XXH64, BLOOM_INDEX_MODULO);
+    bloom_filter_init(&many_hashes, 2000, 0.0000001);
+
+    // filters full enough that false positives are checked too
+    for (uint64_t i = 0; i < 7000; ++i) {
+        char key[24] = {0};
+        sprintf(key, "%" PRIu64 "", i);
+        bloom_filter_add_string(&days[i % 7], key);
+        bloom_filter_add_u64(&days[i % 7], i);
+        if (i % 3 == 0) {
+            bloom_filter_add_string(&larger, key);
+            bloom_filter_add_string(&fewer, key);
+            bloom_filter_add_u64(&larger, i);
+        }
+    }
+
+    BloomKey key, ints;
+    unsigned char results[9];
+    int errors = 0;
+    for (uint64_t i = 0; i < 10000; i += 7) {
+        char str[24] = {0};
+        sprintf(str, "%" PRIu64 "", i);
+        errors += bloom_key_init(&key, &days[0], str) != BLOOM_SUCCESS;
+        errors += bloom_filter_check_many_filters(&key, filters, 9, results) != BLOOM_SUCCESS;
+        for (int f = 0; f < 9; ++f) {
+            errors += results[f] != (bloom_filter_check_string(filters[f], str) == BLOOM_SUCCESS);
+        }
+        errors += bloom_key_init_u64(&ints, &days[0], i) != BLOOM_SUCCESS;
+        errors += bloom_filter_check_many_filters(&ints, filters, 8, results) != BLOOM_SUCCESS;
+        for (int f = 0; f < 8; ++f) {
+            errors += results[f] != (bloom_filter_check_u64(filters[f], i) == BLOOM_SUCCESS);
+        }
+        bloom_key_destroy(&key);
+        bloom_key_destroy(&ints);
+    }
+    mu_assert_int_eq(0, errors);
+
+    // add once, check and add the hashed key elsewhere
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_key_init_bytes(&key, &days[0], "new key", 7));
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_add_key(&days[3], &key));
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_add_key(&larger, &key));
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_key(&days[3], &key));
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_bytes(&larger, "new key", 7));
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_many_filters(&key, filters + 3, 1, results));
+    mu_assert_int_eq(1, results[0]);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_many_filters(&key, filters, 0, results));
+
+    // keys do not fit filters with another hash or more hashes
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_check_key(&other_hash, &key));
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_add_key(&many_hashes, &key));
+    filters[2] = &other_hash;
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_check_many_filters(&key, filters, 9, results));
+    bloom_key_destroy(&key);
+    bloom_filter_add_u64(&other_hash, 3);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_key_init_u64(&ints, &days[0], 3));
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_key(&other_hash, &ints));  // integer keys use one mixer
+    bloom_key_destroy(&ints);
+
+    // more hashes than are kept inline
+    mu_check(many_hashes.number_hashes > BLOOM_KEY_INLINE_HASHES);
+    bloom_filter_add_string(&many_hashes, "test");
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_key_init(&key, &many_hashes, "test"));
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_key(&many_hashes, &key));
+    mu_assert_int_eq(bloom_filter_check_string(&days[0], "test"), bloom_filter_check_key(&days[0], &key));
+    bloom_key_destroy(&key);
+
+    for (int d = 0; d < 7; ++d) {
+        bloom_filter_destroy(&days[d]);
+    }
+    bloom_filter_destroy(&larger);
+    bloom_filter_destroy(&fewer);
+    bloom_filter_destroy(&other_hash);
+    bloom_filter_destroy(&many_hashes);
+}
+
+MU_TEST(test_bloom_bulk_load) {
+    BloomFilter single, bulk;
+    uint64_t *ints = (uint64_t*)calloc(100000, sizeof(uint64_t));
+    char **keys = (char**)calloc(100000, sizeof(char*));
+    bloom_filter_init(&single, 50000, 0.01);
+    bloom_filter_init(&bulk, 50000, 0.01);
+    for (int i = 0; i < 100000; ++i) {  // more than one chunk
+        keys[i] = (char*)calloc(12, sizeof(char));
+        sprintf(keys[i], "%d", i);
+        ints[i] = i;
+        if (i < 20000) {
+            bloom_filter_add_string(&single, keys[i]);
+        }
+        bloom_filter_add_u64(&single, ints[i]);
+    }
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_bulk_load(&bulk, (const char * const *)keys, NULL, 20000));
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_bulk_load_u64(&bulk, ints, 100000));
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_bulk_load_u64(&bulk, ints, 0));
+    mu_assert_int_eq(120000, bulk.elements_added);
+    mu_assert_int_eq(0, memcmp(single.bloom, bulk.bloom, single.bloom_length));
+    bloom_filter_destroy(&bulk);
+
+    // on disk the file is the same as adding one key at a time
+    char filepath[] = "./dist/test_bloom_bulk_load.blm";
+    bloom_filter_init_on_disk(&bulk, 50000, 0.01, filepath);
+    bloom_filter_bulk_load(&bulk, (const char * const *)keys, NULL, 20000);
+    bloom_filter_bulk_load_u64(&bulk, ints, 100000);
+    bloom_filter_destroy(&bulk);
+    bloom_filter_import(&bulk, filepath);
+    mu_assert_int_eq(120000, bulk.elements_added);
+    mu_assert_int_eq(0, memcmp(single.bloom, bulk.bloom, single.bloom_length));
+    bloom_filter_destroy(&bulk);
+    remove(filepath);
+
+    for (int i = 0; i < 100000; ++i) {
+        free(keys[i]);
+    }
+    free(keys);
+    free(ints);
+    bloom_filter_destroy(&single);
+
+    // a filter large enough to be radix partitioned; more keys than one staging chunk
+    uint64_t num = 1500000;
+    ints = (uint64_t*)calloc(num, sizeof(uint64_t));
+    bloom_filter_init(&single, 60000000, 0.01);
+    bloom_filter_init(&bulk, 60000000, 0.01);
+    mu_check(bulk.bloom_length > (64 << 20));
+    for (uint64_t i = 0; i < num; ++i) {
+        ints[i] = i * 0x9E3779B97F4A7C15ULL;
+        bloom_filter_add_u64(&single, ints[i]);
+    }
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_bulk_load_u64(&bulk, ints, num));
+    mu_check(bulk.elements_added == num);
+    mu_assert_int_eq(0, memcmp(single.bloom, bulk.bloom, single.bloom_length));
+    free(ints);
+    bloom_filter_destroy(&single);
+    bloom_filter_destroy(&bulk);
+}
+
+MU_TEST(test_bloom_parallel_build) {
+    BloomFilter single, built;
+    uint64_t *ints = (uint64_t*)calloc(30000, sizeof(uint64_t));
+    char **keys = (char**)calloc(30000, sizeof(char*));
+    bloom_filter_init(&single, 50000, 0.01);
+    for (int i = 0; i < 30000; ++i) {
+        keys[i] = (char*)calloc(12, sizeof(char));
+        sprintf(keys[i], "%d", i);
+        ints[i] = i;
+        bloom_filter_add_string(&single, keys[i]);
+        bloom_filter_add_u64(&single, ints[i]);
+    }
+    for (int threads = 1; threads <= 4; threads += 3) {
+        bloom_filter_init(&built, 50000, 0.01);
+        mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_parallel_build(&built, (const char * const *)keys, NULL, 30000, threads));
+        mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_parallel_build_u64(&built, ints, 30000, threads));
+        mu_assert_int_eq(60000, built.elements_added);
+        mu_assert_int_eq(0, memcmp(single.bloom, built.bloom, single.bloom_length));
+        bloom_filter_destroy(&built);
+
+        // keys from a callback that formats them into the buffer
+        uint64_t offset = 0;
+        bloom_filter_init(&built, 50000, 0.01);
+        mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_parallel_build_callback(&built, number_key, &offset, 30000, threads));
+        bloom_filter_add_batch_u64(&built, ints, 30000);
+        mu_assert_int_eq(60000, built.elements_added);
+        mu_assert_int_eq(0, memcmp(single.bloom, built.bloom, single.bloom_length));
+        bloom_filter_destroy(&built);
+    }
+
+    for (int i = 0; i < 30000; ++i) {
+        free(keys[i]);
+    }
+    free(keys);
+    free(ints);
+    bloom_filter_destroy(&single);
+}
+
+MU_TEST(test_bloom_bytes_hash_function) {
+    BloomFilter bf;
+    unsigned char results[1] = {0};
+    const char *keys[] = {"test"};
+
+    // allocating string hashes cannot hash bytes
+    bloom_filter_init_alt(&bf, 50000, 0.01, &fake_hash);
+    mu_assert_null(bf.hash_function_bytes);
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_add_bytes(&bf, "test", 4));
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_check_bytes(&bf, "test", 4));
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_add_batch(&bf, keys, NULL, 1));
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_check_batch(&bf, keys, NULL, 1, results));
+    mu_assert_int_eq(0, bf.elements_added);
+
+    // a bytes hash is used for strings too
+    bloom_filter_set_hash_function_bytes(&bf, &fake_hash_bytes);
+    mu_assert_null(bf.hash_function);
+    mu_assert_null(bf.hash_function_noalloc);
+    uint64_t* hashes = bloom_filter_calculate_hashes(&bf, "test", 3);
+    uint64_t* expected = fake_hash(3, "test");
+    for (int i = 0; i < 3; ++i)
+        mu_assert_int_eq(expected[i], hashes[i]);
+    free(hashes);
+    free(expected);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_add_bytes(&bf, "test", 4));
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_string(&bf, "test"));
+
+    bloom_filter_set_hash_function_bytes(&bf, NULL);
+    mu_assert_not_null(bf.hash_function_bytes);
+    bloom_filter_destroy(&bf);
+}
+
+/*******************************************************************************
+*   Test integer keys
+*******************************************************************************/
+MU_TEST(test_bloom_u64) {
+    int errors = 0;
+    for (uint64_t i = 0; i < 50000; ++i) {
+        errors += bloom_filter_add_u64(&b, i * 7919) == BLOOM_SUCCESS ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+    mu_assert_int_eq(50000, b.elements_added);
+    for (uint64_t i = 0; i < 50000; ++i) {
+        errors += bloom_filter_check_u64(&b, i * 7919) == BLOOM_SUCCESS ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+
+    // false positives should be close to the requested rate
+    for (uint64_t i = 50000; i < 60000; ++i) {
+        errors += bloom_filter_check_u64(&b, i * 7919) == BLOOM_SUCCESS ? 1 : 0;
+    }
+    mu_assert_int_between(50, 150, errors);
+
+    // integers are not the same key as their string
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_check_string(&b, "7919"));
+}
+
+MU_TEST(test_bloom_u32_u128) {
+    bloom_filter_add_u32(&b, 123456);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_u32(&b, 123456));
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_u64(&b, 123456));
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_check_u32(&b, 654321));
+
+    bloom_filter_add_u128(&b, 0x0123456789abcdefULL, 0xfedcba9876543210ULL);
+    mu_assert_int_eq(2, b.elements_added);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_u128(&b, 0x0123456789abcdefULL, 0xfedcba9876543210ULL));
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_check_u128(&b, 0xfedcba9876543210ULL, 0x0123456789abcdefULL));
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_check_u128(&b, 0, 0x0123456789abcdefULL));
+    mu_assert_int_eq(2 * b.number_hashes, bloom_filter_count_set_bits(&b));
+}
+
+MU_TEST(test_bloom_u64_on_disk) {
+    char filepath[] = "./dist/test_bloom_u64_on_disk.blm";
+    BloomFilter bf;
+    bloom_filter_init_on_disk(&bf, 50000, 0.01, filepath);
+    for (uint64_t i = 0; i < 3000; ++i) {
+        bloom_filter_add_u64(&bf, i);
+    }
+    bloom_filter_destroy(&bf);
+
+    bloom_filter_import(&bf, filepath);
+    mu_assert_int_eq(3000, bf.elements_added);
+    int errors = 0;
+    for (uint64_t i = 0; i < 3000; ++i) {
+        errors += bloom_filter_check_u64(&bf, i) == BLOOM_SUCCESS ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+    bloom_filter_destroy(&bf);
+    remove(filepath);
+}
+
+MU_TEST(test_bloom_on_disk_sync_interval) {
+    char filepath[] = "./dist/test_bloom_sync_interval.blm";
+    BloomFilter bf, res;
+    bloom_filter_init_on_disk(&bf, 50000, 0.01, filepath);
+    bloom_filter_set_sync_interval(&bf, 0);
+    for (uint64_t i = 0; i < 100; ++i) {
+        bloom_filter_add_u64(&bf, i);
+    }
+    bloom_filter_import(&res, filepath);
+    mu_check(res.elements_added == 0);  // not written until synced
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_u64(&res, 99));  // the bits are in the mapping
+    bloom_filter_destroy(&res);
+
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_sync(&bf));
+    bloom_filter_import(&res, filepath);
+    mu_check(res.elements_added == 100);
+    bloom_filter_destroy(&res);
+
+    bloom_filter_set_sync_interval(&bf, 10);
+    for (uint64_t i = 100; i < 125; ++i) {
+        bloom_filter_add_u64(&bf, i);
+    }
+    bloom_filter_import(&res, filepath);
+    mu_check(res.elements_added == 120);
+    bloom_filter_destroy(&res);
+
+    bloom_filter_destroy(&bf);
+    bloom_filter_import(&res, filepath);
+    mu_check(res.elements_added == 125);
+    bloom_filter_destroy(&res);
+    remove(filepath);
+}
+
+/*******************************************************************************
+*   Thread safe inserts
+*******************************************************************************/
+typedef struct thread_range {
+    BloomFilter *bf;
+    uint64_t start;
+    uint64_t end;
+} ThreadRange;
+
+typedef struct absent_range {
+    BloomFilter *bf;
+    uint64_t num_keys;
+    unsigned char *added;
+} AbsentRange;
+
+MU_TEST(test_bloom_thread_safe_pthreads) {
+    BloomFilter single, shared;
+    bloom_filter_init(&single, 50000, 0.01);
+    bloom_filter_init(&shared, 50000, 0.01);
+    bloom_filter_set_thread_safe(&shared, 1);
+    for (uint64_t i = 0; i < 40000; ++i) {
+        char key[24] = {0};
+        sprintf(key, "%" PRIu64 "", i);
+        bloom_filter_add_string(&single, key);
+        bloom_filter_add_u64(&single, i);
+    }
+
+    pthread_t threads[4];
+    ThreadRange ranges[4];
+    for (int t = 0; t < 4; ++t) {
+        ranges[t].bf = &shared;
+        ranges[t].start = t * 10000;
+        ranges[t].end = (t + 1) * 10000;
+        pthread_create(&threads[t], NULL, add_thread_range, &ranges[t]);
+    }
+    for (int t = 0; t < 4; ++t) {
+        pthread_join(threads[t], NULL);
+    }
+    mu_check(bloom_filter_elements_added(&shared) == 80000);
+    mu_check(shared.elements_added == 80000);
+    mu_assert_int_eq(0, memcmp(single.bloom, shared.bloom, single.bloom_length));
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_string(&shared, "39999"));
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_u64(&shared, 39999));
+    uint64_t keys[64];
+    unsigned char found[64];
+    int missing = 0;
+    for (int i = 0; i < 64; ++i) {
+        keys[i] = (uint64_t)i * 613;
+    }
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_batch_u64(&shared, keys, 64, found));
+    for (int i = 0; i < 64; ++i) {
+        missing += found[i] != 1;
+    }
+    mu_assert_int_eq(0, missing);
+
+    // re-initializing turns thread safety back off
+    bloom_filter_destroy(&shared);
+    mu_assert_int_eq(0, shared.__thread_safe);
+    bloom_filter_destroy(&single);
+}
+
+MU_TEST(test_bloom_track_bits) {
+    BloomFilter bf, other, scanned;
+    bloom_filter_init(&bf, 50000, 0.01);
+    bloom_filter_init(&other, 50000, 0.01);
+    bloom_filter_init(&scanned, 50000, 0.01);
+    for (uint64_t i = 0; i < 1000; ++i) {
+        bloom_filter_add_u64(&bf, i);
+    }
+    uint64_t tracked = bloom_filter_count_set_bits(&bf);
+    bloom_filter_set_track_bits(&bf, 1);  // counts the bits already set
+    mu_check(bloom_filter_count_set_bits(&bf) == tracked);
+
+    uint64_t *ints = (uint64_t*)calloc(20000, sizeof(uint64_t));
+    for (uint64_t i = 0; i < 20000; ++i) {
+        ints[i] = i + 1000;
+        bloom_filter_add_u64(&other, i);
+    }
+    bloom_filter_add_string(&bf, "test");
+    bloom_filter_add_batch_u64(&bf, ints, 10000);
+    bloom_filter_bulk_load_u64(&bf, ints + 10000, 5000);
+    bloom_filter_parallel_build_u64(&bf, ints + 15000, 5000, 2);
+    tracked = bloom_filter_count_set_bits(&bf);
+    bloom_filter_set_track_bits(&bf, 0);
+    mu_check(tracked == bloom_filter_count_set_bits(&bf));
+    bloom_filter_set_track_bits(&bf, 1);
+    mu_check(tracked == bloom_filter_count_set_bits(&bf));
+    mu_check(bloom_filter_estimate_elements(&bf) > 20000);
+
+    // recounted after a union or intersection
+    bloom_filter_set_track_bits(&scanned, 1);
+    bloom_filter_union(&scanned, &bf, &other);
+    tracked = bloom_filter_count_set_bits(&scanned);
+    mu_check(tracked == bloom_filter_count_union_bits_set(&bf, &other));
+    bloom_filter_intersect(&scanned, &bf, &other);
+    mu_check(bloom_filter_count_set_bits(&scanned) == bloom_filter_count_intersection_bits_set(&bf, &other));
+    BloomFilter *filters[2] = {&bf, &other};
+    bloom_filter_union_many(&scanned, filters, 2);
+    mu_check(bloom_filter_count_set_bits(&scanned) == tracked);
+    bloom_filter_add_string(&scanned, "not in either filter");
+    bloom_filter_set_track_bits(&scanned, 0);
+    tracked = bloom_filter_count_set_bits(&scanned);
+    bloom_filter_set_track_bits(&scanned, 1);
+    mu_check(bloom_filter_count_set_bits(&scanned) == tracked);
+
+    bloom_filter_clear(&bf);
+    mu_check(bloom_filter_count_set_bits(&bf) == 0);
+    bloom_filter_add_u64(&bf, 1);
+    mu_check(bloom_filter_count_set_bits(&bf) <= bf.number_hashes);
+
+    free(ints);
+    bloom_filter_destroy(&bf);
+    bloom_filter_destroy(&other);
+    bloom_filter_destroy(&scanned);
+}
+
+MU_TEST(test_bloom_track_bits_pthreads) {
+    BloomFilter shared;
+    bloom_filter_init(&shared, 50000, 0.01);
+    bloom_filter_set_thread_safe(&shared, 1);
+    bloom_filter_set_track_bits(&shared, 1);
+
+    pthread_t threads[4];
+    ThreadRange ranges[4];
+    for (int t = 0; t < 4; ++t) {
+        ranges[t].bf = &shared;
+        ranges[t].start = t * 10000;
+        ranges[t].end = (t + 1) * 10000;
+        pthread_create(&threads[t], NULL, add_thread_range, &ranges[t]);
+    }
+    for (int t = 0; t < 4; ++t) {
+        pthread_join(threads[t], NULL);
+    }
+    uint64_t tracked = bloom_filter_count_set_bits(&shared);
+    bloom_filter_set_track_bits(&shared, 0);
+    mu_check(tracked == bloom_filter_count_set_bits(&shared));
+    bloom_filter_destroy(&shared);
+}
+
+MU_TEST(test_bloom_add_if_absent) {
+    BloomFilter bf, checked;
+    bloom_filter_init(&bf, 50000, 0.01);
+    bloom_filter_init(&checked, 50000, 0.01);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_add_if_absent(&bf, "test"));
+    mu_assert_int_eq(BLOOM_PRESENT, bloom_filter_add_if_absent(&bf, "test"));
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_add_bytes_if_absent(&bf, "bytes", 5));
+    mu_assert_int_eq(BLOOM_PRESENT, bloom_filter_add_bytes_if_absent(&bf, "bytes", 5));
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_string(&bf, "test"));
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_bytes(&bf, "bytes", 5));
+    mu_check(bf.elements_added == 2);  // keys already present are not counted
+
+    // a key repeated within a batch is new only the first time
+    const char *keys[5] = {"a", "b", "a", "test", "c"};
+    unsigned char results[5];
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_add_batch_if_absent(&bf, keys, NULL, 5, results));
+    mu_assert_int_eq(1, results[0]);
+    mu_assert_int_eq(1, results[1]);
+    mu_assert_int_eq(0, results[2]);
+    mu_assert_int_eq(0, results[3]);
+    mu_assert_int_eq(1, results[4]);
+    mu_check(bf.elements_added == 5);
+
+    // the batch agrees with a check before each add, across many windows
+    uint64_t *ints = (uint64_t*)calloc(3000, sizeof(uint64_t));
+    unsigned char *found = (unsigned char*)calloc(3000, sizeof(unsigned char));
+    int errors = 0;
+    for (uint64_t i = 0; i < 3000; ++i) {
+        ints[i] = i % 2000;
+    }
+    bloom_filter_set_track_bits(&bf, 1);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_add_batch_u64_if_absent(&bf, ints, 3000, found));
+    for (uint64_t i = 0; i < 3000; ++i) {
+        int present = bloom_filter_check_u64(&checked, ints[i]) == BLOOM_SUCCESS;
+        bloom_filter_add_u64(&checked, ints[i]);
+        errors += (found[i] == present);
+    }
+    mu_assert_int_eq(0, errors);
+    uint64_t tracked = bloom_filter_count_set_bits(&bf);
+    bloom_filter_set_track_bits(&bf, 0);
+    mu_check(tracked == bloom_filter_count_set_bits(&bf));
+    free(ints);
+    free(found);
+    bloom_filter_destroy(&bf);
+    bloom_filter_destroy(&checked);
+}
+
+MU_TEST(test_bloom_add_if_absent_pthreads) {
+    // the bits are set atomically with or without thread safe mode
+    for (int thread_safe = 0; thread_safe < 2; ++thread_safe) {
+        BloomFilter shared;
+        bloom_filter_init(&shared, 50000, 0.01);
+        bloom_filter_set_thread_safe(&shared, thread_safe);
+
+        // every thread adds the same keys; each key must be new for at least one of them
+        pthread_t threads[4];
+        AbsentRange ranges[4];
+        for (int t = 0; t < 4; ++t) {
+            ranges[t].bf = &shared;
+            ranges[t].num_keys = 20000;
+            ranges[t].added = (unsigned char*)calloc(20000, sizeof(unsigned char));
+            pthread_create(&threads[t], NULL, add_if_absent_range, &ranges[t]);
+        }
+        for (int t = 0; t < 4; ++t) {
+            pthread_join(threads[t], NULL);
+        }
+        int missed = 0, errors = 0;
+        uint64_t total = 0;
+        for (uint64_t i = 0; i < 20000; ++i) {
+            char key[24] = {0};
+            sprintf(key, "%" PRIu64 "", i);
+            int times = ranges[0].added[i] + ranges[1].added[i] + ranges[2].added[i] + ranges[3].added[i];
+            missed += (times == 0);
+            total += times;
+            errors += bloom_filter_check_string(&shared, key) != BLOOM_SUCCESS;
+        }
+        mu_assert_int_eq(0, missed);
+        mu_assert_int_eq(0, errors);
+        if (thread_safe) {
+            mu_check(bloom_filter_elements_added(&shared) == total);
+        }
+        for (int t = 0; t < 4; ++t) {
+            free(ranges[t].added);
+        }
+        bloom_filter_destroy(&shared);
+    }
+}
+
+MU_TEST(test_bloom_thread_safe_count_exported) {
+    char filepath[] = "./dist/test_bloom_thread_safe.blm";
+    BloomFilter bf, res;
+    bloom_filter_init(&bf, 50000, 0.01);
+    bloom_filter_set_thread_safe(&bf, 1);
+    for (uint64_t i = 0; i < 12345; ++i) {
+        bloom_filter_add_u64(&bf, i);
+    }
+    const char *keys[3] = {"a", "b", "c"};
+    bloom_filter_add_batch(&bf, keys, NULL, 3);
+    // the adds are held in the per thread counts until read
+    mu_check(bf.elements_added == 0);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_export(&bf, filepath));
+    mu_check(bf.elements_added == 12348);
+
+    bloom_filter_add_u64(&bf, 12345);
+    bloom_filter_set_thread_safe(&bf, 0);  // turning it off folds the count
+    mu_check(bf.elements_added == 12349);
+    bloom_filter_destroy(&bf);
+
+    bloom_filter_import(&res, filepath);
+    mu_check(res.elements_added == 12348);
+    bloom_filter_destroy(&res);
+
+    // on disk the trailer is written when the count is folded
+    bloom_filter_init_on_disk(&bf, 50000, 0.01, filepath);
+    bloom_filter_set_thread_safe(&bf, 1);
+    for (uint64_t i = 0; i < 1000; ++i) {
+        bloom_filter_add_u64(&bf, i);
+    }
+    bloom_filter_destroy(&bf);
+    bloom_filter_import(&res, filepath);
+    mu_check(res.elements_added == 1000);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_u64(&res, 999));
+    bloom_filter_destroy(&res);
+    remove(filepath);
+}
+
 /*******************************************************************************
 *   Test clear/reset
 *******************************************************************************/
@@ -288,6 +1191,62 @@ MU_TEST(test_bloom_current_false_positive_rate) {
     mu_assert_double_between(0.00990, 0.01010, bloom_filter_current_false_positive_rate(&b));
 }
 
+MU_TEST(test_bloom_storage_aligned) {
+    mu_assert_int_eq(0, (int)((uintptr_t)b.bloom % 64));
+    // padding past bloom_length to the next cache line is zero and unused
+    unsigned long padded = (b.bloom_length + 63) / 64 * 64;
+    for (int i = 0; i < 5000; ++i) {
+        char key[10] = {0};
+        sprintf(key, "%d", i);
+        bloom_filter_add_string(&b, key);
+    }
+    int errors = 0;
+    for (unsigned long i = b.bloom_length; i < padded; ++i) {
+        errors += b.bloom[i] != 0 ? 1 : 0;
+    }
+    mu_assert_int_eq(0, errors);
+
+    // word and byte tails agree with a bit by bit count
+    uint64_t bits = 0;
+    for (uint64_t i = 0; i < b.number_bits; ++i) {
+        bits += (b.bloom[i / 8] >> (i % 8)) & 1;
+    }
+    mu_check(bits == bloom_filter_count_set_bits(&b));
+    mu_check(bits == bloom_filter_count_union_bits_set(&b, &b));
+    mu_check(bits == bloom_filter_count_intersection_bits_set(&b, &b));
+}
+
+MU_TEST(test_bloom_popcount_kernels) {
+    BloomPopcountKernel kernels[] = {BLOOM_POPCOUNT_POPCNT, BLOOM_POPCOUNT_AVX2, BLOOM_POPCOUNT_AVX512};
+    uint64_t sizes[] = {10, 333, 5000, 50000};  // odd word counts exercise the kernel tails
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_set_popcount_kernel(BLOOM_POPCOUNT_AUTO));
+    mu_check(bloom_filter_get_popcount_kernel() != BLOOM_POPCOUNT_AUTO);
+    BloomPopcountKernel detected = bloom_filter_get_popcount_kernel();
+
+    int errors = 0;
+    for (int s = 0; s < 4; ++s) {
+        BloomFilter bf;
+        bloom_filter_init(&bf, sizes[s], 0.01);
+        for (uint64_t i = 0; i < sizes[s]; ++i) {
+            bloom_filter_add_u64(&bf, i);
+        }
+        mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_set_popcount_kernel(BLOOM_POPCOUNT_PORTABLE));
+        uint64_t expected = bloom_filter_count_set_bits(&bf);
+        for (int k = 0; k < 3; ++k) {
+            if (bloom_filter_set_popcount_kernel(kernels[k]) == BLOOM_SUCCESS) {
+                mu_assert_int_eq(kernels[k], bloom_filter_get_popcount_kernel());
+                errors += bloom_filter_count_set_bits(&bf) == expected ? 0 : 1;
+            }
+        }
+        bloom_filter_destroy(&bf);
+    }
+    mu_assert_int_eq(0, errors);
+
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_set_popcount_kernel((BloomPopcountKernel)99));
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_set_popcount_kernel(BLOOM_POPCOUNT_AUTO));
+    mu_assert_int_eq(detected, bloom_filter_get_popcount_kernel());
+}
+
 MU_TEST(test_bloom_count_set_bits) {
     mu_assert_int_eq(0, bloom_filter_count_set_bits(&b));
 
@@ -367,6 +1326,26 @@ MU_TEST(test_bloom_set_elements_to_estimated) {
     mu_assert_int_eq(9792, bloom_filter_estimate_elements(&b));
     bloom_filter_set_elements_to_estimated(&b);
     mu_assert_int_eq(9792, b.elements_added);
+
+    // adds counted in the thread safe stripes are replaced too
+    BloomFilter bf, other;
+    bloom_filter_init(&bf, 50000, 0.01);
+    bloom_filter_init(&other, 50000, 0.01);
+    bloom_filter_set_thread_safe(&bf, 1);
+    for (uint64_t i = 0; i < 100; ++i) {
+        bloom_filter_add_u64(&bf, i);
+    }
+    bloom_filter_set_elements_to_estimated(&bf);
+    mu_assert_int_between(95, 105, (int)bloom_filter_elements_added(&bf));
+    for (uint64_t i = 100; i < 200; ++i) {
+        bloom_filter_add_u64(&bf, i);
+    }
+    bloom_filter_union(&bf, &bf, &other);
+    mu_assert_int_between(190, 210, (int)bloom_filter_elements_added(&bf));
+    bloom_filter_intersect(&bf, &bf, &bf);
+    mu_assert_int_between(190, 210, (int)bloom_filter_elements_added(&bf));
+    bloom_filter_destroy(&bf);
+    bloom_filter_destroy(&other);
 }
 
 MU_TEST(test_bloom_set_elements_to_estimated_on_disk) {
@@ -523,6 +1502,114 @@ MU_TEST(test_bloom_import_on_disk_fail) {
     mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_import_on_disk(&bf, filepath));
 }
 
+MU_TEST(test_bloom_export_import_hash_type) {
+    char filepath[] = "./dist/test_bloom_export_hash_type.blm";
+    BloomFilter bf;
+    bloom_filter_init_hash_type(&bf, 50000, 0.01, BLOOM_HASH_FNV1A_DOUBLE);
+    for (int i = 0; i < 5000; ++i) {
+        char key[10] = {0};
+        sprintf(key, "%d", i);
+        bloom_filter_add_string(&bf, key);
+    }
+    mu_assert_int_eq(59935, bloom_filter_export_size(&bf));
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_export(&bf, filepath));
+    mu_assert_int_eq(fsize(filepath), 59935);
+
+    BloomFilter imp, imp_disk;
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_import(&imp, filepath));
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_import_on_disk(&imp_disk, filepath));
+    mu_assert_int_eq(BLOOM_HASH_FNV1A_DOUBLE, imp.hash_type);
+    mu_assert_int_eq(BLOOM_HASH_FNV1A_DOUBLE, imp_disk.hash_type);
+    mu_assert_int_eq(59907, imp.bloom_length);
+    mu_assert_int_eq(5000, imp.elements_added);
+    mu_assert_int_eq(5000, imp_disk.elements_added);
+
+    int errors = 0;
+    for (int i = 0; i < 5000; ++i) {
+        char key[10] = {0};
+        sprintf(key, "%d", i);
+        errors += bloom_filter_check_string(&imp, key) == BLOOM_SUCCESS ? 0 : 1;
+        errors += bloom_filter_check_string(&imp_disk, key) == BLOOM_SUCCESS ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_union(&imp, &imp, &bf));
+
+    // hex strings keep the hash type as well
+    char* hex = bloom_filter_export_hex_string(&bf);
+    mu_assert_int_eq(59935 * 2, strlen(hex));
+    BloomFilter imp_hex;
+    bloom_filter_import_hex_string(&imp_hex, hex);
+    mu_assert_int_eq(BLOOM_HASH_FNV1A_DOUBLE, imp_hex.hash_type);
+    mu_assert_int_eq(5000, imp_hex.elements_added);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_string(&imp_hex, "4999"));
+    free(hex);
+
+    bloom_filter_destroy(&bf);
+    bloom_filter_destroy(&imp);
+    bloom_filter_destroy(&imp_disk);
+    bloom_filter_destroy(&imp_hex);
+    remove(filepath);
+}
+
+MU_TEST(test_bloom_on_disk_hash_type) {
+    char filepath[] = "./dist/test_bloom_on_disk_hash_type.blm";
+    BloomFilter bf;
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_init_on_disk_hash_type(&bf, 50000, 0.01, filepath, BLOOM_HASH_FNV1A_DOUBLE));
+    mu_assert_int_eq(BLOOM_HASH_FNV1A_DOUBLE, bf.hash_type);
+    for (int i = 0; i < 3000; ++i) {
+        char key[10] = {0};
+        sprintf(key, "%d", i);
+        bloom_filter_add_string(&bf, key);
+    }
+    bloom_filter_destroy(&bf);
+    mu_assert_int_eq(fsize(filepath), 59935);
+
+    bloom_filter_import(&bf, filepath);
+    mu_assert_int_eq(BLOOM_HASH_FNV1A_DOUBLE, bf.hash_type);
+    mu_assert_int_eq(3000, bf.elements_added);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_string(&bf, "2999"));
+    bloom_filter_destroy(&bf);
+    remove(filepath);
+}
+
+MU_TEST(test_bloom_export_import_index_mapping) {
+    char filepath[] = "./dist/test_bloom_export_index_mapping.blm";
+    BloomFilter bf;
+    bloom_filter_init_on_disk_options(&bf, 50000, 0.01, filepath, BLOOM_HASH_MURMUR3_128, BLOOM_INDEX_POW2);
+    mu_assert_int_eq(65564, bloom_filter_export_size(&bf));
+    for (int i = 0; i < 5000; ++i) {
+        char key[10] = {0};
+        sprintf(key, "%d", i);
+        bloom_filter_add_string(&bf, key);
+    }
+    bloom_filter_destroy(&bf);
+    mu_assert_int_eq(fsize(filepath), 65564);
+
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_import(&bf, filepath));
+    mu_assert_int_eq(BLOOM_HASH_MURMUR3_128, bf.hash_type);
+    mu_assert_int_eq(BLOOM_INDEX_POW2, bf.index_mapping);
+    mu_assert_int_eq(524288, bf.number_bits);
+    mu_assert_int_eq(5000, bf.elements_added);
+    int errors = 0;
+    for (int i = 0; i < 5000; ++i) {
+        char key[10] = {0};
+        sprintf(key, "%d", i);
+        errors += bloom_filter_check_string(&bf, key) == BLOOM_SUCCESS ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+
+    char* hex = bloom_filter_export_hex_string(&bf);
+    BloomFilter imp;
+    bloom_filter_import_hex_string(&imp, hex);
+    mu_assert_int_eq(BLOOM_INDEX_POW2, imp.index_mapping);
+    mu_assert_int_eq(524288, imp.number_bits);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_check_string(&imp, "4999"));
+    free(hex);
+    bloom_filter_destroy(&imp);
+    bloom_filter_destroy(&bf);
+    remove(filepath);
+}
+
 MU_TEST(test_bloom_export_hex) {
     char hex_start[] = "80202010000000008008068000001000800800000200800080220000200000000000002002000002";
     char hex_end[] = "1000000004021000000200601000000040020100000000000000c35000000000000013883c23d70a";
@@ -791,6 +1878,829 @@ MU_TEST(test_bloom_filter_jaccard) {
     bloom_filter_destroy(&z);
 }
 
+MU_TEST(test_bloom_filter_pair_counts) {
+    BloomPopcountKernel kernels[] = {BLOOM_POPCOUNT_PORTABLE, BLOOM_POPCOUNT_POPCNT, BLOOM_POPCOUNT_AVX2, BLOOM_POPCOUNT_AVX512};
+    BloomFilter bf1, bf2, res;
+    BloomPairCounts counts;
+    bloom_filter_init(&bf1, 50000, 0.01);
+    bloom_filter_init(&bf2, 50000, 0.01);
+    bloom_filter_init(&res, 50000, 0.01);
+    for (uint64_t i = 0; i < 20000; ++i) {
+        bloom_filter_add_u64(&bf1, i);
+        bloom_filter_add_u64(&bf2, i + 10000);
+    }
+    bloom_filter_union(&res, &bf1, &bf2);
+    uint64_t union_bits = bloom_filter_count_set_bits(&res);
+    bloom_filter_intersect(&res, &bf1, &bf2);
+    uint64_t intersection_bits = bloom_filter_count_set_bits(&res);
+
+    int errors = 0;
+    for (int k = 0; k < 4; ++k) {
+        if (bloom_filter_set_popcount_kernel(kernels[k]) == BLOOM_SUCCESS) {
+            mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_count_pair_bits_set(&bf1, &bf2, &counts));
+            errors += counts.bits_a == bloom_filter_count_set_bits(&bf1) ? 0 : 1;
+            errors += counts.bits_b == bloom_filter_count_set_bits(&bf2) ? 0 : 1;
+            errors += counts.bits_union == union_bits ? 0 : 1;
+            errors += counts.bits_intersection == intersection_bits ? 0 : 1;
+        }
+    }
+    bloom_filter_set_popcount_kernel(BLOOM_POPCOUNT_AUTO);
+    mu_assert_int_eq(0, errors);
+    mu_check(bloom_filter_count_union_bits_set(&bf1, &bf2) == union_bits);
+    mu_check(bloom_filter_count_intersection_bits_set(&bf1, &bf2) == intersection_bits);
+    mu_assert_double_eq((float)intersection_bits / union_bits, bloom_filter_jaccard_index(&bf1, &bf2));
+
+    // half of the elements of each are in the other
+    uint64_t est = bloom_filter_estimate_intersection_elements(&bf1, &bf2);
+    mu_check(est > 9500 && est < 10500);
+    est = bloom_filter_estimate_union_elements(&bf1, &bf2);
+    mu_check(est > 29000 && est < 31000);
+    float containment = bloom_filter_containment(&bf1, &bf2);
+    mu_check(containment > 0.5 && containment < 0.6);
+
+    // everything in res is in bf1
+    bloom_filter_clear(&res);
+    for (uint64_t i = 0; i < 5000; ++i) {
+        bloom_filter_add_u64(&res, i);
+    }
+    mu_assert_double_eq(1.0, bloom_filter_containment(&res, &bf1));
+    mu_check(bloom_filter_containment(&bf1, &res) < 0.5);
+
+    bloom_filter_destroy(&bf1);
+    bloom_filter_destroy(&bf2);
+    bloom_filter_destroy(&res);
+}
+
+MU_TEST(test_bloom_filter_union_intersect_many) {
+    char filepath[] = "./dist/test_bloom_union_many.blm";
+    BloomFilter bfs[5], chained, res, other;
+    BloomFilter *filters[5];  // large enough for 2 bulk threads
+    for (int f = 0; f < 5; ++f) {
+        if (f == 4) {
+            bloom_filter_init_on_disk(&bfs[f], 600000, 0.01, filepath);
+        } else {
+            bloom_filter_init(&bfs[f], 600000, 0.01);
+        }
+        for (uint64_t i = 0; i < 40000; ++i) {
+            bloom_filter_add_u64(&bfs[f], i + f * 10000);
+        }
+        filters[f] = &bfs[f];
+    }
+    bloom_filter_init(&chained, 600000, 0.01);
+    bloom_filter_init(&res, 600000, 0.01);
+
+    for (int threads = 1; threads <= 3; threads += 2) {
+        bloom_filter_set_bulk_threads(threads);
+        bloom_filter_union(&chained, filters[0], filters[1]);
+        for (int f = 2; f < 5; ++f) {
+            bloom_filter_union(&chained, &chained, filters[f]);
+        }
+        mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_union_many(&res, filters, 5));
+        mu_assert_int_eq(0, memcmp(chained.bloom, res.bloom, res.bloom_length));
+        mu_check(res.elements_added == chained.elements_added);
+
+        bloom_filter_intersect(&chained, filters[0], filters[1]);
+        for (int f = 2; f < 5; ++f) {
+            bloom_filter_intersect(&chained, &chained, filters[f]);
+        }
+        mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_intersect_many(&res, filters, 5));
+        mu_assert_int_eq(0, memcmp(chained.bloom, res.bloom, res.bloom_length));
+        mu_check(res.elements_added == chained.elements_added);
+    }
+    bloom_filter_set_bulk_threads(1);
+
+    // the result may be one of the inputs
+    bloom_filter_union(&chained, filters[0], filters[1]);
+    bloom_filter_union(&chained, &chained, filters[2]);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_union_many(filters[2], filters, 3));
+    mu_assert_int_eq(0, memcmp(chained.bloom, filters[2]->bloom, chained.bloom_length));
+
+    // adds counted in the thread safe stripes are replaced, with or without tracking bits
+    for (int track = 0; track < 2; ++track) {
+        BloomFilter bf, empty;
+        bloom_filter_init(&bf, 50000, 0.01);
+        bloom_filter_init(&empty, 50000, 0.01);
+        bloom_filter_set_thread_safe(&bf, 1);
+        bloom_filter_set_track_bits(&bf, track);
+        for (uint64_t i = 0; i < 100; ++i) {
+            bloom_filter_add_u64(&bf, i);
+        }
+        BloomFilter *pair[2] = {&bf, &empty};
+        mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_union_many(&bf, pair, 2));
+        mu_assert_int_between(95, 105, (int)bloom_filter_elements_added(&bf));
+        pair[1] = &bf;
+        mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_intersect_many(&bf, pair, 2));
+        mu_assert_int_between(95, 105, (int)bloom_filter_elements_added(&bf));
+        bloom_filter_destroy(&bf);
+        bloom_filter_destroy(&empty);
+    }
+
+    bloom_filter_init(&other, 100000, 0.01);
+    filters[3] = &other;
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_union_many(&res, filters, 5));
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_intersect_many(&res, filters, 0));
+
+    for (int f = 0; f < 5; ++f) {
+        bloom_filter_destroy(&bfs[f]);
+    }
+    bloom_filter_destroy(&other);
+    bloom_filter_destroy(&chained);
+    bloom_filter_destroy(&res);
+    remove(filepath);
+}
+
+MU_TEST(test_bloom_filter_bulk_threads) {
+    BloomFilter bf1, bf2, serial, threaded;
+    bloom_filter_init(&bf1, 2000000, 0.01);  // about 2.3 MB; enough for several threads
+    bloom_filter_init(&bf2, 2000000, 0.01);
+    bloom_filter_init(&serial, 2000000, 0.01);
+    bloom_filter_init(&threaded, 2000000, 0.01);
+    for (uint64_t i = 0; i < 300000; ++i) {
+        bloom_filter_add_u64(&bf1, i);
+        bloom_filter_add_u64(&bf2, i + 150000);
+    }
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_set_bulk_threads(0));
+    mu_assert_int_eq(1, bloom_filter_get_bulk_threads());
+
+    uint64_t set_bits = bloom_filter_count_set_bits(&bf1);
+    uint64_t union_bits = bloom_filter_count_union_bits_set(&bf1, &bf2);
+    uint64_t intersection_bits = bloom_filter_count_intersection_bits_set(&bf1, &bf2);
+    bloom_filter_union(&serial, &bf1, &bf2);
+
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_set_bulk_threads(3));
+    mu_assert_int_eq(3, bloom_filter_get_bulk_threads());
+    mu_check(bloom_filter_count_set_bits(&bf1) == set_bits);
+    mu_check(bloom_filter_count_union_bits_set(&bf1, &bf2) == union_bits);
+    mu_check(bloom_filter_count_intersection_bits_set(&bf1, &bf2) == intersection_bits);
+    bloom_filter_union(&threaded, &bf1, &bf2);
+    mu_assert_int_eq(0, memcmp(serial.bloom, threaded.bloom, serial.bloom_length));
+    mu_check(serial.elements_added == threaded.elements_added);
+
+    bloom_filter_intersect(&threaded, &bf1, &bf2);
+    bloom_filter_set_bulk_threads(1);
+    bloom_filter_intersect(&serial, &bf1, &bf2);
+    mu_assert_int_eq(0, memcmp(serial.bloom, threaded.bloom, serial.bloom_length));
+
+    bloom_filter_set_bulk_threads(3);
+    bloom_filter_clear(&threaded);
+    mu_check(bloom_filter_count_set_bits(&threaded) == 0);
+    bloom_filter_set_bulk_threads(1);
+
+    bloom_filter_destroy(&bf1);
+    bloom_filter_destroy(&bf2);
+    bloom_filter_destroy(&serial);
+    bloom_filter_destroy(&threaded);
+}
+
+/*******************************************************************************
+*   Blocked Bloom Filter
+*******************************************************************************/
+MU_TEST(test_blocked_bloom_setup) {
+    BlockedBloomFilter bb;
+    mu_assert_int_eq(BLOOM_SUCCESS, blocked_bloom_filter_init(&bb, 50000, 0.01));
+    mu_assert_int_eq(50000, bb.estimated_elements);
+    mu_assert_int_eq(6, bb.number_hashes);
+    mu_assert_int_eq(969, bb.number_blocks);
+    mu_assert_int_eq(969 * 512, bb.number_bits);
+    mu_assert_int_eq(0, (int)((uintptr_t)bb.bloom % 64));
+    // larger than a standard bloom filter to make up for the uneven blocks
+    mu_check(bb.number_bits > b.number_bits);
+    mu_check(blocked_bloom_filter_false_positive_rate(50000, bb.number_blocks, bb.number_hashes) <= 0.01);
+    // and no larger than needed
+    for (unsigned int k = 5; k <= 8; ++k) {
+        mu_check(blocked_bloom_filter_false_positive_rate(50000, bb.number_blocks - 1, k) > 0.01);
+    }
+    mu_check(blocked_bloom_filter_false_positive_rate(50000, b.number_bits / 512, bb.number_hashes) > 0.01);
+    mu_assert_int_eq(0, blocked_bloom_filter_count_set_bits(&bb));
+    blocked_bloom_filter_destroy(&bb);
+    mu_assert_null(bb.bloom);
+
+    mu_assert_int_eq(BLOOM_FAILURE, blocked_bloom_filter_init(&bb, 0, 0.01));
+    mu_assert_int_eq(BLOOM_FAILURE, blocked_bloom_filter_init(&bb, 50000, 1.0));
+}
+
+MU_TEST(test_blocked_bloom_add_check) {
+    BlockedBloomFilter bb;
+    blocked_bloom_filter_init(&bb, 50000, 0.01);
+    for (int i = 0; i < 50000; ++i) {
+        char key[10] = {0};
+        sprintf(key, "%d", i);
+        blocked_bloom_filter_add_string(&bb, key);
+    }
+    mu_assert_int_eq(50000, bb.elements_added);
+
+    int errors = 0, same = 0;
+    for (int i = 0; i < 50000; ++i) {
+        char key[10] = {0};
+        sprintf(key, "%d", i);
+        errors += blocked_bloom_filter_check_string(&bb, key) == BLOOM_SUCCESS ? 0 : 1;
+        same += blocked_bloom_filter_check_bytes(&bb, key, strlen(key)) == BLOOM_SUCCESS ? 1 : 0;
+    }
+    mu_assert_int_eq(0, errors);
+    mu_assert_int_eq(50000, same);
+
+    int false_positives = 0;
+    for (int i = 50000; i < 150000; ++i) {
+        char key[10] = {0};
+        sprintf(key, "%d", i);
+        false_positives += blocked_bloom_filter_check_string(&bb, key) == BLOOM_SUCCESS ? 1 : 0;
+    }
+    mu_check(false_positives < 1200);  // 0.01 of 100000 with some slack
+    mu_check(blocked_bloom_filter_current_false_positive_rate(&bb) <= 0.01);
+    blocked_bloom_filter_destroy(&bb);
+}
+
+MU_TEST(test_blocked_bloom_u64) {
+    BlockedBloomFilter bb;
+    blocked_bloom_filter_init(&bb, 50000, 0.01);
+    for (uint64_t i = 0; i < 50000; ++i) {
+        blocked_bloom_filter_add_u64(&bb, i * 0x100000001ULL);
+    }
+    int errors = 0, false_positives = 0;
+    for (uint64_t i = 0; i < 50000; ++i) {
+        errors += blocked_bloom_filter_check_u64(&bb, i * 0x100000001ULL) == BLOOM_SUCCESS ? 0 : 1;
+        false_positives += blocked_bloom_filter_check_u64(&bb, i * 0x100000001ULL + 1) == BLOOM_SUCCESS ? 1 : 0;
+    }
+    mu_assert_int_eq(0, errors);
+    mu_check(false_positives < 600);
+
+    blocked_bloom_filter_clear(&bb);
+    mu_assert_int_eq(0, bb.elements_added);
+    mu_assert_int_eq(0, blocked_bloom_filter_count_set_bits(&bb));
+    mu_assert_int_eq(BLOOM_FAILURE, blocked_bloom_filter_check_u64(&bb, 0));
+    blocked_bloom_filter_destroy(&bb);
+}
+
+MU_TEST(test_blocked_bloom_union) {
+    BlockedBloomFilter x, y, z, other;
+    blocked_bloom_filter_init(&x, 5000, 0.01);
+    blocked_bloom_filter_init(&y, 5000, 0.01);
+    blocked_bloom_filter_init(&z, 5000, 0.01);
+    blocked_bloom_filter_init(&other, 5000, 0.001);
+    for (uint64_t i = 0; i < 2500; ++i) {
+        blocked_bloom_filter_add_u64(&x, i);
+        blocked_bloom_filter_add_u64(&y, i + 2500);
+    }
+    mu_assert_int_eq(BLOOM_FAILURE, blocked_bloom_filter_union(&z, &x, &other));
+    mu_assert_int_eq(BLOOM_SUCCESS, blocked_bloom_filter_union(&z, &x, &y));
+    int errors = 0;
+    for (uint64_t i = 0; i < 5000; ++i) {
+        errors += blocked_bloom_filter_check_u64(&z, i) == BLOOM_SUCCESS ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+    mu_check(z.elements_added > 4800 && z.elements_added < 5200);
+    blocked_bloom_filter_destroy(&x);
+    blocked_bloom_filter_destroy(&y);
+    blocked_bloom_filter_destroy(&z);
+    blocked_bloom_filter_destroy(&other);
+}
+
+MU_TEST(test_blocked_bloom_export_import) {
+    char filepath[] = "./dist/test_blocked_bloom_export.blm";
+    BlockedBloomFilter bb, imp;
+    blocked_bloom_filter_init(&bb, 50000, 0.01);
+    for (int i = 0; i < 5000; ++i) {
+        char key[10] = {0};
+        sprintf(key, "%d", i);
+        blocked_bloom_filter_add_string(&bb, key);
+    }
+    mu_assert_int_eq(BLOOM_SUCCESS, blocked_bloom_filter_export(&bb, filepath));
+    mu_assert_int_eq(fsize(filepath), blocked_bloom_filter_export_size(&bb));
+    mu_assert_int_eq(969 * 64 + 24, blocked_bloom_filter_export_size(&bb));
+
+    mu_assert_int_eq(BLOOM_SUCCESS, blocked_bloom_filter_import(&imp, filepath));
+    mu_assert_int_eq(50000, imp.estimated_elements);
+    mu_assert_int_eq(5000, imp.elements_added);
+    mu_assert_int_eq(bb.number_blocks, imp.number_blocks);
+    mu_assert_int_eq(bb.number_hashes, imp.number_hashes);
+    mu_assert_int_eq(0, memcmp(bb.bloom, imp.bloom, bb.number_blocks * 64));
+    blocked_bloom_filter_destroy(&imp);
+    remove(filepath);
+
+    // a standard bloom filter is not a blocked bloom filter
+    bloom_filter_export(&b, filepath);
+    mu_assert_int_eq(BLOOM_FAILURE, blocked_bloom_filter_import(&imp, filepath));
+    remove(filepath);
+    mu_assert_int_eq(BLOOM_FAILURE, blocked_bloom_filter_import(&imp, filepath));
+    blocked_bloom_filter_destroy(&bb);
+}
+
+/*******************************************************************************
+*   Split Block Bloom Filter
+*******************************************************************************/
+MU_TEST(test_sbbf_setup) {
+    SplitBlockBloomFilter sb;
+    mu_assert_int_eq(BLOOM_SUCCESS, split_block_bloom_filter_init(&sb, 50000, 0.01));
+    mu_assert_int_eq(50000, sb.estimated_elements);
+    mu_assert_int_eq(65536, sb.number_bytes);  // 60510 bytes rounded to a power of 2
+    mu_assert_int_eq(2048, sb.number_blocks);
+    mu_assert_int_eq(0, (int)((uintptr_t)sb.bloom % 32));
+    mu_assert_int_eq(0, split_block_bloom_filter_count_set_bits(&sb));
+    // the Parquet sizing does not account for unevenly filled blocks
+    double fpr = split_block_bloom_filter_false_positive_rate(50000, sb.number_blocks);
+    mu_check(fpr > 0.01 && fpr < 0.0105);
+    split_block_bloom_filter_destroy(&sb);
+    mu_assert_null(sb.bloom);
+
+    mu_assert_int_eq(BLOOM_FAILURE, split_block_bloom_filter_init(&sb, 0, 0.01));
+    mu_assert_int_eq(BLOOM_FAILURE, split_block_bloom_filter_init(&sb, 50000, 0));
+}
+
+/* the bits must be exactly the ones the Parquet specification describes */
+MU_TEST(test_sbbf_parquet_layout) {
+    const uint32_t salts[8] = {0x47b6137b, 0x44974d91, 0x8824ad5b, 0xa2b7289d, 0x705495c7, 0x2df1424b, 0x9efc4947, 0x5c6bfb31};
+    SplitBlockBloomFilter sb;
+    split_block_bloom_filter_init(&sb, 1000, 0.01);
+
+    mu_check(split_block_bloom_filter_hash("", 0) == 0xEF46DB3751D8E999ULL);  // XXH64 seed 0
+    uint64_t hash = split_block_bloom_filter_hash("parquet", 7);
+    split_block_bloom_filter_add_bytes(&sb, "parquet", 7);
+    mu_assert_int_eq(8, split_block_bloom_filter_count_set_bits(&sb));
+
+    unsigned char *bitset = (unsigned char*)calloc(sb.number_bytes, 1);
+    split_block_bloom_filter_export_bitset(&sb, bitset);
+    uint64_t block = ((hash >> 32) * sb.number_blocks) >> 32;
+    int errors = 0;
+    for (int i = 0; i < 8; ++i) {
+        uint32_t bit = ((uint32_t)hash * salts[i]) >> 27;
+        const unsigned char *word = bitset + block * 32 + i * 4;
+        uint32_t value = word[0] | (word[1] << 8) | (word[2] << 16) | ((uint32_t)word[3] << 24);
+        errors += value == (1U << bit) ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+
+    // INT32 and INT64 values are hashed as their little endian bytes
+    unsigned char int32_bytes[4] = {0x78, 0x56, 0x34, 0x12};
+    unsigned char int64_bytes[8] = {0xef, 0xcd, 0xab, 0x89, 0x67, 0x45, 0x23, 0x01};
+    split_block_bloom_filter_add_u32(&sb, 0x12345678);
+    split_block_bloom_filter_add_u64(&sb, 0x0123456789abcdefULL);
+    mu_assert_int_eq(BLOOM_SUCCESS, split_block_bloom_filter_check_bytes(&sb, int32_bytes, 4));
+    mu_assert_int_eq(BLOOM_SUCCESS, split_block_bloom_filter_check_bytes(&sb, int64_bytes, 8));
+    mu_assert_int_eq(BLOOM_SUCCESS, split_block_bloom_filter_check_hash(&sb, hash));
+    free(bitset);
+    split_block_bloom_filter_destroy(&sb);
+}
+
+MU_TEST(test_sbbf_add_check) {
+    SplitBlockBloomFilter sb;
+    split_block_bloom_filter_init(&sb, 50000, 0.01);
+    for (int i = 0; i < 50000; ++i) {
+        char key[10] = {0};
+        sprintf(key, "%d", i);
+        split_block_bloom_filter_add_string(&sb, key);
+        split_block_bloom_filter_add_u32(&sb, i);
+    }
+    mu_assert_int_eq(100000, sb.elements_added);
+
+    int errors = 0, false_positives = 0;
+    for (int i = 0; i < 50000; ++i) {
+        char key[10] = {0};
+        sprintf(key, "%d", i);
+        errors += split_block_bloom_filter_check_string(&sb, key) == BLOOM_SUCCESS ? 0 : 1;
+        errors += split_block_bloom_filter_check_u32(&sb, i) == BLOOM_SUCCESS ? 0 : 1;
+        false_positives += split_block_bloom_filter_check_u64(&sb, i + 50000) == BLOOM_SUCCESS ? 1 : 0;
+    }
+    mu_assert_int_eq(0, errors);
+    mu_check(false_positives < 50000 * split_block_bloom_filter_current_false_positive_rate(&sb) * 1.2);
+
+    // every kernel sets and checks the same bits
+    BloomPopcountKernel kernels[4] = {BLOOM_POPCOUNT_PORTABLE, BLOOM_POPCOUNT_POPCNT, BLOOM_POPCOUNT_AVX2, BLOOM_POPCOUNT_AVX512};
+    for (int k = 0; k < 4; ++k) {
+        if (bloom_filter_set_popcount_kernel(kernels[k]) == BLOOM_FAILURE) {
+            continue;
+        }
+        SplitBlockBloomFilter kernel_sb;
+        split_block_bloom_filter_init(&kernel_sb, 50000, 0.01);
+        for (int i = 0; i < 50000; ++i) {
+            char key[10] = {0};
+            sprintf(key, "%d", i);
+            split_block_bloom_filter_add_string(&kernel_sb, key);
+            split_block_bloom_filter_add_u32(&kernel_sb, i);
+        }
+        mu_assert_int_eq(0, memcmp(sb.bloom, kernel_sb.bloom, sb.number_bytes));
+        int kernel_false_positives = 0;
+        for (int i = 0; i < 50000; ++i) {
+            errors += split_block_bloom_filter_check_u32(&kernel_sb, i) == BLOOM_SUCCESS ? 0 : 1;
+            kernel_false_positives += split_block_bloom_filter_check_u64(&kernel_sb, i + 50000) == BLOOM_SUCCESS ? 1 : 0;
+        }
+        mu_assert_int_eq(false_positives, kernel_false_positives);
+        split_block_bloom_filter_destroy(&kernel_sb);
+    }
+    bloom_filter_set_popcount_kernel(BLOOM_POPCOUNT_AUTO);
+    mu_assert_int_eq(0, errors);
+
+    split_block_bloom_filter_clear(&sb);
+    mu_assert_int_eq(0, sb.elements_added);
+    mu_assert_int_eq(0, split_block_bloom_filter_count_set_bits(&sb));
+    split_block_bloom_filter_destroy(&sb);
+}
+
+MU_TEST(test_sbbf_union) {
+    SplitBlockBloomFilter x, y, z, other;
+    split_block_bloom_filter_init(&x, 5000, 0.01);
+    split_block_bloom_filter_init(&y, 5000, 0.01);
+    split_block_bloom_filter_init(&z, 5000, 0.01);
+    split_block_bloom_filter_init(&other, 50000, 0.01);
+    for (uint64_t i = 0; i < 2500; ++i) {
+        split_block_bloom_filter_add_u64(&x, i);
+        split_block_bloom_filter_add_u64(&y, i + 2500);
+    }
+    mu_assert_int_eq(BLOOM_FAILURE, split_block_bloom_filter_union(&z, &x, &other));
+    mu_assert_int_eq(BLOOM_SUCCESS, split_block_bloom_filter_union(&z, &x, &y));
+    int errors = 0;
+    for (uint64_t i = 0; i < 5000; ++i) {
+        errors += split_block_bloom_filter_check_u64(&z, i) == BLOOM_SUCCESS ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+    mu_check(z.elements_added > 4800 && z.elements_added < 5200);
+    split_block_bloom_filter_destroy(&x);
+    split_block_bloom_filter_destroy(&y);
+    split_block_bloom_filter_destroy(&z);
+    split_block_bloom_filter_destroy(&other);
+}
+
+MU_TEST(test_sbbf_export_import) {
+    char filepath[] = "./dist/test_sbbf_export.blm";
+    SplitBlockBloomFilter sb, imp;
+    split_block_bloom_filter_init(&sb, 50000, 0.01);
+    for (uint64_t i = 0; i < 5000; ++i) {
+        split_block_bloom_filter_add_u64(&sb, i);
+    }
+    mu_assert_int_eq(BLOOM_SUCCESS, split_block_bloom_filter_export(&sb, filepath));
+    mu_assert_int_eq(65536 + 24, fsize(filepath));
+    mu_assert_int_eq(fsize(filepath), split_block_bloom_filter_export_size(&sb));
+
+    mu_assert_int_eq(BLOOM_SUCCESS, split_block_bloom_filter_import(&imp, filepath));
+    mu_assert_int_eq(50000, imp.estimated_elements);
+    mu_assert_int_eq(5000, imp.elements_added);
+    mu_assert_int_eq(2048, imp.number_blocks);
+    mu_assert_int_eq(0, memcmp(sb.bloom, imp.bloom, sb.number_bytes));
+    split_block_bloom_filter_destroy(&imp);
+    remove(filepath);
+    mu_assert_int_eq(BLOOM_FAILURE, split_block_bloom_filter_import(&imp, filepath));
+
+    // a bare Parquet bitset
+    unsigned char *bitset = (unsigned char*)calloc(sb.number_bytes, 1);
+    split_block_bloom_filter_export_bitset(&sb, bitset);
+    mu_assert_int_eq(BLOOM_FAILURE, split_block_bloom_filter_import_bitset(&imp, bitset, 100));
+    mu_assert_int_eq(BLOOM_SUCCESS, split_block_bloom_filter_import_bitset(&imp, bitset, sb.number_bytes));
+    mu_assert_int_eq(2048, imp.number_blocks);
+    mu_check(imp.elements_added > 4800 && imp.elements_added < 5200);
+    int errors = 0;
+    for (uint64_t i = 0; i < 5000; ++i) {
+        errors += split_block_bloom_filter_check_u64(&imp, i) == BLOOM_SUCCESS ? 0 : 1;
+    }
+    mu_assert_int_eq(0, errors);
+    free(bitset);
+    split_block_bloom_filter_destroy(&imp);
+    split_block_bloom_filter_destroy(&sb);
+}
+
+/*******************************************************************************
+*   Bit Sliced Bloom Index
+*******************************************************************************/
+MU_TEST(test_bsi_check) {
+    BloomFilter filters[150];
+    BloomFilter *ptrs[150];
+    BitSlicedBloomIndex idx, single;
+    for (int f = 0; f < 150; ++f) {
+        bloom_filter_init(&filters[f], 1000, 0.01);
+        ptrs[f] = &filters[f];
+    }
+    // each key is in about 1 in 25 filters; "common" is in all of them
+    for (uint64_t i = 0; i < 20000; ++i) {
+        char key[24] = {0};
+        sprintf(key, "%" PRIu64 "", i);
+        bloom_filter_add_string(&filters[(i * 7) % 150], key);
+        bloom_filter_add_u64(&filters[(i * 11) % 150], i);
+    }
+    for (int f = 0; f < 150; ++f) {
+        bloom_filter_add_string(&filters[f], "common");
+    }
+    // appended in groups that do not start on a row word and grow the rows
+    mu_assert_int_eq(BLOOM_SUCCESS, bit_sliced_bloom_index_init(&idx, &filters[0], 10));
+    mu_assert_int_eq(BLOOM_SUCCESS, bit_sliced_bloom_index_append_many(&idx, ptrs, 3));
+    mu_assert_int_eq(BLOOM_SUCCESS, bit_sliced_bloom_index_append_many(&idx, ptrs + 3, 100));
+    mu_assert_int_eq(BLOOM_SUCCESS, bit_sliced_bloom_index_append_many(&idx, ptrs + 103, 47));
+    mu_check(idx.number_filters == 150);
+    mu_check(idx.row_words == 4);
+    bit_sliced_bloom_index_init(&single, &filters[0], 150);
+    for (int f = 0; f < 150; ++f) {
+        bit_sliced_bloom_index_append(&single, &filters[f]);
+    }
+    mu_assert_int_eq(0, memcmp(idx.rows, single.rows, idx.params.number_bits * idx.row_words * sizeof(uint64_t)));
+
+    uint64_t ids[150], num_ids = 0;
+    mu_assert_int_eq(BLOOM_SUCCESS, bit_sliced_bloom_index_check_string(&idx, "common", ids, &num_ids));
+    mu_check(num_ids == 150 && ids[0] == 0 && ids[149] == 149);
+
+    BloomPopcountKernel kernels[3] = {BLOOM_POPCOUNT_PORTABLE, BLOOM_POPCOUNT_AVX2, BLOOM_POPCOUNT_AVX512};
+    int errors = 0;
+    uint64_t matches = 0;
+    for (int k = 0; k < 3; ++k) {
+        if (bloom_filter_set_popcount_kernel(kernels[k]) == BLOOM_FAILURE) {
+            continue;
+        }
+        for (uint64_t i = 0; i < 25000; i += 13) {
+            char key[24] = {0};
+            sprintf(key, "%" PRIu64 "", i);
+            uint64_t expected = 0, j = 0;
+            errors += bit_sliced_bloom_index_check_string(&idx, key, ids, &num_ids) != BLOOM_SUCCESS;
+            for (int f = 0; f < 150; ++f) {
+                if (bloom_filter_check_string(&filters[f], key) == BLOOM_SUCCESS) {
+                    errors += (j >= num_ids || ids[j] != (uint64_t)f);
+                    ++j;
+                    ++expected;
+                }
+            }
+            errors += (num_ids != expected);
+            matches += num_ids;
+
+            errors += bit_sliced_bloom_index_check_u64(&idx, i, ids, &num_ids) != BLOOM_SUCCESS;
+            for (int f = 0, j = 0; f < 150; ++f) {
+                if (bloom_filter_check_u64(&filters[f], i) == BLOOM_SUCCESS) {
+                    errors += (j >= (int)num_ids || ids[j++] != (uint64_t)f);
+                }
+            }
+            BloomKey hashed;
+            bloom_key_init_bytes(&hashed, &filters[0], key, strlen(key));
+            uint64_t key_ids[150], num_key_ids = 0;
+            errors += bit_sliced_bloom_index_check_key(&idx, &hashed, key_ids, &num_key_ids) != BLOOM_SUCCESS;
+            bit_sliced_bloom_index_check_bytes(&idx, key, strlen(key), ids, &num_ids);
+            errors += (num_ids != num_key_ids || memcmp(ids, key_ids, num_ids * sizeof(uint64_t)) != 0);
+            bloom_key_destroy(&hashed);
+        }
+    }
+    bloom_filter_set_popcount_kernel(BLOOM_POPCOUNT_AUTO);
+    mu_assert_int_eq(0, errors);
+    mu_check(matches > 0);
+
+    // filters of another size or hash do not fit
+    BloomFilter other;
+    bloom_filter_init(&other, 2000, 0.01);
+    mu_assert_int_eq(BLOOM_FAILURE, bit_sliced_bloom_index_append(&idx, &other));
+    bloom_filter_destroy(&other);
+    bloom_filter_init_options(&other, 1000, 0.01, BLOOM_HASH_XXH64, BLOOM_INDEX_MODULO);
+    mu_assert_int_eq(BLOOM_FAILURE, bit_sliced_bloom_index_append(&idx, &other));
+    mu_check(idx.number_filters == 150);
+    bloom_filter_destroy(&other);
+
+    bit_sliced_bloom_index_destroy(&idx);
+    bit_sliced_bloom_index_destroy(&single);
+    for (int f = 0; f < 150; ++f) {
+        bloom_filter_destroy(&filters[f]);
+    }
+}
+
+MU_TEST(test_bsi_on_disk) {
+    char filepath[] = "./dist/test_bsi.idx";
+    char exported[] = "./dist/test_bsi_export.idx";
+    char names[70][40];
+    const char *filepaths[70];
+    BloomFilter filters[70];
+    BitSlicedBloomIndex idx, imp;
+    for (int f = 0; f < 70; ++f) {
+        bloom_filter_init_options(&filters[f], 1000, 0.01, BLOOM_HASH_XXH64, BLOOM_INDEX_FASTRANGE);
+        for (uint64_t i = f; i < 7000; i += 70) {
+            bloom_filter_add_u64(&filters[f], i);
+        }
+        sprintf(names[f], "./dist/test_bsi_%d.blm", f);
+        filepaths[f] = names[f];
+        bloom_filter_export(&filters[f], names[f]);
+    }
+
+    // built on disk from the exported filters, then the rows are widened in place
+    mu_assert_int_eq(BLOOM_SUCCESS, bit_sliced_bloom_index_build_from_files(&idx, filepaths, 60, filepath));
+    mu_check(idx.number_filters == 60);
+    mu_assert_int_eq(BLOOM_SUCCESS, bit_sliced_bloom_index_append(&idx, &filters[60]));
+    mu_check(idx.number_filters == 61 && idx.row_words == 1);
+    bit_sliced_bloom_index_destroy(&idx);
+
+    mu_assert_int_eq(BLOOM_SUCCESS, bit_sliced_bloom_index_import_on_disk(&imp, filepath));
+    mu_check(imp.number_filters == 61);
+    mu_assert_int_eq(BLOOM_HASH_XXH64, imp.params.hash_type);
+    mu_assert_int_eq(BLOOM_INDEX_FASTRANGE, imp.params.index_mapping);
+    BloomFilter *rest[9];
+    for (int f = 61; f < 70; ++f) {
+        rest[f - 61] = &filters[f];
+    }
+    mu_assert_int_eq(BLOOM_SUCCESS, bit_sliced_bloom_index_append_many(&imp, rest, 9));
+    mu_check(imp.number_filters == 70 && imp.row_words == 2);
+    bit_sliced_bloom_index_destroy(&imp);
+
+    mu_assert_int_eq(BLOOM_SUCCESS, bit_sliced_bloom_index_import(&imp, filepath));
+    mu_assert_int_eq(BLOOM_SUCCESS, bit_sliced_bloom_index_export(&imp, exported));
+    mu_assert_int_eq(fsize(filepath), fsize(exported));
+    mu_assert_int_eq(64 + imp.params.number_bits * 2 * 8, fsize(exported));
+    bit_sliced_bloom_index_destroy(&imp);
+    mu_assert_int_eq(BLOOM_SUCCESS, bit_sliced_bloom_index_import(&imp, exported));
+    mu_check(imp.number_filters == 70);
+
+    uint64_t ids[70], num_ids = 0;
+    int errors = 0;
+    for (uint64_t i = 0; i < 7000; i += 3) {
+        bit_sliced_bloom_index_check_u64(&imp, i, ids, &num_ids);
+        int found = 0;
+        for (uint64_t j = 0, f = 0; f < 70; ++f) {
+            if (bloom_filter_check_u64(&filters[f], i) == BLOOM_SUCCESS) {
+                errors += (j >= num_ids || ids[j++] != f);
+            }
+        }
+        for (uint64_t j = 0; j < num_ids; ++j) {
+            found += ids[j] == i % 70;
+        }
+        errors += found != 1;
+    }
+    mu_assert_int_eq(0, errors);
+    bit_sliced_bloom_index_destroy(&imp);
+
+    // not an index, and a missing filter
+    mu_assert_int_eq(BLOOM_FAILURE, bit_sliced_bloom_index_import(&imp, filepaths[0]));
+    remove(filepaths[5]);
+    mu_assert_int_eq(BLOOM_FAILURE, bit_sliced_bloom_index_build_from_files(&idx, filepaths, 10, NULL));
+    for (int f = 0; f < 70; ++f) {
+        bloom_filter_destroy(&filters[f]);
+        remove(filepaths[f]);
+    }
+    remove(filepath);
+    remove(exported);
+}
+
+/*******************************************************************************
+*   Bloom Filter Tree
+*******************************************************************************/
+MU_TEST(test_bloom_tree_check) {
+    BloomFilter filters[100];
+    BloomFilter *ptrs[100];
+    for (int f = 0; f < 100; ++f) {
+        bloom_filter_init(&filters[f], 500, 0.01);
+        ptrs[f] = &filters[f];
+        for (uint64_t i = f; i < 10000; i += 100) {
+            char key[24] = {0};
+            sprintf(key, "%" PRIu64 "", i);
+            bloom_filter_add_string(&filters[f], key);
+            bloom_filter_add_u64(&filters[f], i);
+        }
+        bloom_filter_add_string(&filters[f], "common");
+    }
+
+    unsigned int fanouts[3] = {2, 3, 64};
+    uint64_t ids[100], num_ids = 0;
+    int errors = 0;
+    for (int t = 0; t < 3; ++t) {
+        BloomFilterTree tree;
+        mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_tree_build(&tree, ptrs, 100, fanouts[t], 2));
+        mu_check(tree.number_leaves == 100);
+        // 100 leaves with a fanout of 3: 34, 12, 4, 2, and 1 nodes above them
+        if (fanouts[t] == 3) {
+            mu_check(tree.number_levels == 6 && tree.number_nodes == 153);
+        }
+
+        // the root is the union of all of the filters
+        BloomFilter all;
+        bloom_filter_init(&all, 500, 0.01);
+        bloom_filter_union_many(&all, ptrs, 100);
+        mu_assert_int_eq(0, memcmp(tree.nodes, all.bloom, all.bloom_length));
+        bloom_filter_destroy(&all);
+
+        mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_tree_check_string(&tree, "common", ids, &num_ids));
+        mu_check(num_ids == 100 && ids[0] == 0 && ids[99] == 99);
+        for (uint64_t i = 0; i < 12000; i += 7) {
+            char key[24] = {0};
+            sprintf(key, "%" PRIu64 "", i);
+            errors += bloom_filter_tree_check_string(&tree, key, ids, &num_ids) != BLOOM_SUCCESS;
+            uint64_t j = 0;
+            for (int f = 0; f < 100; ++f) {
+                if (bloom_filter_check_string(&filters[f], key) == BLOOM_SUCCESS) {
+                    errors += (j >= num_ids || ids[j] != (uint64_t)f);
+                    ++j;
+                }
+            }
+            errors += (num_ids != j);
+            // keys past 10000 were never added; they should be rejected near the root
+            errors += (i < 10000 && (num_ids == 0 || ids[0] > i % 100));
+
+            bloom_filter_tree_check_u64(&tree, i, ids, &num_ids);
+            j = 0;
+            for (int f = 0; f < 100; ++f) {
+                if (bloom_filter_check_u64(&filters[f], i) == BLOOM_SUCCESS) {
+                    errors += (j >= num_ids || ids[j++] != (uint64_t)f);
+                }
+            }
+            errors += (num_ids != j);
+
+            BloomKey hashed;
+            uint64_t key_ids[100], num_key_ids = 0;
+            bloom_key_init_bytes(&hashed, &filters[0], key, strlen(key));
+            errors += bloom_filter_tree_check_key(&tree, &hashed, key_ids, &num_key_ids) != BLOOM_SUCCESS;
+            bloom_filter_tree_check_bytes(&tree, key, strlen(key), ids, &num_ids);
+            errors += (num_ids != num_key_ids || memcmp(ids, key_ids, num_ids * sizeof(uint64_t)) != 0);
+            bloom_key_destroy(&hashed);
+        }
+        bloom_filter_tree_destroy(&tree);
+    }
+    mu_assert_int_eq(0, errors);
+
+    // a single filter is its own root
+    BloomFilterTree tree;
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_tree_build(&tree, ptrs, 1, 2, 1));
+    mu_check(tree.number_levels == 1 && tree.number_nodes == 1);
+    bloom_filter_tree_check_u64(&tree, 0, ids, &num_ids);
+    mu_check(num_ids == 1 && ids[0] == 0);
+    bloom_filter_tree_destroy(&tree);
+
+    // bad fanouts and filters that do not match
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_tree_build(&tree, ptrs, 100, 1, 1));
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_tree_build(&tree, ptrs, 100, 65, 1));
+    BloomFilter other;
+    bloom_filter_init(&other, 2000, 0.01);
+    ptrs[50] = &other;
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_tree_build(&tree, ptrs, 100, 4, 1));
+    bloom_filter_destroy(&other);
+    for (int f = 0; f < 100; ++f) {
+        bloom_filter_destroy(&filters[f]);
+    }
+}
+
+MU_TEST(test_bloom_tree_on_disk) {
+    char directory[] = "./dist/test_tree";
+    char filepath[] = "./dist/test_tree.bft";
+    char exported[] = "./dist/test_tree_export.bft";
+    char names[40][60];
+    BloomFilter filters[40];
+    BloomFilterTree tree, imp;
+    mkdir(directory, 0755);
+    for (int f = 0; f < 40; ++f) {
+        bloom_filter_init_options(&filters[f], 1000, 0.01, BLOOM_HASH_XXH64, BLOOM_INDEX_FASTRANGE);
+        for (uint64_t i = f; i < 4000; i += 40) {
+            bloom_filter_add_u64(&filters[f], i);
+        }
+        // named so that name order is leaf order
+        sprintf(names[f], "%s/filter_%02d.blm", directory, f);
+        bloom_filter_export(&filters[f], names[f]);
+    }
+    FILE *fp = fopen("./dist/test_tree/notes.txt", "w");
+    fputs("not a bloom filter", fp);
+    fclose(fp);
+
+    // built into a mapped file from the .blm files of the directory
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_tree_build_from_directory(&tree, directory, 4, filepath, 3));
+    // 40 leaves with a fanout of 4: 10, 3, and 1 nodes above them
+    mu_check(tree.number_leaves == 40 && tree.number_levels == 4 && tree.number_nodes == 54);
+    bloom_filter_tree_destroy(&tree);
+    mu_assert_int_eq(64 + 54 * ((filters[0].bloom_length + 63) / 64 * 64), fsize(filepath));
+
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_tree_import_on_disk(&imp, filepath));
+    mu_check(imp.number_leaves == 40 && imp.fanout == 4);
+    mu_assert_int_eq(BLOOM_HASH_XXH64, imp.params.hash_type);
+    mu_assert_int_eq(BLOOM_INDEX_FASTRANGE, imp.params.index_mapping);
+    mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_tree_export(&imp, exported));
+    bloom_filter_tree_destroy(&imp);
+    mu_assert_int_eq(fsize(filepath), fsize(exported));
+
+    uint64_t ids[40], num_ids = 0;
+    int errors = 0;
+    for (int on_disk = 0; on_disk < 2; ++on_disk) {
+        if (on_disk) {
+            mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_tree_import_on_disk(&imp, exported));
+        } else {
+            mu_assert_int_eq(BLOOM_SUCCESS, bloom_filter_tree_import(&imp, exported));
+        }
+        for (uint64_t i = 0; i < 5000; i += 3) {
+            bloom_filter_tree_check_u64(&imp, i, ids, &num_ids);
+            uint64_t j = 0;
+            int found = 0;
+            for (uint64_t f = 0; f < 40; ++f) {
+                if (bloom_filter_check_u64(&filters[f], i) == BLOOM_SUCCESS) {
+                    errors += (j >= num_ids || ids[j++] != f);
+                }
+            }
+            errors += (num_ids != j);
+            for (j = 0; j < num_ids; ++j) {
+                found += ids[j] == i % 40;
+            }
+            errors += (i < 4000 && found != 1);
+        }
+        bloom_filter_tree_destroy(&imp);
+    }
+    mu_assert_int_eq(0, errors);
+
+    // not a tree, a missing directory, and a missing filter
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_tree_import(&imp, names[0]));
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_tree_import_on_disk(&imp, names[0]));
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_tree_build_from_directory(&tree, "./dist/no_such_directory", 4, NULL, 1));
+    const char *filepaths[3] = {names[0], "./dist/test_tree/missing.blm", names[1]};
+    mu_assert_int_eq(BLOOM_FAILURE, bloom_filter_tree_build_from_files(&tree, filepaths, 3, 2, NULL, 1));
+    for (int f = 0; f < 40; ++f) {
+        bloom_filter_destroy(&filters[f]);
+        remove(names[f]);
+    }
+    remove("./dist/test_tree/notes.txt");
+    remove(directory);
+    remove(filepath);
+    remove(exported);
+}
+
 /*******************************************************************************
 *   Test Statistics
 *******************************************************************************/
@@ -850,6 +2760,11 @@ MU_TEST_SUITE(test_suite) {
     /* hashes */
     MU_RUN_TEST(test_bloom_hashes_values);
     MU_RUN_TEST(test_bloom_hashes_start_collisions);
+    MU_RUN_TEST(test_bloom_hashes_into);
+    MU_RUN_TEST(test_bloom_hashes_noalloc);
+    MU_RUN_TEST(test_bloom_hashes_double);
+    MU_RUN_TEST(test_bloom_hashes_families);
+    MU_RUN_TEST(test_bloom_index_mapping);
 
     /* set and contains */
     MU_RUN_TEST(test_bloom_set);
@@ -859,13 +2774,40 @@ MU_TEST_SUITE(test_suite) {
     MU_RUN_TEST(test_bloom_check_false_positive);
     MU_RUN_TEST(test_bloom_check_failure);
 
+    /* bytes keys */
+    MU_RUN_TEST(test_bloom_bytes_same_as_string);
+    MU_RUN_TEST(test_bloom_bytes_embedded_nul);
+    MU_RUN_TEST(test_bloom_bytes_batch);
+    MU_RUN_TEST(test_bloom_batch_same_as_single);
+    MU_RUN_TEST(test_bloom_check_batch_interleaved);
+    MU_RUN_TEST(test_bloom_check_many_filters);
+    MU_RUN_TEST(test_bloom_bulk_load);
+    MU_RUN_TEST(test_bloom_parallel_build);
+    MU_RUN_TEST(test_bloom_bytes_hash_function);
+
+    /* integer keys */
+    MU_RUN_TEST(test_bloom_u64);
+    MU_RUN_TEST(test_bloom_u32_u128);
+    MU_RUN_TEST(test_bloom_u64_on_disk);
+    MU_RUN_TEST(test_bloom_on_disk_sync_interval);
+
+    /* thread safety */
+    MU_RUN_TEST(test_bloom_thread_safe_pthreads);
+    MU_RUN_TEST(test_bloom_thread_safe_count_exported);
+    MU_RUN_TEST(test_bloom_track_bits);
+    MU_RUN_TEST(test_bloom_track_bits_pthreads);
+    MU_RUN_TEST(test_bloom_add_if_absent);
+    MU_RUN_TEST(test_bloom_add_if_absent_pthreads);
+
     /* clear, reset */
     MU_RUN_TEST(test_bloom_clear);
     MU_RUN_TEST(test_bloom_clear_on_disk);
 
     /* statistics */
     MU_RUN_TEST(test_bloom_current_false_positive_rate);
+    MU_RUN_TEST(test_bloom_storage_aligned);
     MU_RUN_TEST(test_bloom_count_set_bits);
+    MU_RUN_TEST(test_bloom_popcount_kernels);
     MU_RUN_TEST(test_bloom_export_size);
     MU_RUN_TEST(test_bloom_estimate_elements);
     MU_RUN_TEST(test_bloom_set_elements_to_estimated);
@@ -878,6 +2820,9 @@ MU_TEST_SUITE(test_suite) {
     MU_RUN_TEST(test_bloom_import_fail);
     MU_RUN_TEST(test_bloom_import_on_disk);
     MU_RUN_TEST(test_bloom_import_on_disk_fail);
+    MU_RUN_TEST(test_bloom_export_import_hash_type);
+    MU_RUN_TEST(test_bloom_on_disk_hash_type);
+    MU_RUN_TEST(test_bloom_export_import_index_mapping);
 
     /* import and export hex strings */
     MU_RUN_TEST(test_bloom_export_hex);
@@ -891,6 +2836,31 @@ MU_TEST_SUITE(test_suite) {
     MU_RUN_TEST(test_bloom_filter_intersection);
     MU_RUN_TEST(test_bloom_filter_interesection_57);
     MU_RUN_TEST(test_bloom_filter_jaccard);
+    MU_RUN_TEST(test_bloom_filter_pair_counts);
+    MU_RUN_TEST(test_bloom_filter_union_intersect_many);
+    MU_RUN_TEST(test_bloom_filter_bulk_threads);
+
+    /* Blocked Bloom Filter */
+    MU_RUN_TEST(test_blocked_bloom_setup);
+    MU_RUN_TEST(test_blocked_bloom_add_check);
+    MU_RUN_TEST(test_blocked_bloom_u64);
+    MU_RUN_TEST(test_blocked_bloom_union);
+    MU_RUN_TEST(test_blocked_bloom_export_import);
+
+    /* Split Block Bloom Filter */
+    MU_RUN_TEST(test_sbbf_setup);
+    MU_RUN_TEST(test_sbbf_parquet_layout);
+    MU_RUN_TEST(test_sbbf_add_check);
+    MU_RUN_TEST(test_sbbf_union);
+    MU_RUN_TEST(test_sbbf_export_import);
+
+    /* Bit Sliced Bloom Index */
+    MU_RUN_TEST(test_bsi_check);
+    MU_RUN_TEST(test_bsi_on_disk);
+
+    /* Bloom Filter Tree */
+    MU_RUN_TEST(test_bloom_tree_check);
+    MU_RUN_TEST(test_bloom_tree_on_disk);
 
     /* Statistics */
     MU_RUN_TEST(test_bloom_filter_stat);
@@ -963,6 +2933,18 @@ static uint64_t* fake_hash(int num_hashes, const char *str) {
     return hashes;
 }
 
+static void fake_hash_noalloc(int num_hashes, const char *str, uint64_t *results) {
+    uint64_t* hashes = fake_hash(num_hashes, str);
+    memcpy(results, hashes, num_hashes * sizeof(uint64_t));
+    free(hashes);
+}
+
+static void fake_hash_bytes(int num_hashes, const void *key, size_t len, uint64_t *results) {
+    char str[64] = {0};
+    memcpy(str, key, len < 63 ? len : 63);
+    fake_hash_noalloc(num_hashes, str, results);
+}
+
 static uint64_t hasher(const char *key) {
     int i, len = strlen(key);
     uint64_t h = 14695981039346656073ULL; // FNV_OFFSET 64 bit
@@ -972,3 +2954,30 @@ static uint64_t hasher(const char *key) {
     }
     return h;
 }
+
+static void* add_thread_range(void *arg) {
+    ThreadRange *range = (ThreadRange*)arg;
+    for (uint64_t i = range->start; i < range->end; ++i) {
+        char key[24] = {0};
+        sprintf(key, "%" PRIu64 "", i);
+        bloom_filter_add_string(range->bf, key);
+        bloom_filter_add_u64(range->bf, i);
+    }
+    return NULL;
+}
+
+static void* add_if_absent_range(void *arg) {
+    AbsentRange *range = (AbsentRange*)arg;
+    for (uint64_t i = 0; i < range->num_keys; ++i) {
+        char key[24] = {0};
+        sprintf(key, "%" PRIu64 "", i);
+        range->added[i] = bloom_filter_add_if_absent(range->bf, key) == BLOOM_SUCCESS;
+    }
+    return NULL;
+}
+
+static const char* number_key(size_t idx, char *buffer, size_t *length, void *user_data) {
+    uint64_t offset = *(uint64_t*)user_data;
+    *length = sprintf(buffer, "%" PRIu64 "", offset + idx);
+    return buffer;
+}